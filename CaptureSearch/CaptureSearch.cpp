@@ -0,0 +1,335 @@
+#include <Windows.h>
+#include "Lib/CmdLine.h"
+#include "CaptureFile.h"
+
+
+// Reads a Sernic capture file (option -o): prints the records of a time
+// window, or finds a text or byte pattern in them. The capture is mapped
+// into memory, the window is found with the index and the data is searched
+// in place.
+//
+namespace
+{
+	constexpr std::array cOriginNames{ "RX        "sv, "TX gdb    "sv, "TX console"sv, "TX raw    "sv, "TX shm    "sv };
+	constexpr size_t cContextSize{ 60 };		// bytes printed before and after a match
+
+	void Usage()
+	{
+		std::cout << "Usage:\n\n";
+		std::cout << "CaptureSearch captureFile [-f from] [-t to] [-s text | -x hexBytes] [-u]\n\n";
+		std::cout << "where\n";
+		std::cout << "\tcaptureFile - file written by Sernic with the -o option (compressed or not)\n";
+		std::cout << "\tfrom, to - time window, \"YYYY-MM-DD HH:MM[:SS]\", or HH:MM[:SS] on the first day\n";
+		std::cout << "\tof the capture (default: the whole capture)\n";
+		std::cout << "\ttext - text to find, the records with it are printed\n";
+		std::cout << "\thexBytes - bytes to find, in hex (for example 2423)\n";
+		std::cout << "\t-u - the times are UTC (default: local time)\n\n";
+		std::cout << "Without -s or -x all the records in the window are printed.\n";
+	}
+
+
+	// A file mapped into memory, read only. The file may still be written.
+	//
+	class MappedFile : NonCopyable
+	{
+	public:
+		~MappedFile()
+		{
+			if (m_pView)
+				UnmapViewOfFile(m_pView);
+
+			if (m_mapping)
+				CloseHandle(m_mapping);
+
+			if (m_file != INVALID_HANDLE_VALUE)
+				CloseHandle(m_file);
+		}
+
+		// Returns false on error
+		//
+		bool Open(const std::string& path)
+		{
+			m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
+
+			LARGE_INTEGER size{};
+
+			if (m_file == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_file, &size))
+				return false;
+
+			if ((uint64_t)size.QuadPart > std::numeric_limits<size_t>::max())
+			{
+				std::cerr << path << " is too big for the 32-bit build\n";
+				return false;
+			}
+
+			if (size.QuadPart == 0)
+				return true;
+
+			m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+			m_pView = m_mapping ? MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+
+			if (!m_pView)
+				return false;
+
+			m_data = { (const uint8_t*)m_pView, (size_t)size.QuadPart };
+
+			return true;
+		}
+
+		std::span<const uint8_t> GetData() const { return m_data; }
+
+	private:
+		HANDLE m_file{ INVALID_HANDLE_VALUE };
+		HANDLE m_mapping{};
+		void* m_pView{};
+		std::span<const uint8_t> m_data;
+	};
+
+
+	// Converts between the capture times (UTC) and the times the user reads
+	// and types
+	//
+	class TimeFormat
+	{
+	public:
+		explicit TimeFormat(const bool isUtc)
+			: m_pZone{ isUtc ? nullptr : std::chrono::current_zone() }
+		{
+		}
+
+		void Print(std::ostream& os, const uint64_t time) const
+		{
+			using namespace std::chrono;
+
+			auto localTime{ ToLocal(sys_time<microseconds>{ microseconds{ time } }) };
+			auto day{ floor<days>(localTime) };
+			year_month_day date{ day };
+			hh_mm_ss timeOfDay{ localTime - day };
+
+			os << std::setfill('0')
+				<< (int)date.year() << '-' << std::setw(2) << (uint)date.month() << '-' << std::setw(2) << (uint)date.day() << ' '
+				<< std::setw(2) << timeOfDay.hours().count() << ':' << std::setw(2) << timeOfDay.minutes().count() << ':'
+				<< std::setw(2) << timeOfDay.seconds().count() << '.' << std::setw(6) << timeOfDay.subseconds().count()
+				<< std::setfill(' ');
+		}
+
+		// Parses "YYYY-MM-DD HH:MM[:SS]" (or with a 'T' between the date and
+		// the time), or "HH:MM[:SS]" on the day of firstTime.
+		// Returns false if the text is not valid.
+		//
+		bool Parse(const std::string_view text, const uint64_t firstTime, uint64_t& time) const
+		{
+			using namespace std::chrono;
+
+			int year{}, month{}, day{}, hour{}, minute{}, second{};
+			std::string value{ text };
+			std::replace(value.begin(), value.end(), 'T', ' ');
+
+			local_days date{ floor<days>(ToLocal(sys_time<microseconds>{ microseconds{ firstTime } })) };
+			int length{};
+
+			if (std::sscanf(value.c_str(), "%d-%d-%d %d:%d%n", &year, &month, &day, &hour, &minute, &length) == 5)
+			{
+				year_month_day ymd{ std::chrono::year{ year }, std::chrono::month{ (uint)month }, std::chrono::day{ (uint)day } };
+
+				if (!ymd.ok())
+					return false;
+
+				date = local_days{ ymd };
+			}
+			else if (std::sscanf(value.c_str(), "%d:%d%n", &hour, &minute, &length) != 2)
+				return false;
+
+			int secondLength{};
+
+			if (std::sscanf(value.c_str() + length, ":%d%n", &second, &secondLength) == 1)
+				length += secondLength;
+
+			if ((size_t)length != value.size() || hour < 0 || hour > 23 || minute < 0 || minute > 59 || second < 0 || second > 59)
+				return false;
+
+			local_time<microseconds> localTime{ date + hours{ hour } + minutes{ minute } + seconds{ second } };
+
+			time = (uint64_t)ToSys(localTime).time_since_epoch().count();
+
+			return true;
+		}
+
+	private:
+		using LocalTime = std::chrono::local_time<std::chrono::microseconds>;
+		using SysTime = std::chrono::sys_time<std::chrono::microseconds>;
+
+		LocalTime ToLocal(const SysTime time) const
+		{
+			return m_pZone ? m_pZone->to_local(time) : LocalTime{ time.time_since_epoch() };
+		}
+
+		SysTime ToSys(const LocalTime time) const
+		{
+			return m_pZone ? m_pZone->to_sys(time, std::chrono::choose::earliest) : SysTime{ time.time_since_epoch() };
+		}
+
+		const std::chrono::time_zone* m_pZone;
+	};
+
+
+	// Parses bytes in hex ("2423" or "24 23"). Returns false if the text is
+	// not valid.
+	//
+	bool ParseHex(const std::string_view text, std::vector<uint8_t>& bytes)
+	{
+		std::string digits;
+		std::copy_if(text.begin(), text.end(), std::back_inserter(digits), [](char c) { return c != ' '; });
+
+		if (digits.empty() || digits.size() % 2 != 0)
+			return false;
+
+		for (size_t index{}; index < digits.size(); index += 2)
+		{
+			uint8_t byte{};
+			auto result{ std::from_chars(digits.data() + index, digits.data() + index + 2, byte, 16) };
+
+			if (result.ec != std::errc{} || result.ptr != digits.data() + index + 2)
+				return false;
+
+			bytes.push_back(byte);
+		}
+
+		return true;
+	}
+
+
+	// Prints the data with the bytes that are not printable in hex
+	//
+	void PrintData(std::ostream& os, const std::span<const uint8_t> data)
+	{
+		for (uint8_t byte : data)
+		{
+			if (byte >= 0x20 && byte < 0x7F && byte != '\\')
+				os << (char)byte;
+			else
+				os << "\\x" << std::hex << std::setw(2) << std::setfill('0') << (uint)byte << std::dec << std::setfill(' ');
+		}
+	}
+
+
+	void PrintRecord(const TimeFormat& timeFormat, const CaptureReader::Record& record, const std::span<const uint8_t> data)
+	{
+		timeFormat.Print(std::cout, record.time);
+		std::cout << ' ' << cOriginNames[(size_t)record.origin] << ' ';
+		PrintData(std::cout, data);
+		std::cout << '\n';
+	}
+}
+
+
+int main(int argc, char* argv[])
+{
+	CmdLine cmdLine{ argc, argv, { "f"sv, "t"sv, "s"sv, "x"sv, "u"sv } };
+
+	if (!cmdLine.IsOk() || cmdLine.GetNumArguments() != 1 || (cmdLine.HasOption("s"sv) && cmdLine.HasOption("x"sv)))
+	{
+		Usage();
+		return -1;
+	}
+
+	const std::string path{ cmdLine.GetArgument(0) };
+	MappedFile file;
+	MappedFile index;
+	CaptureReader reader;
+
+	if (!file.Open(path) || !reader.Open(file.GetData()))
+	{
+		std::cerr << "Failed to open capture file " << path << std::endl;
+		return -1;
+	}
+
+	if (!index.Open(path + std::string{ cCaptureIndexSuffix }) || !reader.Open(file.GetData(), index.GetData()) || reader.GetNumIndexEntries() == 0)
+		std::cerr << "No index, reading the capture from the start\n";
+
+	CaptureReader::Record firstRecord;
+
+	if (!reader.Read(reader.GetBegin(), &firstRecord))
+	{
+		std::cerr << "The capture is empty\n";
+		return 0;
+	}
+
+	// The time window
+
+	const TimeFormat timeFormat{ cmdLine.HasOption("u"sv) };
+	uint64_t begin{ reader.GetBegin() };
+	uint64_t end{ reader.GetEnd() };
+
+	for (auto [option, pOffset] : { std::pair{ "f"sv, &begin }, std::pair{ "t"sv, &end } })
+	{
+		if (!cmdLine.HasOption(option))
+			continue;
+
+		uint64_t time{};
+
+		if (!timeFormat.Parse(cmdLine.GetOption(option), firstRecord.time, time))
+		{
+			std::cerr << "Invalid time " << cmdLine.GetOption(option) << '\n';
+			return -1;
+		}
+
+		*pOffset = reader.Seek(time);
+	}
+
+	end = std::max(begin, end);
+
+	// The pattern
+
+	std::vector<uint8_t> pattern;
+
+	if (cmdLine.HasOption("s"sv))
+	{
+		auto text{ cmdLine.GetOption("s"sv) };
+		pattern.assign(text.begin(), text.end());
+	}
+	else if (cmdLine.HasOption("x"sv) && !ParseHex(cmdLine.GetOption("x"sv), pattern))
+	{
+		std::cerr << "Invalid hex bytes\n";
+		return -1;
+	}
+
+	if (cmdLine.HasOption("s"sv) && pattern.empty())
+	{
+		std::cerr << "Empty text\n";
+		return -1;
+	}
+
+	auto startTime{ std::chrono::steady_clock::now() };
+	uint64_t numRecords{};
+
+	if (pattern.empty())
+	{
+		CaptureReader::Record record;
+
+		for (uint64_t offset{ begin }; offset < end && reader.Read(offset, &record); offset = reader.GetNext(record))
+		{
+			PrintRecord(timeFormat, record, record.data);
+			++numRecords;
+		}
+	}
+	else
+	{
+		Lib::SubstringSearch search{ pattern };
+
+		reader.Search(begin, end, search, [&](const CaptureReader::Record& record, const size_t position)
+			{
+				size_t first{ position > cContextSize ? position - cContextSize : 0 };
+				PrintRecord(timeFormat, record, record.data.subspan(first, std::min(record.data.size() - first, position - first + pattern.size() + cContextSize)));
+				++numRecords;
+			});
+	}
+
+	std::chrono::duration<double> seconds{ std::chrono::steady_clock::now() - startTime };
+
+	std::cerr << std::fixed << std::setprecision(1)
+			<< (pattern.empty() ? "Printed " : "Found ") << numRecords << (pattern.empty() ? " records" : " matches")
+			<< " in " << (end - begin) / 1024.0 / 1024.0 << " MB, " << seconds.count() * 1000 << " ms\n";
+
+	return 0;
+}
@@ -1,6 +1,7 @@
 #include <cassert>
 #include "IFilter.h"
 #include "BaseClient.h"
+#include "Log.h"
 
 
 BaseClient::BaseClient(
@@ -16,55 +17,53 @@ BaseClient::BaseClient(
 }
 
 
+// Resumes the coroutine waiting for the indexed event. Runner does it
+// without calling ProcessEvent (see ResumeWaiter), so it only gets here
+// for an event that no coroutine waits for.
+// Returns the number of bytes received, 0 if no data was received or -1 on error.
+//
+int BaseClient::ProcessEvent(const uint index, Buffer** ppRxBuffer)
+{
+	if (auto waiter{ *m_waiters.GetSlot(index) })
+		return ResumeWaiter(waiter, ppRxBuffer);
+
+	LogError() << "BUG: " << m_name << " has no coroutine waiting for event " << index;
+
+	return -1;
+}
+
+
 // If a TX filter is present it filters the buffer.
-// Returns true if m_pTxBuffer has to be sent now.
+// Queues the buffer(s) and wakes up the send loop if it is idle.
+// Returns false on error.
 //
-bool BaseClient::PrepareSend(const Buffer* pBuffer)
+bool BaseClient::QueueSend(const Buffer* pBuffer)
 {
 	assert(pBuffer);
-	bool shouldSendNow{ !m_pTxBuffer };	// don't send if sender is busy
-
-	if (m_pTxFilter)
-	{
-		uint numFilteredBuffers{ m_pTxFilter->Process(pBuffer) };
-		shouldSendNow &= numFilteredBuffers > 0;
-
-		if (shouldSendNow)
-		{
-			m_pTxBuffer = m_pTxFilter->GetResult();
-			--numFilteredBuffers;
-		}
-
-		// Any remaining filtered buffers are queued for later
-		//
-		while (numFilteredBuffers--)
-			m_txQueue.Enqueue(m_pTxFilter->GetResult());
-	}
-	else
-	{
-		if (shouldSendNow)
-			m_pTxBuffer = pBuffer;
-		else
-			m_txQueue.Enqueue(pBuffer);
-	}
-
-	return shouldSendNow;
+
+	FilterTx(pBuffer, [this](const Buffer* pTxBuffer) { QueueBuffer(pTxBuffer); });
+
+	return ResumeSendLoop();
 }
 
 
-// Returns zero on success
+// Wakes up the send loop if it is waiting for data.
+// Returns false if the send loop has failed.
 //
-int BaseClient::OnDataSent()
+bool BaseClient::ResumeSendLoop()
 {
-	assert(m_pTxBuffer);
+	m_waiters.Resume(cTxDataWaiter);
 
-	m_bufferPool.PutBuffer(m_pTxBuffer);
-	m_pTxBuffer = {};
+	return !std::exchange(m_hasFailed, false);
+}
 
-	// Send the next queued buffer (if any)
 
-	if (const Buffer* pBuffer; m_txQueue.Dequeue(&pBuffer))
-		return Send(pBuffer) ? 0 : -1;
+void BaseClient::QueueBuffer(const Buffer* pBuffer)
+{
+	// If the queue is full the data is lost
 
-	return 0;
+	if (m_txQueue.Enqueue(pBuffer))
+		m_bufferPool.SetOwner(pBuffer, m_name);
+	else
+		m_bufferPool.PutBuffer(pBuffer);
 }
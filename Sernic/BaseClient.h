@@ -1,32 +1,135 @@
 #pragma once
 
 #include "Lib/BlockQueue.h"
+#include "Lib/Coroutine.h"
 #include "Buffers.h"
 #include "IClient.h"
-
-struct IFilter;
+#include "IFilter.h"
 
 
+// Base of the clients written as coroutines.
+//
+// A client runs one or more coroutine loops (Lib::Task). A loop starts an
+// overlapped operation and then awaits WaitForEvent(index) for the event
+// the client has given to Runner at that index. Runner resumes the loop
+// with ResumeWaiter, which handles the completion, reports received data
+// with Deliver (or an error with Fail) and starts the next operation
+// before it suspends. ProcessEvent is left for the events no loop waits for.
+//
+// Data to be sent goes through the TX filter (if any) into m_txQueue.
+// The client's send loop takes buffers from the queue and awaits
+// WaitForTxData when the queue is empty.
+//
 class BaseClient : public IClient
 {
+public:
+	BaseClient* GetCoroutineClient() override { return this; }
+
+	// The slot of the loop waiting for the indexed event, which stays the
+	// same while the client is open (see Lib::EventWaiters)
+	std::coroutine_handle<>* GetWaiterSlot(uint index) { return m_waiters.GetSlot(index); }
+
+	// Resumes the loop taken from the slot and returns when it suspends.
+	// Returns like ProcessEvent.
+	int ResumeWaiter(std::coroutine_handle<> waiter, Buffer** ppRxBuffer);
+
 protected:
+	// The maximum number of events of a client
+	static constexpr uint cMaxEvents{ 8 };
+
 	BaseClient(
 			std::string_view name,
 			BufferPool& bufferPool,
 			uint numTxBuffers,
 			std::unique_ptr<IFilter> pTxFilter);
 
+	// Resumes the coroutine waiting for the indexed event, if any
+	int ProcessEvent(uint index, Buffer** ppRxBuffer) override;
+
 	// If a TX filter is present it filters the buffer.
-	// Returns true if m_pTxBuffer has to be sent now.
-	bool PrepareSend(const Buffer* pBuffer);
+	// Queues the buffer(s) and wakes up the send loop.
+	// Returns false on error.
+	bool QueueSend(const Buffer* pBuffer);
+
+	// Passes the buffer through the TX filter (if any) and calls
+	// onBuffer(const Buffer*) for the buffer or for each filtered buffer
+	template<typename F>
+	void FilterTx(const Buffer* pBuffer, F onBuffer);
 
-	// Returns zero on success
-	int OnDataSent();
+	// Queues a buffer for the send loop. If the queue is full the data is lost.
+	void QueueBuffer(const Buffer* pBuffer);
+
+	// Wakes up the send loop if it is waiting for data.
+	// Returns false on error.
+	bool ResumeSendLoop();
+
+	// Awaitable that suspends the coroutine until the indexed event is processed
+	auto WaitForEvent(uint index) { return m_waiters.Wait(index); }
+
+	// Awaitable that suspends the send loop until QueueSend is called
+	auto WaitForTxData() { return m_waiters.Wait(cTxDataWaiter); }
+
+	// Returns true if a coroutine is waiting for the indexed event
+	bool IsWaitingFor(uint index) const { return m_waiters.IsWaiting(index); }
+
+	// Hands a received buffer over to the caller of ResumeWaiter
+	void Deliver(Buffer* pBuffer) { assert(!m_pRxBuffer); m_pRxBuffer = pBuffer; }
+
+	// Reports an error to the caller of ResumeWaiter or QueueSend
+	void Fail() { m_hasFailed = true; }
 
 	std::string_view m_name;
 	BufferPool& m_bufferPool;
 	Lib::BlockQueue<const Buffer*, 1> m_txQueue;
-	Buffer* m_pRxBuffer{};
-	const Buffer* m_pTxBuffer{};
 	std::unique_ptr<IFilter> m_pTxFilter;
+
+private:
+	static constexpr uint cTxDataWaiter{ cMaxEvents };
+
+	// The outcome of a resumed loop is only written when there is one,
+	// and taken by its caller
+
+	Lib::EventWaiters<cMaxEvents + 1> m_waiters;
+	Buffer* m_pRxBuffer{};			// delivered
+	bool m_hasFailed{};
 };
+
+
+// Called by Runner on every event of the client: an event without data
+// costs the resume and two reads.
+//
+inline int BaseClient::ResumeWaiter(const std::coroutine_handle<> waiter, Buffer** ppRxBuffer)
+{
+	waiter.resume();
+
+	int result{};
+
+	if (m_pRxBuffer)
+	{
+		*ppRxBuffer = std::exchange(m_pRxBuffer, {});
+		result = (int)(*ppRxBuffer)->GetDataSize();
+	}
+
+	if (m_hasFailed)
+	{
+		m_hasFailed = false;
+		result = -1;
+	}
+
+	return result;
+}
+
+
+template<typename F>
+void BaseClient::FilterTx(const Buffer* pBuffer, F onBuffer)
+{
+	if (m_pTxFilter)
+	{
+		uint numFilteredBuffers{ m_pTxFilter->Process(pBuffer) };
+
+		while (numFilteredBuffers--)
+			onBuffer(m_pTxFilter->GetResult());
+	}
+	else
+		onBuffer(pBuffer);
+}
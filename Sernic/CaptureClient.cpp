@@ -0,0 +1,474 @@
+#include "CaptureClient.h"
+#include <cassert>
+#include "Log.h"
+
+
+namespace
+{
+	enum class EventType
+	{
+		Write,
+		FlushTimer,
+		Compressed,
+		_NumEvents
+	};
+}
+
+
+static_assert((uint)CaptureOrigin::Gdb == (uint)TxSource::Gdb + 1 && (uint)CaptureOrigin::Shm == (uint)TxSource::Shm + 1,
+		"The origins of the channels follow TxSource");
+
+
+// The data is captured as it is sent, BaseClient's TX queue is not used
+//
+CaptureClient::CaptureClient(const std::string_view path, const bool isCompressed, BufferPool& bufferPool)
+	: BaseClient{ "Capture"sv, bufferPool, 1, {} }
+	, m_path{ path }
+	, m_isCompressed{ isCompressed }
+{
+}
+
+
+CaptureClient::~CaptureClient()
+{
+	if (m_file != INVALID_HANDLE_VALUE)
+	{
+		WriteRemaining();
+
+		LogInfo() << m_name << " wrote " << m_numRecords << " records to " << m_path;
+
+		if (m_numDroppedBytes > 0)
+			LogWarning() << m_name << " lost " << m_numDroppedBytes << " bytes (the disk was too slow)";
+
+		CloseHandle(m_file);
+	}
+
+	StopCompressing();
+
+	if (m_numCompressedBytes > 0)
+	{
+		std::chrono::duration<double> time{ m_compressTime };
+		LogLine line{ LogInfo() };
+
+		line.GetStream() << std::fixed << std::setprecision(1) << m_name << " compressed " << m_numCompressedBytes / 1024.0 / 1024.0
+				<< " MB to " << m_numBlockBytes / 1024.0 / 1024.0 << " MB (" << (double)m_numCompressedBytes / m_numBlockBytes
+				<< ":1) in " << time.count() * 1000 << " ms, " << m_numCompressedBytes / 1024.0 / 1024.0 / time.count() << " MB/s";
+	}
+
+	for (HANDLE handle : { m_indexFile, m_ovWrite.hEvent, m_compressEvent, m_compressedEvent })
+	{
+		if (handle && handle != INVALID_HANDLE_VALUE)
+			CloseHandle(handle);
+	}
+}
+
+
+// Creates the capture file and its index, replacing existing files.
+// Returns the number of events, 0 on error.
+//
+uint CaptureClient::Open(std::span<WSAEVENT> events)
+{
+	m_file = CreateFileA(m_path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_FLAG_OVERLAPPED, NULL);
+
+	if (m_file == INVALID_HANDLE_VALUE)
+	{
+		LogError() << "Failed to create capture file " << m_path;
+		return 0;
+	}
+
+	// The index is small and written in one piece after each chunk
+
+	auto indexPath{ m_path + std::string{ cCaptureIndexSuffix } };
+	m_indexFile = CreateFileA(indexPath.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, 0, NULL);
+
+	DWORD bytesWritten{};
+
+	if (m_indexFile == INVALID_HANDLE_VALUE
+		|| !WriteFile(m_indexFile, &cCaptureIndexHeader, sizeof(cCaptureIndexHeader), &bytesWritten, NULL))
+	{
+		LogError() << "Failed to create capture index " << indexPath;
+		return 0;
+	}
+
+	for (auto& chunk : m_chunks)
+	{
+		chunk.data.resize(cChunkSize);
+
+		if (m_isCompressed)
+			chunk.blocks.resize(cMaxBlocksSize);
+	}
+
+	// The file header is written with the first chunk. With compression
+	// the thread writes it before the blocks.
+
+	Chunk& chunk{ m_chunks[m_fillChunk] };
+
+	if (m_isCompressed)
+		chunk.offset = sizeof(CaptureFileHeader);
+	else
+	{
+		std::memcpy(chunk.data.data(), &cCaptureFileHeader, sizeof(cCaptureFileHeader));
+		chunk.size = sizeof(cCaptureFileHeader);
+	}
+
+	m_ovWrite.hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+	events[(int)EventType::Write] = m_ovWrite.hEvent;
+
+	m_compressEvent = CreateEventA(NULL, FALSE, FALSE, NULL);		// auto-reset
+	m_compressedEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+	events[(int)EventType::Compressed] = m_compressedEvent;
+
+	if (!m_flushTimer.Create())
+	{
+		LogError() << "Failed to create timer for " << m_name;
+		return 0;
+	}
+
+	events[(int)EventType::FlushTimer] = m_flushTimer.GetEvent();
+
+	m_writeTask = WriteLoop();
+	m_flushTask = FlushLoop();
+	m_compressedTask = CompressedLoop();
+
+	if (!m_writeTask || !m_flushTask || !m_compressedTask)
+	{
+		LogError() << "No memory for " << m_name << " coroutines";
+		return 0;
+	}
+
+	if (m_isCompressed)
+		m_compressThread = std::thread{ &CaptureClient::CompressThread, this };
+
+	LogInfo() << m_name << " writing to " << m_path << (m_isCompressed ? " (compressed)"sv : ""sv);
+
+	return (uint)EventType::_NumEvents;
+}
+
+
+// Captures the data received from the serial port
+//
+bool CaptureClient::Send(const Buffer* pBuffer)
+{
+	Capture(CaptureOrigin::Serial, pBuffer->GetData());
+	m_bufferPool.PutBuffer(pBuffer);
+
+	return true;
+}
+
+
+// Captures the data a channel sends to the serial port
+//
+bool CaptureClient::SendFrom(const Buffer* pBuffer, const TxSource source)
+{
+	Capture((CaptureOrigin)((uint)source + 1), pBuffer->GetData());
+	m_bufferPool.PutBuffer(pBuffer);
+
+	return true;
+}
+
+
+// Adds a record to the chunk being filled, and an index entry if the
+// record starts the chunk or is cCaptureIndexSpacing bytes past the last
+// entry. Moves on to the next chunk if the record doesn't fit.
+//
+void CaptureClient::Capture(const CaptureOrigin origin, const std::span<const uint8_t> data)
+{
+	size_t recordSize{ sizeof(CaptureRecordHeader) + data.size() };
+
+	if (m_chunks[m_fillChunk].size + recordSize > cChunkSize && !CloseChunk())
+	{
+		m_numDroppedBytes += data.size();
+		return;
+	}
+
+	Chunk& chunk{ m_chunks[m_fillChunk] };
+	uint64_t time{ GetCaptureTime() };
+	uint64_t offset{ chunk.offset + chunk.size };
+
+	if (chunk.numIndexEntries == 0 || offset >= m_lastIndexedOffset + cCaptureIndexSpacing)
+	{
+		assert(chunk.numIndexEntries < chunk.index.size());
+
+		chunk.index[chunk.numIndexEntries++] = { time, offset };
+		m_lastIndexedOffset = offset;
+	}
+
+	chunk.size += WriteCaptureRecord(chunk.data.data() + chunk.size, time, origin, data);
+	++m_numRecords;
+}
+
+
+// Hands the chunk being filled over to the write loop (and to the
+// compression thread) and starts filling the next one.
+// Returns false if all the other chunks are still waiting.
+//
+bool CaptureClient::CloseChunk()
+{
+	if (m_numFullChunks == cNumChunks - 1)
+		return false;
+
+	const Chunk& fullChunk{ m_chunks[m_fillChunk] };
+	uint64_t offset{ fullChunk.offset + fullChunk.size };
+
+	++m_numFullChunks;
+	m_fillChunk = (m_fillChunk + 1) % cNumChunks;
+
+	if (m_isCompressed)
+	{
+		m_numClosedChunks.fetch_add(1, std::memory_order_release);
+		SetEvent(m_compressEvent);
+	}
+
+	Chunk& chunk{ m_chunks[m_fillChunk] };
+
+	chunk.size = 0;
+	chunk.offset = offset;
+	chunk.numIndexEntries = 0;
+
+	return ResumeSendLoop();
+}
+
+
+// Returns true if the next full chunk can be written: always without
+// compression, otherwise when the thread has compressed it
+//
+bool CaptureClient::IsWriteChunkReady() const
+{
+	return !m_isCompressed || m_numCompressedChunks.load(std::memory_order_acquire) > m_numWrittenChunks;
+}
+
+
+std::span<const uint8_t> CaptureClient::GetWriteData(const Chunk& chunk) const
+{
+	return m_isCompressed ? std::span{ chunk.blocks.data(), chunk.blocksSize } : std::span{ chunk.data.data(), chunk.size };
+}
+
+
+// Starts writing the next full chunk at the end of the file.
+// Returns false on error.
+//
+bool CaptureClient::StartWrite()
+{
+	auto data{ GetWriteData(m_chunks[m_writeChunk]) };
+
+	m_ovWrite.Offset = (DWORD)m_fileSize;
+	m_ovWrite.OffsetHigh = (DWORD)(m_fileSize >> 32);
+
+	if (!WriteFile(m_file, data.data(), (DWORD)data.size(), NULL, &m_ovWrite) && GetLastError() != ERROR_IO_PENDING)
+	{
+		LogError() << "Failed to write to " << m_path;
+		return false;
+	}
+
+	m_isWriting = true;
+
+	return true;
+}
+
+
+// Completes the write of a chunk and appends the chunk's index entries to
+// the index, now that the data they point to is in the file.
+// Returns false on error.
+//
+bool CaptureClient::FinishWrite()
+{
+	const Chunk& chunk{ m_chunks[m_writeChunk] };
+	DWORD bytesWritten{};
+
+	m_isWriting = false;
+
+	if (!GetOverlappedResult(m_file, &m_ovWrite, &bytesWritten, TRUE) || bytesWritten != GetWriteData(chunk).size())
+	{
+		LogError() << "Failed to write to " << m_path;
+		return false;
+	}
+
+	m_fileSize += bytesWritten;
+
+	if (chunk.numIndexEntries > 0
+		&& !WriteFile(m_indexFile, chunk.index.data(), chunk.numIndexEntries * sizeof(CaptureIndexEntry), &bytesWritten, NULL))
+	{
+		LogError() << "Failed to write to the index of " << m_path;
+		return false;
+	}
+
+	m_writeChunk = (m_writeChunk + 1) % cNumChunks;
+	--m_numFullChunks;
+	++m_numWrittenChunks;
+
+	return true;
+}
+
+
+// Writes the chunks that are left when the client is closed, waiting for
+// each write. With compression, the thread compresses the chunks it has
+// not done yet before it finishes.
+//
+void CaptureClient::WriteRemaining()
+{
+	if (m_isWriting && !FinishWrite())
+		return;
+
+	if (m_chunks[m_fillChunk].size > 0)
+	{
+		// The last chunk, nothing is added to it any more
+
+		++m_numFullChunks;
+
+		if (m_isCompressed)
+			m_numClosedChunks.fetch_add(1, std::memory_order_release);
+	}
+
+	StopCompressing();
+
+	while (m_numFullChunks > 0)
+	{
+		if (!StartWrite() || !FinishWrite())
+			return;
+	}
+}
+
+
+// Stops the compression thread (if it is running) once it has compressed
+// the chunks handed over to it
+//
+void CaptureClient::StopCompressing()
+{
+	if (!m_compressThread.joinable())
+		return;
+
+	m_isStopping.store(true, std::memory_order_release);
+	SetEvent(m_compressEvent);
+	m_compressThread.join();
+}
+
+
+// Compresses the records of the chunk into blocks. Runs on the
+// compression thread.
+//
+void CaptureClient::CompressChunk(Chunk& chunk)
+{
+	auto startTime{ std::chrono::steady_clock::now() };
+	size_t blocksSize{};
+
+	// The file header goes before the first block of the capture
+
+	if (chunk.offset == sizeof(CaptureFileHeader))
+	{
+		std::memcpy(chunk.blocks.data(), &cCompressedCaptureFileHeader, sizeof(cCompressedCaptureFileHeader));
+		blocksSize = sizeof(cCompressedCaptureFileHeader);
+	}
+
+	for (size_t position{}; position < chunk.size;)
+	{
+		std::span<const uint8_t> records{ chunk.data.data() + position, chunk.size - position };
+		size_t blockSize{ GetCaptureBlockSize(records) };
+
+		assert(blocksSize + GetMaxCaptureBlockSize(blockSize) <= chunk.blocks.size());
+
+		blocksSize += WriteCaptureBlock(chunk.blocks.data() + blocksSize, chunk.offset + position, records.first(blockSize), m_compressor);
+		position += blockSize;
+	}
+
+	chunk.blocksSize = blocksSize;
+
+	m_numCompressedBytes += chunk.size;
+	m_numBlockBytes += blocksSize;
+	m_compressTime += std::chrono::steady_clock::now() - startTime;
+}
+
+
+// Compresses the chunks as they are handed over, in order, until
+// StopCompressing is called, and then the rest
+//
+void CaptureClient::CompressThread()
+{
+	uint64_t numCompressedChunks{};
+
+	for (;;)
+	{
+		WaitForSingleObject(m_compressEvent, INFINITE);
+
+		// Read the flag before the count, so no chunk is left behind
+
+		bool isStopping{ m_isStopping.load(std::memory_order_acquire) };
+
+		while (numCompressedChunks < m_numClosedChunks.load(std::memory_order_acquire))
+		{
+			CompressChunk(m_chunks[numCompressedChunks % cNumChunks]);
+
+			m_numCompressedChunks.store(++numCompressedChunks, std::memory_order_release);
+			SetEvent(m_compressedEvent);
+		}
+
+		if (isStopping)
+			break;
+	}
+}
+
+
+// Writes the full chunks one by one, when they have been compressed.
+// Finishes on error.
+//
+Lib::Task CaptureClient::WriteLoop()
+{
+	for (;;)
+	{
+		if (m_numFullChunks == 0 || !IsWriteChunkReady())
+		{
+			co_await WaitForTxData();
+			continue;
+		}
+
+		if (!StartWrite())
+			break;
+
+		co_await WaitForEvent((uint)EventType::Write);
+		ResetEvent(m_ovWrite.hEvent);
+
+		if (!FinishWrite())
+			break;
+	}
+
+	Fail();
+}
+
+
+// Every cFlushInterval, hands the chunk being filled over to the write
+// loop if it has data and the write loop has nothing else to write.
+// Finishes on error.
+//
+Lib::Task CaptureClient::FlushLoop()
+{
+	for (;;)
+	{
+		m_flushTimer.Start(cFlushInterval);
+		co_await WaitForEvent((uint)EventType::FlushTimer);
+		m_flushTimer.Stop();
+
+		if (m_chunks[m_fillChunk].size > 0 && m_numFullChunks == 0 && !CloseChunk())
+			break;
+	}
+
+	Fail();
+}
+
+
+// Wakes up the write loop when the compression thread has compressed a
+// chunk. The event is handled here, because the thread may set it while
+// the write loop is waiting for a write.
+// Finishes on error.
+//
+Lib::Task CaptureClient::CompressedLoop()
+{
+	for (;;)
+	{
+		co_await WaitForEvent((uint)EventType::Compressed);
+		ResetEvent(m_compressedEvent);
+
+		if (!ResumeSendLoop())
+			break;
+	}
+
+	Fail();
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "BaseClient.h"
+#include "CaptureFile.h"
+#include "EventTimer.h"
+
+
+// Writes the data received from the serial port (Send) and the data the
+// channels send to it (SendFrom) to a capture file with a time index
+// (see CaptureFile.h).
+//
+// The records are added to chunks of memory, which are written to the
+// file with overlapped writes while the next chunk is being filled.
+// A chunk that isn't full is written after cFlushInterval, so the file
+// is never far behind. If the disk doesn't keep up and all the chunks
+// are full, the data is not captured.
+//
+// With compression, a full chunk is first compressed into blocks on the
+// compression thread, which sets an event for each chunk it has done,
+// and the blocks are written instead of the records. The thread only
+// takes the chunks in order, the same as the write loop.
+//
+class CaptureClient : public BaseClient
+{
+public:
+	CaptureClient(std::string_view path, bool isCompressed, BufferPool& bufferPool);
+	~CaptureClient();
+
+private:
+	static constexpr size_t cChunkSize{ 256 * 1024 };
+	static constexpr uint cNumChunks{ 4 };
+	static constexpr auto cFlushInterval{ 1s };
+
+	// An entry for the first record of a chunk and then every cCaptureIndexSpacing
+	static constexpr size_t cMaxIndexEntries{ 1 + cChunkSize / cCaptureIndexSpacing };
+
+	// The blocks of a chunk (and the file header before the first one):
+	// at most the records of the chunk compressed in one block and the
+	// headers and margins of more blocks
+	static constexpr size_t cMaxBlocksSize{ sizeof(CaptureFileHeader) + GetMaxCaptureBlockSize(cChunkSize)
+			+ (cChunkSize / cCaptureBlockSize + 1) * GetMaxCaptureBlockSize(0) };
+
+	struct Chunk
+	{
+		std::vector<uint8_t> data;
+		size_t size;
+		uint64_t offset;			// in the capture without compression, which is the file offset without it
+		std::array<CaptureIndexEntry, cMaxIndexEntries> index;		// of the records in the chunk
+		uint numIndexEntries;
+		std::vector<uint8_t> blocks;		// with compression
+		size_t blocksSize;
+	};
+
+	uint Open(std::span<WSAEVENT> events) override;
+	bool Send(const Buffer* pBuffer) override;
+	bool SendFrom(const Buffer* pBuffer, TxSource source) override;
+
+	void Capture(CaptureOrigin origin, std::span<const uint8_t> data);
+	bool CloseChunk();
+	bool IsWriteChunkReady() const;
+	std::span<const uint8_t> GetWriteData(const Chunk& chunk) const;
+	bool StartWrite();
+	bool FinishWrite();
+	void WriteRemaining();
+	void StopCompressing();
+	void CompressChunk(Chunk& chunk);
+	void CompressThread();
+	Lib::Task WriteLoop();
+	Lib::Task FlushLoop();
+	Lib::Task CompressedLoop();
+
+	std::string m_path;
+	bool m_isCompressed;
+	HANDLE m_file{ INVALID_HANDLE_VALUE };
+	HANDLE m_indexFile{ INVALID_HANDLE_VALUE };
+	OVERLAPPED m_ovWrite{};
+	std::array<Chunk, cNumChunks> m_chunks{};
+	uint m_fillChunk{};				// the chunk the records are added to
+	uint m_writeChunk{};			// the next chunk written to the file
+	uint m_numFullChunks{};			// waiting for the write loop
+	bool m_isWriting{};
+	uint64_t m_fileSize{};			// written so far
+	uint64_t m_lastIndexedOffset{};
+	uint64_t m_numRecords{};
+	uint64_t m_numDroppedBytes{};
+	EventTimer m_flushTimer;
+
+	// The chunks are counted from the start of the capture. The nth chunk
+	// is m_chunks[n % cNumChunks].
+	uint64_t m_numWrittenChunks{};
+	std::atomic<uint64_t> m_numClosedChunks{};		// handed over to the compression thread
+	std::atomic<uint64_t> m_numCompressedChunks{};
+	std::atomic<bool> m_isStopping{};
+	HANDLE m_compressEvent{};		// wakes up the compression thread
+	HANDLE m_compressedEvent{};		// set by the thread when a chunk is compressed
+	std::thread m_compressThread;
+
+	// Used by the compression thread, and by the destructor when it has finished
+	Lib::Lz4Block m_compressor;
+	uint64_t m_numCompressedBytes{};
+	uint64_t m_numBlockBytes{};		// written for them
+	std::chrono::steady_clock::duration m_compressTime{};
+
+	Lib::Task m_writeTask;
+	Lib::Task m_flushTask;
+	Lib::Task m_compressedTask;
+};
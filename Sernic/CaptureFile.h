@@ -0,0 +1,470 @@
+#pragma once
+
+#include <cassert>
+#include <cstring>
+#include "Lib/Lz4Block.h"
+#include "Lib/SubstringSearch.h"
+
+
+// Capture file of the serial data (option -o): a CaptureFileHeader followed
+// by the records, in the order Sernic received or sent the data. A record
+// is a CaptureRecordHeader followed by the data of one read from the serial
+// port, or of one piece of data sent to it by a channel.
+//
+// The index is a sidecar file (the capture's path with ".idx" appended):
+// a CaptureFileHeader followed by CaptureIndexEntry items, the time and
+// file offset of a record, at least every cCaptureIndexSpacing bytes of the
+// capture. Sernic appends to the index only after the data it points to has
+// been written, so both files can be read while the capture goes on. The
+// index is only a shortcut: a capture without one is read from the start.
+//
+// A compressed capture (option -z, version 2 of the header) has the same
+// records, in blocks of whole records of at most cCaptureBlockSize bytes.
+// A block is a CaptureBlockHeader followed by the records compressed in
+// the LZ4 block format, or as they are if they don't compress. Each block
+// is compressed on its own, so it can be read without the blocks before
+// it. The offsets of the records (in the index too) are where they would
+// be in the capture without compression, each block header has the offset
+// of its first record.
+//
+// Times are in microseconds since 1970-01-01 UTC. They come from the system
+// clock, so they go back if the clock is set back, and Seek then finds the
+// first record after the time in one of the stretches.
+//
+// This header is all a reader needs (together with Lib/SubstringSearch.h
+// and Lib/Lz4Block.h).
+//
+
+// Where the data of a record comes from: received from the serial port or
+// sent to it by a channel (the values after Serial follow TxSource)
+//
+enum class CaptureOrigin : uint8_t
+{
+	Serial,
+	Gdb,
+	Console,
+	Raw,
+	Shm,
+	_NumOrigins
+};
+
+struct CaptureFileHeader
+{
+	std::array<char, 8> magic;
+	uint32_t version;
+	uint32_t headerSize;		// of this header, the records or entries follow
+};
+
+struct CaptureRecordHeader
+{
+	uint64_t time;
+	uint32_t size;				// of the data that follows
+	CaptureOrigin origin;
+	uint8_t reserved[3];
+};
+
+struct CaptureIndexEntry
+{
+	uint64_t time;
+	uint64_t offset;			// of a record
+};
+
+struct CaptureBlockHeader
+{
+	uint64_t offset;			// of the first record, without compression
+	uint32_t size;				// of the records
+	uint32_t compressedSize;	// of the data that follows, size if the records are not compressed
+};
+
+static_assert(sizeof(CaptureFileHeader) == 16 && sizeof(CaptureRecordHeader) == 16 && sizeof(CaptureIndexEntry) == 16
+		&& sizeof(CaptureBlockHeader) == 16);
+
+constexpr inline CaptureFileHeader cCaptureFileHeader{ { 'S', 'e', 'r', 'n', 'i', 'c', 'C', 'F' }, 1, sizeof(CaptureFileHeader) };
+constexpr inline CaptureFileHeader cCompressedCaptureFileHeader{ { 'S', 'e', 'r', 'n', 'i', 'c', 'C', 'F' }, 2, sizeof(CaptureFileHeader) };
+constexpr inline CaptureFileHeader cCaptureIndexHeader{ { 'S', 'e', 'r', 'n', 'i', 'c', 'C', 'I' }, 1, sizeof(CaptureFileHeader) };
+constexpr inline uint64_t cCaptureIndexSpacing{ 64 * 1024 };
+constexpr inline size_t cCaptureBlockSize{ 64 * 1024 };
+constexpr inline auto cCaptureIndexSuffix{ ".idx"sv };
+
+
+// Returns the current time for a record
+//
+inline uint64_t GetCaptureTime()
+{
+	using namespace std::chrono;
+
+	return (uint64_t)duration_cast<microseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+
+// Writes a record to the memory, which must have room for the header and
+// the data. Returns the size of the record.
+//
+inline size_t WriteCaptureRecord(
+		uint8_t* pMemory,
+		const uint64_t time,
+		const CaptureOrigin origin,
+		const std::span<const uint8_t> data)
+{
+	CaptureRecordHeader header{ .time = time, .size = (uint32_t)data.size(), .origin = origin };
+
+	std::memcpy(pMemory, &header, sizeof(header));
+	std::memcpy(pMemory + sizeof(header), data.data(), data.size());
+
+	return sizeof(header) + data.size();
+}
+
+
+// Returns the size of the whole records at the start of the memory that
+// make up the next block: at most cCaptureBlockSize bytes, but at least
+// one record
+//
+inline size_t GetCaptureBlockSize(const std::span<const uint8_t> records)
+{
+	size_t size{};
+
+	while (size < records.size())
+	{
+		CaptureRecordHeader header;
+		std::memcpy(&header, records.data() + size, sizeof(header));
+
+		size_t recordSize{ sizeof(header) + header.size };
+
+		if (size > 0 && size + recordSize > cCaptureBlockSize)
+			break;
+
+		size += recordSize;
+	}
+
+	return size;
+}
+
+
+// The most memory a block of the records takes
+//
+constexpr size_t GetMaxCaptureBlockSize(const size_t size)
+{
+	return sizeof(CaptureBlockHeader) + Lib::Lz4Block::GetMaxCompressedSize(size);
+}
+
+
+// Writes a block of the records, which start at the offset in the capture
+// without compression, to the memory, which must have room for
+// GetMaxCaptureBlockSize. Returns the size of the block.
+//
+inline size_t WriteCaptureBlock(
+		uint8_t* pMemory,
+		const uint64_t offset,
+		const std::span<const uint8_t> records,
+		Lib::Lz4Block& compressor)
+{
+	uint8_t* pData{ pMemory + sizeof(CaptureBlockHeader) };
+	size_t compressedSize{ compressor.Compress(records, { pData, Lib::Lz4Block::GetMaxCompressedSize(records.size()) }) };
+
+	if (compressedSize == 0 || compressedSize >= records.size())
+	{
+		std::memcpy(pData, records.data(), records.size());
+		compressedSize = records.size();
+	}
+
+	CaptureBlockHeader header{ .offset = offset, .size = (uint32_t)records.size(), .compressedSize = (uint32_t)compressedSize };
+	std::memcpy(pMemory, &header, sizeof(header));
+
+	return sizeof(header) + compressedSize;
+}
+
+
+// Reads a capture and its index from memory (a mapped file, for example).
+// The file may still be written: the records end at the first one that
+// is not complete.
+//
+// The blocks of a compressed capture are found when it is opened, and
+// decompressed as their records are read into a cache of cNumCachedBlocks
+// blocks. The data of a record read from a compressed block stays valid
+// until that many other blocks have been read.
+//
+class CaptureReader : NonCopyable
+{
+public:
+	struct Record
+	{
+		uint64_t offset;			// of the record in the file
+		uint64_t time;
+		CaptureOrigin origin;
+		std::span<const uint8_t> data;
+	};
+
+	// Takes the capture and its index, which may be empty. An index that
+	// is not valid is ignored. Returns false if the capture is not valid.
+	//
+	bool Open(const std::span<const uint8_t> file, const std::span<const uint8_t> index = {})
+	{
+		m_file = file;
+		m_index = {};
+		m_blocks.clear();
+		m_end = file.size();
+		m_isCompressed = IsHeaderValid(file, cCompressedCaptureFileHeader);
+
+		for (auto& cachedBlock : m_cache)
+			cachedBlock.index = cNoBlock;
+
+		if (m_isCompressed)
+			FindBlocks();
+		else if (!IsHeaderValid(file, cCaptureFileHeader))
+			return false;
+
+		if (IsHeaderValid(index, cCaptureIndexHeader))
+		{
+			auto entries{ index.subspan(sizeof(CaptureFileHeader)) };
+
+			m_index = { (const CaptureIndexEntry*)entries.data(), entries.size() / sizeof(CaptureIndexEntry) };
+		}
+
+		return true;
+	}
+
+	// The offsets of the records (without compression)
+	uint64_t GetBegin() const { return sizeof(CaptureFileHeader); }
+	uint64_t GetEnd() const { return m_end; }
+
+	uint GetNumIndexEntries() const { return (uint)m_index.size(); }
+	bool IsCompressed() const { return m_isCompressed; }
+	size_t GetNumBlocks() const { return m_blocks.size(); }
+
+	// Reads the record at the offset. Returns false at the end of the file
+	// or of the complete records (or blocks), or if a block is not valid.
+	//
+	bool Read(const uint64_t offset, Record* pRecord) const
+	{
+		std::span<const uint8_t> records{ m_file };
+		uint64_t recordsOffset{};
+
+		if (m_isCompressed && !GetBlock(offset, records, recordsOffset))
+			return false;
+
+		uint64_t position{ offset - recordsOffset };
+
+		if (position + sizeof(CaptureRecordHeader) > records.size())
+			return false;
+
+		CaptureRecordHeader header;
+		std::memcpy(&header, records.data() + position, sizeof(header));
+
+		if (header.size > records.size() - position - sizeof(header) || header.origin >= CaptureOrigin::_NumOrigins)
+			return false;
+
+		*pRecord = { offset, header.time, header.origin, records.subspan(position + sizeof(header), header.size) };
+
+		return true;
+	}
+
+	uint64_t GetNext(const Record& record) const
+	{
+		return record.offset + sizeof(CaptureRecordHeader) + record.data.size();
+	}
+
+	// Returns the offset of the first record at or after the time (the end
+	// of the records if there is none). The index narrows it down to the
+	// records between two entries, which are read one by one.
+	//
+	uint64_t Seek(const uint64_t time) const
+	{
+		auto pEntry{ std::ranges::partition_point(m_index, [time](const CaptureIndexEntry& entry) { return entry.time < time; }) };
+		uint64_t offset{ pEntry == m_index.begin() ? GetBegin() : std::prev(pEntry)->offset };
+
+		Record record;
+
+		while (Read(offset, &record) && record.time < time)
+			offset = GetNext(record);
+
+		return offset;
+	}
+
+	// Finds the pattern in the data of each origin between the offsets of
+	// two records, as one stream per origin, so a match may straddle the
+	// records. Calls onMatch(const Record&, size_t position) with the record
+	// where a match starts and its position in the record's data, in the
+	// order of the records.
+	//
+	template<typename F>
+	void Search(uint64_t offset, const uint64_t end, const Lib::SubstringSearch& search, F onMatch) const
+	{
+		// The last bytes of each origin's stream (fewer than the pattern)
+		// with the record of each byte, for the matches that straddle
+
+		struct Tail
+		{
+			std::vector<uint8_t> data;
+			std::vector<std::pair<uint64_t, size_t>> positions;		// record offset and position in it
+		};
+
+		const size_t carrySize{ search.GetPatternSize() - 1 };
+		std::array<Tail, (size_t)CaptureOrigin::_NumOrigins> tails;
+		std::vector<uint8_t> joined;
+
+		Record record;
+
+		for (; offset < end && Read(offset, &record); offset = GetNext(record))
+		{
+			Tail& tail{ tails[(size_t)record.origin] };
+
+			// A match that starts in the tail ends in this record, because the
+			// tail is shorter than the pattern
+
+			if (!tail.data.empty())
+			{
+				joined.assign(tail.data.begin(), tail.data.end());
+				joined.insert(joined.end(), record.data.begin(), record.data.begin() + std::min(carrySize, record.data.size()));
+
+				bool isMatched{};
+
+				for (size_t position{ search.Find(joined) }; position < tail.data.size(); position = search.Find(joined, position + 1))
+				{
+					Record first;
+					[[maybe_unused]] bool isRead{ Read(tail.positions[position].first, &first) };
+					assert(isRead);
+
+					onMatch(first, tail.positions[position].second);
+					isMatched = true;
+				}
+
+				// Reading the first records may have dropped the block of this
+				// record from the cache
+
+				if (isMatched && m_isCompressed)
+					Read(offset, &record);
+			}
+
+			for (size_t position{ search.Find(record.data) }; position != Lib::SubstringSearch::npos; position = search.Find(record.data, position + 1))
+				onMatch(record, position);
+
+			// Keep the last carrySize bytes of the stream
+
+			size_t numKept{ std::min(record.data.size(), carrySize) };
+			size_t numDropped{ tail.data.size() + numKept > carrySize ? tail.data.size() + numKept - carrySize : 0 };
+
+			tail.data.erase(tail.data.begin(), tail.data.begin() + numDropped);
+			tail.positions.erase(tail.positions.begin(), tail.positions.begin() + numDropped);
+
+			for (size_t position{ record.data.size() - numKept }; position < record.data.size(); ++position)
+			{
+				tail.data.push_back(record.data[position]);
+				tail.positions.emplace_back(record.offset, position);
+			}
+		}
+	}
+
+private:
+	static constexpr size_t cNumCachedBlocks{ 8 };
+	static constexpr size_t cNoBlock{ std::numeric_limits<size_t>::max() };
+
+	struct Block
+	{
+		uint64_t offset;			// of the first record, without compression
+		uint32_t size;
+		uint32_t compressedSize;
+		uint64_t dataOffset;		// in the file
+	};
+
+	struct CachedBlock
+	{
+		size_t index{ cNoBlock };	// in m_blocks
+		uint64_t lastUse{};
+		std::vector<uint8_t> records;
+	};
+
+	// Finds the blocks of a compressed capture, up to the first one that
+	// is not complete or valid
+	//
+	void FindBlocks()
+	{
+		uint64_t offset{ GetBegin() };
+		uint64_t fileOffset{ sizeof(CaptureFileHeader) };
+
+		while (fileOffset + sizeof(CaptureBlockHeader) <= m_file.size())
+		{
+			CaptureBlockHeader header;
+			std::memcpy(&header, m_file.data() + fileOffset, sizeof(header));
+
+			fileOffset += sizeof(header);
+
+			if (header.offset != offset
+				|| header.compressedSize > m_file.size() - fileOffset
+				|| header.compressedSize > Lib::Lz4Block::GetMaxCompressedSize(header.size))
+			{
+				break;
+			}
+
+			m_blocks.push_back({ offset, header.size, header.compressedSize, fileOffset });
+
+			offset += header.size;
+			fileOffset += header.compressedSize;
+		}
+
+		m_end = offset;
+	}
+
+	// Gets the records of the block with the record at the offset, and the
+	// offset of the first one. Returns false if there is no such block or
+	// it is not valid.
+	//
+	bool GetBlock(const uint64_t offset, std::span<const uint8_t>& records, uint64_t& recordsOffset) const
+	{
+		auto pBlock{ std::ranges::upper_bound(m_blocks, offset, {}, &Block::offset) };
+
+		if (pBlock == m_blocks.begin() || offset >= std::prev(pBlock)->offset + std::prev(pBlock)->size)
+			return false;
+
+		const Block& block{ *--pBlock };
+		auto data{ m_file.subspan(block.dataOffset, block.compressedSize) };
+
+		recordsOffset = block.offset;
+
+		if (block.compressedSize == block.size)
+		{
+			records = data;		// not compressed
+			return true;
+		}
+
+		size_t index{ (size_t)(pBlock - m_blocks.begin()) };
+		auto pCachedBlock{ std::ranges::find(m_cache, index, &CachedBlock::index) };
+
+		if (pCachedBlock == m_cache.end())
+		{
+			pCachedBlock = std::ranges::min_element(m_cache, {}, &CachedBlock::lastUse);
+			pCachedBlock->records.resize(block.size);
+
+			if (Lib::Lz4Block::Decompress(data, pCachedBlock->records) != block.size)
+			{
+				pCachedBlock->index = cNoBlock;
+				return false;
+			}
+
+			pCachedBlock->index = index;
+		}
+
+		pCachedBlock->lastUse = ++m_numUses;
+		records = pCachedBlock->records;
+
+		return true;
+	}
+
+	static bool IsHeaderValid(const std::span<const uint8_t> file, const CaptureFileHeader& expected)
+	{
+		if (file.size() < sizeof(CaptureFileHeader))
+			return false;
+
+		CaptureFileHeader header;
+		std::memcpy(&header, file.data(), sizeof(header));
+
+		return header.magic == expected.magic && header.version == expected.version && header.headerSize == sizeof(header);
+	}
+
+	std::span<const uint8_t> m_file;
+	std::span<const CaptureIndexEntry> m_index;
+	bool m_isCompressed{};
+	std::vector<Block> m_blocks;
+	uint64_t m_end{};				// of the records, without compression
+	mutable std::array<CachedBlock, cNumCachedBlocks> m_cache;
+	mutable uint64_t m_numUses{};
+};
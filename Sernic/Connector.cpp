@@ -0,0 +1,159 @@
+#include "Connector.h"
+#include "TcpClient.h"
+#include "GdbOutputFilter.h"
+
+
+namespace
+{
+	// The scrollback buffers of the console and raw channels come from the pool
+	//
+	uint GetNumScrollbackBuffers(const Connector::Config& config)
+	{
+		return (uint)((config.scrollbackSize * 1024 + cBufferSize - 1) / cBufferSize);
+	}
+
+
+	uint GetNumScrollbackChannels(const Connector::Config& config)
+	{
+		auto isSocket{ [](const Connector::Channel& channel) { return channel.IsSet() && !channel.onLocalData; } };
+
+		return (uint)isSocket(config.console) + (uint)isSocket(config.raw);
+	}
+}
+
+
+Connector::Connector(const Config& config)
+	: m_numScrollbackBuffers{ GetNumScrollbackBuffers(config) }
+	, m_bufferPool{ cNumBuffers + GetNumScrollbackChannels(config) * m_numScrollbackBuffers }
+	, m_pSerialClient{ MakeSerialClient(config) }
+{
+	if (config.console.IsSet())
+	{
+		auto pGdbOutFilter = std::make_unique<GdbOutputFilter>(m_bufferPool);
+		m_pConsoleClient = MakeChannel("Console"sv, TxSource::Console, config.console, true, std::move(pGdbOutFilter));
+	}
+
+	if (config.gdb.IsSet())
+		m_pGdbClient = MakeChannel("GDB"sv, TxSource::Gdb, config.gdb, false);
+
+	if (config.raw.IsSet())
+		m_pRawClient = MakeChannel("Raw console"sv, TxSource::Raw, config.raw, true);
+
+	if (!config.shmName.empty())
+		m_pShmClient = std::make_unique<ShmClient>(config.shmName, m_bufferPool);
+
+	m_pRunner = std::make_unique<Runner>(
+			*m_pSerialClient,
+			m_pConsoleClient.get(),
+			m_pGdbClient.get(),
+			m_pRawClient.get(),
+			m_pShmClient.get());
+
+	m_pRunner->TraceBuffers(m_bufferPool);
+
+	if (config.spinBudget > 0 || config.pollCore != Runner::cNoCore)
+		m_pRunner->SetBusyPoll(config.pollCore, std::chrono::microseconds{ config.spinBudget });
+
+	if (!config.capturePath.empty())
+	{
+		m_pCaptureClient = std::make_unique<CaptureClient>(config.capturePath, config.isCaptureCompressed, m_bufferPool);
+		m_pRunner->SetCapture(m_pCaptureClient.get());
+	}
+
+	if (!config.multicastAddress.empty())
+	{
+		std::unique_ptr<IFilter> pTxFilter{};
+
+		if (config.isMulticastFiltered)
+			pTxFilter = std::make_unique<GdbOutputFilter>(m_bufferPool);
+
+		m_pMulticastClient = std::make_unique<UdpClient>(
+				"Multicast"sv, config.multicastAddress, config.multicastPort, m_bufferPool, std::move(pTxFilter));
+		m_pRunner->SetMulticast(m_pMulticastClient.get());
+	}
+
+	if (!config.triggerPatterns.empty())
+	{
+		for (auto pattern : config.triggerPatterns)
+		{
+			if (!m_triggerMatcher.AddPattern(pattern))
+				LogWarning() << "Trigger pattern \"" << pattern << "\" ignored (empty or more than "
+						<< Lib::MultiPatternMatcher::cMaxPatterns << " patterns)";
+		}
+
+		m_triggerMatcher.Build();
+		m_pRunner->SetTriggers(m_triggerMatcher, config.triggerActions, m_bufferPool, config.onTrigger);
+	}
+}
+
+
+void Connector::Run()
+{
+	m_pRunner->Run();
+}
+
+
+void Connector::Close()
+{
+	m_pRunner->Close();
+}
+
+
+size_t Connector::Write(const TxSource channel, const std::span<const uint8_t> data)
+{
+	LocalClient* pLocalClient{ m_localClients[(uint)channel] };
+
+	return pLocalClient ? pLocalClient->Write(data) : 0;
+}
+
+
+// Makes the client of the serial port, or the target simulator in its place
+//
+std::unique_ptr<IClient> Connector::MakeSerialClient(const Config& config)
+{
+	if (config.comPort == cSimulatedPort)
+		return std::make_unique<TargetSimulator>(config.comPort, TargetSimulator::Config{ .baudRate = config.baudRate }, m_bufferPool);
+
+	auto pSerialClient{ std::make_unique<SerialClient>(
+			config.comPort, config.baudRate, config.flowControl, config.numSerialReads, config.gdbTxWeight, m_bufferPool) };
+
+	if (config.metricsInterval > 0)
+		pSerialClient->SetMetricsInterval(std::chrono::seconds{ config.metricsInterval });
+
+	return pSerialClient;
+}
+
+
+// Makes the client of a channel. The terminal channels (console and raw)
+// coalesce the data sent to a socket client and keep a scrollback for it.
+//
+std::unique_ptr<IClient> Connector::MakeChannel(
+		const std::string_view name,
+		const TxSource source,
+		const Channel& channel,
+		const bool isTerminal,
+		std::unique_ptr<IFilter> pTxFilter)
+{
+	if (channel.onLocalData)
+	{
+		auto pLocalClient{ std::make_unique<LocalClient>(name, m_bufferPool, channel.onLocalData, std::move(pTxFilter)) };
+		m_localClients[(uint)source] = pLocalClient.get();
+
+		return pLocalClient;
+	}
+
+	std::unique_ptr<TcpClient> pTcpClient{};
+
+	if (channel.socketPath.empty())
+		pTcpClient = std::make_unique<TcpClient>(name, channel.port, m_bufferPool, std::move(pTxFilter));
+	else
+		pTcpClient = std::make_unique<TcpClient>(name, channel.socketPath, m_bufferPool, std::move(pTxFilter));
+
+	if (isTerminal)
+	{
+		pTcpClient->SetCoalescing(cTxCoalesceWindow, cTxCoalesceSize);
+		pTcpClient->SetScrollback(m_numScrollbackBuffers);
+	}
+
+	return pTcpClient;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "SerialClient.h"
+#include "LocalClient.h"
+#include "ShmClient.h"
+#include "CaptureClient.h"
+#include "UdpClient.h"
+#include "TargetSimulator.h"
+#include "Runner.h"
+#include "Log.h"
+#include "Defs.h"
+
+
+// Sernic as a library: connects a serial port to the channels given in
+// the configuration. The command line program is a thin wrapper around it,
+// and a program can embed it to use some of the channels in-process
+// (LocalClient) instead of over sockets.
+//
+class Connector : NonCopyable
+{
+public:
+	// Where a channel is: on a TCP port, on a Unix domain socket or in this
+	// process (onLocalData is called with the data from the serial port)
+	//
+	struct Channel
+	{
+		uint16_t port;
+		std::string_view socketPath;
+		LocalClient::DataCallback onLocalData;
+
+		bool IsSet() const { return port != 0 || !socketPath.empty() || onLocalData; }
+	};
+
+	struct Config
+	{
+		std::string_view comPort;							// "COMx", or cSimulatedPort for the target simulator
+		uint baudRate{ 115200 };							// 0 for a simulator without pacing
+		SerialClient::FlowControl flowControl{ SerialClient::FlowControl::Default };
+		uint numSerialReads{ cDefaultNumSerialReads };
+		uint gdbTxWeight{ TxScheduler::cStrictPriority };
+		uint scrollbackSize{ cDefaultScrollbackSize };		// in KB
+		uint metricsInterval{};								// in seconds, 0 reports only errors
+		int pollCore{ Runner::cNoCore };					// the core the event loop is pinned to
+		uint spinBudget{};									// of busy polling in us, 0 for none
+		Channel console;
+		Channel gdb;
+		Channel raw;
+		std::string_view shmName;							// empty for no shared memory channel
+		std::string_view capturePath;						// empty for no capture file
+		bool isCaptureCompressed{};
+		std::string_view multicastAddress;					// empty for no multicast channel
+		uint16_t multicastPort{};
+		bool isMulticastFiltered{};							// sends the console data instead of the raw data
+		std::vector<std::string_view> triggerPatterns;		// empty for no triggers
+		Runner::TriggerActions triggerActions{};
+		Runner::TriggerCallback onTrigger;
+	};
+
+	// The strings in the configuration must outlive the connector
+	explicit Connector(const Config& config);
+
+	// Runs until Close is called or an error occurs
+	void Run();
+
+	// Stops Run. Can be called from any thread.
+	void Close();
+
+	// Queues data for the serial port from a local channel (console, gdb
+	// or raw). Can be called from any thread.
+	// Returns the number of bytes queued, 0 if the channel is not local.
+	size_t Write(TxSource channel, std::span<const uint8_t> data);
+
+private:
+	std::unique_ptr<IClient> MakeSerialClient(const Config& config);
+	std::unique_ptr<IClient> MakeChannel(
+			std::string_view name,
+			TxSource source,
+			const Channel& channel,
+			bool isTerminal,
+			std::unique_ptr<IFilter> pTxFilter = {});
+
+	static constexpr uint cNumSources{ (uint)TxSource::_NumSources };
+
+	LogWriter m_logWriter;			// destroyed last, writes what the clients log when they close
+	uint m_numScrollbackBuffers;
+	BufferPool m_bufferPool;
+	std::unique_ptr<IClient> m_pSerialClient;		// a SerialClient or a TargetSimulator
+	std::unique_ptr<IClient> m_pConsoleClient;
+	std::unique_ptr<IClient> m_pGdbClient;
+	std::unique_ptr<IClient> m_pRawClient;
+	std::unique_ptr<ShmClient> m_pShmClient;
+	std::unique_ptr<CaptureClient> m_pCaptureClient;
+	std::unique_ptr<UdpClient> m_pMulticastClient;
+	std::array<LocalClient*, cNumSources> m_localClients{};
+	Lib::MultiPatternMatcher m_triggerMatcher;
+	std::unique_ptr<Runner> m_pRunner;				// destroyed first, the clients still hold buffers
+};
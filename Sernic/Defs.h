@@ -4,3 +4,29 @@
 
 constexpr inline size_t cBufferSize{ 120 };
 constexpr inline uint cNumBuffers{ 2048 };
+constexpr inline uint cDefaultNumSerialReads{ 4 };
+constexpr inline uint cMaxGdbTxWeight{ 64 };
+
+// The port name of the target simulator (TargetSimulator.h)
+constexpr inline auto cSimulatedPort{ "SIM"sv };
+
+// Coalescing of the data sent to the console and raw channels
+constexpr inline auto cTxCoalesceWindow{ 5ms };
+constexpr inline size_t cTxCoalesceSize{ 1024 };
+
+// Batching of the data sent to the multicast channel (option -u)
+constexpr inline auto cMulticastCoalesceWindow{ 2ms };
+
+// Scrollback of the console and raw channels, in KB
+constexpr inline uint cDefaultScrollbackSize{ 256 };
+constexpr inline uint cMaxScrollbackSize{ 16384 };
+
+// Busy polling of the events after the last one (option -b), in us
+constexpr inline uint cDefaultSpinBudget{ 1000 };
+constexpr inline uint cMaxSpinBudget{ 1'000'000 };
+
+// Reporting of the serial port metrics, in seconds
+constexpr inline uint cMaxMetricsInterval{ 3600 };
+
+// Patterns in the serial data that trigger the actions set with -t
+constexpr inline std::array cDefaultTriggerPatterns{ "Kernel panic"sv, "Oops:"sv, "BUG:"sv };
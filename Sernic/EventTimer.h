@@ -0,0 +1,74 @@
+#pragma once
+
+#include <Windows.h>
+#include "Lib/Types.h"
+
+
+// One-shot timer for the event loop: a manual-reset waitable timer that a
+// client hands over to Runner like its other events. A coroutine starts the
+// timer and awaits its event, and stops the timer when it is resumed.
+//
+class EventTimer : NonCopyable
+{
+public:
+	EventTimer() = default;
+
+	~EventTimer()
+	{
+		Close();
+	}
+
+	// Returns false on error
+	//
+	bool Create()
+	{
+		// High resolution timers need Windows 10 1803 or above
+
+		m_handle = CreateWaitableTimerExA(NULL, NULL, CREATE_WAITABLE_TIMER_MANUAL_RESET | CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+
+		if (!m_handle)
+			m_handle = CreateWaitableTimerExA(NULL, NULL, CREATE_WAITABLE_TIMER_MANUAL_RESET, TIMER_ALL_ACCESS);
+
+		return !!m_handle;
+	}
+
+	void Close()
+	{
+		if (m_handle)
+		{
+			CloseHandle(m_handle);
+			m_handle = NULL;
+		}
+	}
+
+	HANDLE GetEvent() const { return m_handle; }
+
+	// Sets the event after the delay (at once if it is 0).
+	// Restarts the timer if it is running.
+	//
+	void Start(const std::chrono::microseconds delay)
+	{
+		// A negative due time is relative, in 100 ns units
+
+		LARGE_INTEGER dueTime{};
+		dueTime.QuadPart = -std::max<LONGLONG>(delay.count() * 10, 1);
+
+		SetWaitableTimer(m_handle, &dueTime, 0, NULL, NULL, FALSE);
+	}
+
+	// Stops the timer and resets the event
+	//
+	void Stop()
+	{
+		// Setting the timer resets the event, cancelling it doesn't
+
+		LARGE_INTEGER dueTime{};
+		dueTime.QuadPart = std::numeric_limits<LONGLONG>::min();
+
+		SetWaitableTimer(m_handle, &dueTime, 0, NULL, NULL, FALSE);
+		CancelWaitableTimer(m_handle);
+	}
+
+private:
+	HANDLE m_handle{};
+};
@@ -4,6 +4,21 @@
 #include "Buffers.h"
 
 
+// The channels whose data is sent to the serial port
+//
+enum class TxSource
+{
+	Gdb,
+	Console,
+	Raw,
+	Shm,
+	_NumSources
+};
+
+
+class BaseClient;
+
+
 struct IClient : NonCopyable
 {
 	// Opens the client and adds events to the given span.
@@ -19,4 +34,16 @@ struct IClient : NonCopyable
 	// Starts sending the data and returns true on success.
 	// When the buffer is finished it will be returned to the buffer pool.
 	virtual bool Send(const Buffer* pBuffer) = 0;
+
+	// Like Send, for data received from the given source. A client may queue
+	// the data of each source separately and send it by priority.
+	virtual bool SendFrom(const Buffer* pBuffer, TxSource source) { return Send(pBuffer); }
+
+	// Keeps the recent data sent to the client (if the client keeps any)
+	// from being replaced, shortly after a trigger pattern was found
+	virtual void FreezeScrollback() {}
+
+	// Returns the client if it is written as coroutines, whose loops Runner
+	// resumes without calling ProcessEvent
+	virtual BaseClient* GetCoroutineClient() { return nullptr; }
 };
@@ -0,0 +1,31 @@
+#include "AllocationAudit.h"
+
+
+#ifdef AUDIT_ALLOCATIONS
+
+// Replaces the global operator new and delete. The other forms (arrays,
+// nothrow) call these ones. Aligned allocations are not counted.
+
+void* operator new(const size_t size)
+{
+	++Lib::AllocationAudit::t_numAllocations;
+
+	if (void* p{ std::malloc(size > 0 ? size : 1) })
+		return p;
+
+	throw std::bad_alloc{};
+}
+
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+
+void operator delete(void* p, size_t) noexcept
+{
+	std::free(p);
+}
+
+#endif
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "Types.h"
+
+
+namespace Lib
+{
+	// Counts the allocations made with the global operator new on the
+	// current thread, for checking that forwarding doesn't allocate once
+	// the program has started. The counting operator new is only built
+	// with AUDIT_ALLOCATIONS (the audit build and the unit tests), see
+	// AllocationAudit.cpp. Otherwise the counts stay 0.
+	//
+	// An object counts the allocations of a phase, from its construction
+	// or from the end of the previous phase.
+	//
+	class AllocationAudit : NonCopyable
+	{
+	public:
+		AllocationAudit()
+			: m_phaseStart{ t_numAllocations }
+		{
+		}
+
+		// The number of allocations in the phase so far
+		uint64_t GetCount() const { return t_numAllocations - m_phaseStart; }
+
+		// Ends the phase and returns its number of allocations
+		//
+		uint64_t NextPhase()
+		{
+			auto count{ GetCount() };
+			m_phaseStart = t_numAllocations;
+
+			return count;
+		}
+
+		// Incremented by operator new
+		static inline thread_local uint64_t t_numAllocations{};
+
+	private:
+		uint64_t m_phaseStart;
+	};
+}
@@ -18,17 +18,26 @@ namespace Lib
 	// 1. Get the front block and read data from it
 	// 2. Pop the block from the queue
 	//
+	// Runs of contiguous blocks can be written with BackN/PushN and read with
+	// FrontN/PopN, which publish the whole run with a single atomic store.
+	//
+	// The number of blocks is a power of two, so the indices run freely and
+	// are masked when converted to a block position. The writer and the reader
+	// keep their index in separate cache lines, each with a cached copy of the
+	// other side's index, so they only touch the shared line when the cached
+	// value shows the queue as full (writer) or empty (reader).
+	//
 	template<typename T, size_t L>
 	class BlockQueue : NonCopyable
 	{
 	public:
 		static constexpr size_t cBlockLength{ L };				// in items of type T
 
-		// Allocates a queue for the given number of blocks
+		// Allocates a queue for the given number of blocks (rounded up to a power of two)
 		BlockQueue(const uint numBlocks)
-			: c_pOwnedBuffer{ new T[numBlocks * cBlockLength] }
+			: c_pOwnedBuffer{ new T[std::bit_ceil(numBlocks) * cBlockLength] }
 		{
-			SetBuffer({ c_pOwnedBuffer, numBlocks * cBlockLength });
+			SetBuffer({ c_pOwnedBuffer, std::bit_ceil(numBlocks) * cBlockLength });
 		}
 
 		// Uses an external buffer for the queue
@@ -42,34 +51,69 @@ namespace Lib
 			delete[] c_pOwnedBuffer;
 		}
 
+		// The buffer must hold a power of two number of blocks
+		//
 		void SetBuffer(std::span<T> buffer)
 		{
 			m_buffer = buffer;
-			m_numBlocks = buffer.size() / cBlockLength;
+			m_numBlocks = (uint)(buffer.size() / cBlockLength);
+			m_indexMask = m_numBlocks - 1;
+
+			assert(buffer.empty() || (std::has_single_bit(m_numBlocks) && buffer.size() == m_numBlocks * cBlockLength));
 
 			Clear();
 		}
 
-		uint GetNumFreeBlocks() const { return m_numFreeBlocks; }
-		uint GetNumUsedBlocks() const { return m_numBlocks - m_numFreeBlocks; }
+		uint GetNumBlocks() const { return m_numBlocks; }
+		uint GetNumFreeBlocks() const { return m_numBlocks - GetNumUsedBlocks(); }
+
+		// Can be called from any thread. The read index is loaded first, so
+		// the result is never negative, and it is clamped, because the writer
+		// may push more blocks after the reader popped some in between.
+		//
+		uint GetNumUsedBlocks() const
+		{
+			uint readIndex{ m_readIndex.load(std::memory_order_acquire) };
+
+			return std::min(m_writeIndex.load(std::memory_order_acquire) - readIndex, m_numBlocks);
+		}
 
 		// Returns a pointer to the back of the queue, or nullptr if the queue is full.
 		// The caller must write data to the buffer and call Push.
 		//
 		T* Back()
 		{
-			// Thread safe: the reader side can only increment m_numFreeBlocks
-			//
-			return m_numFreeBlocks > 0 ? ToPointer(m_writeIndex) : nullptr;
+			return GetWritableBlocks(1) > 0 ? ToPointer(m_writeIndex.load(std::memory_order_relaxed)) : nullptr;
 		}
 
 		// Enqueues the block previously obtained by calling Back
 		//
 		void Push()
 		{
-			assert(m_numFreeBlocks > 0);
-			--m_numFreeBlocks;
-			Advance(m_writeIndex);
+			PushN(1);
+		}
+
+		// Returns a span of up to maxBlocks free blocks at the back of the queue.
+		// The span is contiguous, so it may be shorter than the free space when
+		// the free space wraps around the end of the buffer. The caller must
+		// write data to the span and call PushN.
+		//
+		std::span<T> BackN(const uint maxBlocks)
+		{
+			auto writeIndex{ m_writeIndex.load(std::memory_order_relaxed) };
+			uint numBlocks{ std::min({ maxBlocks, GetWritableBlocks(maxBlocks), m_numBlocks - (writeIndex & m_indexMask) }) };
+
+			return { ToPointer(writeIndex), numBlocks * cBlockLength };
+		}
+
+		// Enqueues numBlocks blocks previously obtained by calling BackN
+		//
+		void PushN(const uint numBlocks)
+		{
+			auto writeIndex{ m_writeIndex.load(std::memory_order_relaxed) };
+
+			assert(numBlocks <= m_numBlocks - (writeIndex - m_cachedReadIndex));
+			m_writeIndex.store(writeIndex + numBlocks, std::memory_order_release);
 		}
 
 		// Pushes a copy of an element at the back of the queue.
@@ -77,9 +121,9 @@ namespace Lib
 		//
 		bool Enqueue(const T& element)
 		{
-			if (m_numFreeBlocks > 0)
+			if (T* pBlock{ Back() })
 			{
-				*ToPointer(m_writeIndex) = element;
+				*pBlock = element;
 				Push();
 
 				return true;
@@ -88,23 +132,55 @@ namespace Lib
 			return false;
 		}
 
+		// Copies whole blocks from the items span to the back of the queue.
+		// Returns the number of blocks copied, which is less than requested
+		// if the queue doesn't have enough free space.
+		//
+		uint EnqueueN(std::span<const T> items)
+		{
+			uint numBlocks{ std::min((uint)(items.size() / cBlockLength), GetWritableBlocks((uint)(items.size() / cBlockLength))) };
+			auto writeIndex{ m_writeIndex.load(std::memory_order_relaxed) };
+
+			CopyRun(items.first(numBlocks * cBlockLength), writeIndex, [](T* pBlock, const T* pItems, size_t length) { std::copy_n(pItems, length, pBlock); });
+			m_writeIndex.store(writeIndex + numBlocks, std::memory_order_release);
+
+			return numBlocks;
+		}
+
 		// Returns a pointer to the front of the queue, or nullptr if the queue is empty.
 		// The caller must read the data and call Pop.
 		//
 		T* Front()
 		{
-			// Thread safe: the writer size can only decrement m_numFreeBlocks
-			//
-			return GetNumUsedBlocks() > 0 ? ToPointer(m_readIndex) : nullptr;
+			return GetReadableBlocks(1) > 0 ? ToPointer(m_readIndex.load(std::memory_order_relaxed)) : nullptr;
 		}
 
 		// Pops the block previously obtained by calling Front
 		//
 		void Pop()
 		{
-			assert(m_numFreeBlocks < m_numBlocks);
-			++m_numFreeBlocks;
-			Advance(m_readIndex);
+			PopN(1);
+		}
+
+		// Returns a contiguous span of up to maxBlocks blocks from the front of the queue.
+		// The caller must read the data and call PopN.
+		//
+		std::span<T> FrontN(const uint maxBlocks)
+		{
+			auto readIndex{ m_readIndex.load(std::memory_order_relaxed) };
+			uint numBlocks{ std::min({ maxBlocks, GetReadableBlocks(maxBlocks), m_numBlocks - (readIndex & m_indexMask) }) };
+
+			return { ToPointer(readIndex), numBlocks * cBlockLength };
+		}
+
+		// Pops numBlocks blocks previously obtained by calling FrontN
+		//
+		void PopN(const uint numBlocks)
+		{
+			auto readIndex{ m_readIndex.load(std::memory_order_relaxed) };
+
+			assert(numBlocks <= m_cachedWriteIndex - readIndex);
+			m_readIndex.store(readIndex + numBlocks, std::memory_order_release);
 		}
 
 		// Pops a copy of an element from the front of the queue.
@@ -112,9 +188,9 @@ namespace Lib
 		//
 		bool Dequeue(T* pElement)
 		{
-			if (GetNumUsedBlocks() > 0)
+			if (T* pBlock{ Front() })
 			{
-				*pElement = *ToPointer(m_readIndex);
+				*pElement = *pBlock;
 				Pop();
 
 				return true;
@@ -123,24 +199,95 @@ namespace Lib
 			return false;
 		}
 
-		// Discards all data from the buffer
+		// Copies whole blocks from the front of the queue to the items span.
+		// Returns the number of blocks copied.
+		//
+		uint DequeueN(std::span<T> items)
+		{
+			uint numBlocks{ std::min((uint)(items.size() / cBlockLength), GetReadableBlocks((uint)(items.size() / cBlockLength))) };
+			auto readIndex{ m_readIndex.load(std::memory_order_relaxed) };
+
+			CopyRun(items.first(numBlocks * cBlockLength), readIndex, [](T* pBlock, T* pItems, size_t length) { std::copy_n(pBlock, length, pItems); });
+			m_readIndex.store(readIndex + numBlocks, std::memory_order_release);
+
+			return numBlocks;
+		}
+
+		// Discards all data from the buffer.
+		// Not thread-safe: neither side may use the queue at the same time.
 		//
 		void Clear()
 		{
-			m_writeIndex = 0;
-			m_readIndex = 0;
-			m_numFreeBlocks = m_numBlocks;
+			m_writeIndex.store(0, std::memory_order_relaxed);
+			m_readIndex.store(0, std::memory_order_relaxed);
+			m_cachedReadIndex = 0;
+			m_cachedWriteIndex = 0;
 		}
 
 	private:
-		T* ToPointer(const uint index) { return m_buffer.data() + index * cBlockLength; }
-		void Advance(uint& index) const { if (++index >= m_numBlocks) index = 0; }
+		T* ToPointer(const uint index) { return m_buffer.data() + (index & m_indexMask) * cBlockLength; }
+
+		// Writer side: returns the number of free blocks. The reader's index
+		// is re-read only if the cached copy shows less than numWanted blocks.
+		//
+		uint GetWritableBlocks(const uint numWanted)
+		{
+			auto writeIndex{ m_writeIndex.load(std::memory_order_relaxed) };
+			uint numFree{ m_numBlocks - (writeIndex - m_cachedReadIndex) };
+
+			if (numFree < numWanted)
+			{
+				m_cachedReadIndex = m_readIndex.load(std::memory_order_acquire);
+				numFree = m_numBlocks - (writeIndex - m_cachedReadIndex);
+			}
+
+			return numFree;
+		}
 
+		// Reader side: returns the number of used blocks. The writer's index
+		// is re-read only if the cached copy shows less than numWanted blocks.
+		//
+		uint GetReadableBlocks(const uint numWanted)
+		{
+			auto readIndex{ m_readIndex.load(std::memory_order_relaxed) };
+			uint numUsed{ m_cachedWriteIndex - readIndex };
+
+			if (numUsed < numWanted)
+			{
+				m_cachedWriteIndex = m_writeIndex.load(std::memory_order_acquire);
+				numUsed = m_cachedWriteIndex - readIndex;
+			}
+
+			return numUsed;
+		}
+
+		// Calls copy(pBlock, pItems, length) for the one or two contiguous
+		// pieces of the run of blocks that starts at index
+		//
+		template<typename U, typename F>
+		void CopyRun(std::span<U> items, const uint index, F copy)
+		{
+			auto* pBlock{ ToPointer(index) };
+			size_t firstLength{ std::min(items.size(), (m_numBlocks - (index & m_indexMask)) * cBlockLength) };
+
+			copy(pBlock, items.data(), firstLength);
+
+			if (firstLength < items.size())
+				copy(m_buffer.data(), items.data() + firstLength, items.size() - firstLength);
+		}
+
+		// Read-only after SetBuffer
 		T* const			c_pOwnedBuffer{};
 		std::span<T>		m_buffer;
 		uint				m_numBlocks{};
-		std::atomic<uint>	m_numFreeBlocks{};
-		uint				m_writeIndex{};		// index of the block at the write position
-		uint				m_readIndex{};		// index of the block at the read position
+		uint				m_indexMask{};
+
+		// Writer section
+		alignas(cCacheLineSize) std::atomic<uint> m_writeIndex{};		// index of the block at the write position
+		uint				m_cachedReadIndex{};	// writer's copy of m_readIndex
+
+		// Reader section
+		alignas(cCacheLineSize) std::atomic<uint> m_readIndex{};		// index of the block at the read position
+		uint				m_cachedWriteIndex{};	// reader's copy of m_writeIndex
 	};
 }
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <cassert>
+#include "Types.h"
+
+
+namespace Lib
+{
+	// Ring of items written by one producer and read by up to M consumers.
+	// Every consumer has its own read cursor and sees every item published
+	// after it was added, so the producer publishes each item only once.
+	//
+	// Producer:
+	// 1. Reclaim the items that all the consumers have passed
+	// 2. Publish new items
+	//
+	// Consumer:
+	// 1. Peek a contiguous span of items at its cursor
+	// 2. Advance its cursor past the items it has finished with
+	//
+	// The cursors are kept in separate cache lines, so the consumers never
+	// write to a shared line. Only the producer reads all of them (to find
+	// the slowest one) when it reclaims items.
+	//
+	// Thread-safe when the producer and each consumer are used by one
+	// thread each. Adding and removing consumers belongs to the producer.
+	//
+	// It beats a queue per consumer only with fan-out. With one consumer
+	// it is no faster and can be slower (see BroadcastRingTest).
+	//
+	template<typename T, uint M>
+	class BroadcastRing : NonCopyable
+	{
+	public:
+		static constexpr uint cMaxConsumers{ M };
+
+		// Allocates a ring for the given number of items (rounded up to a power of two)
+		BroadcastRing(const uint numItems)
+			: c_numItems{ std::bit_ceil(numItems) }
+			, c_indexMask{ c_numItems - 1 }
+			, c_pItems{ new T[c_numItems] }
+		{
+		}
+
+		~BroadcastRing()
+		{
+			delete[] c_pItems;
+		}
+
+		uint GetNumItems() const { return c_numItems; }
+
+		// Number of published items that have not been reclaimed yet
+		uint GetNumUsedItems() const { return m_writeIndex.load(std::memory_order_relaxed) - m_reclaimIndex; }
+		uint GetNumFreeItems() const { return c_numItems - GetNumUsedItems(); }
+
+		// --- Producer side
+
+		// Adds a consumer whose cursor starts at the current write position.
+		// Returns the consumer's id, or -1 if there is no free cursor.
+		//
+		int AddConsumer()
+		{
+			for (uint id{}; id < cMaxConsumers; ++id)
+			{
+				Cursor& cursor{ m_cursors[id] };
+
+				if (!cursor.isUsed)
+				{
+					cursor.index.store(m_writeIndex.load(std::memory_order_relaxed), std::memory_order_relaxed);
+					cursor.isUsed = true;
+
+					return (int)id;
+				}
+			}
+
+			return -1;
+		}
+
+		// Removes a consumer. The items it has not read yet are reclaimed
+		// by the next call to Reclaim (if the other consumers have passed them).
+		//
+		void RemoveConsumer(const uint id)
+		{
+			assert(id < cMaxConsumers && m_cursors[id].isUsed);
+
+			m_cursors[id].isUsed = false;
+		}
+
+		// Calls onReclaim(item) for every item that all the consumers have
+		// passed, oldest first, and frees its slot.
+		// Returns the number of items reclaimed.
+		//
+		template<typename F>
+		uint Reclaim(F onReclaim)
+		{
+			auto endIndex{ m_writeIndex.load(std::memory_order_relaxed) };
+
+			for (const Cursor& cursor : m_cursors)
+			{
+				if (cursor.isUsed)
+				{
+					auto index{ cursor.index.load(std::memory_order_acquire) };
+
+					if (index - m_reclaimIndex < endIndex - m_reclaimIndex)
+						endIndex = index;
+				}
+			}
+
+			uint numReclaimed{ endIndex - m_reclaimIndex };
+
+			for (; m_reclaimIndex != endIndex; ++m_reclaimIndex)
+				onReclaim(c_pItems[m_reclaimIndex & c_indexMask]);
+
+			return numReclaimed;
+		}
+
+		// Appends a copy of an item to the ring.
+		// Returns true on success, false if the ring is full
+		// (the caller may reclaim some items and try again).
+		//
+		bool Publish(const T& item)
+		{
+			auto writeIndex{ m_writeIndex.load(std::memory_order_relaxed) };
+
+			if (writeIndex - m_reclaimIndex >= c_numItems)
+				return false;
+
+			c_pItems[writeIndex & c_indexMask] = item;
+			m_writeIndex.store(writeIndex + 1, std::memory_order_release);
+
+			return true;
+		}
+
+		// --- Consumer side
+
+		// Returns the number of items the consumer has not read yet
+		//
+		uint GetNumPending(const uint id) const
+		{
+			return m_writeIndex.load(std::memory_order_acquire) - m_cursors[id].index.load(std::memory_order_relaxed);
+		}
+
+		// Returns a contiguous span of up to maxItems unread items at the
+		// consumer's cursor. The span ends at the end of the ring buffer,
+		// so there may be more items available after advancing.
+		//
+		std::span<const T> Peek(const uint id, const uint maxItems) const
+		{
+			assert(id < cMaxConsumers && m_cursors[id].isUsed);
+
+			auto index{ m_cursors[id].index.load(std::memory_order_relaxed) };
+			uint numItems{ std::min({ maxItems,
+					m_writeIndex.load(std::memory_order_acquire) - index,
+					c_numItems - (index & c_indexMask) }) };
+
+			return { c_pItems + (index & c_indexMask), numItems };
+		}
+
+		// Moves the consumer's cursor past numItems items previously obtained by Peek
+		//
+		void Advance(const uint id, const uint numItems)
+		{
+			assert(numItems <= GetNumPending(id));
+
+			auto& index{ m_cursors[id].index };
+			index.store(index.load(std::memory_order_relaxed) + numItems, std::memory_order_release);
+		}
+
+		// Moves the consumer's cursor past all the published items
+		//
+		void Skip(const uint id)
+		{
+			m_cursors[id].index.store(m_writeIndex.load(std::memory_order_acquire), std::memory_order_release);
+		}
+
+	private:
+		struct alignas(cCacheLineSize) Cursor
+		{
+			std::atomic<uint> index{};		// index of the next item to be read
+			bool isUsed{};
+		};
+
+		const uint			c_numItems;
+		const uint			c_indexMask;
+		T* const			c_pItems;
+
+		// Producer section
+		alignas(cCacheLineSize) std::atomic<uint> m_writeIndex{};		// index of the next item to be published
+		uint				m_reclaimIndex{};		// index of the oldest item not yet reclaimed
+
+		std::array<Cursor, cMaxConsumers> m_cursors{};
+	};
+}
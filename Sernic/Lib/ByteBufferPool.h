@@ -6,8 +6,31 @@
 
 namespace Lib
 {
+	// Where a buffer was got, handed over or put back. Recorded only with
+	// TRACE_BUFFERS, otherwise the argument is an empty object that the
+	// compiler drops.
+	//
+#ifdef TRACE_BUFFERS
+	using BufferSite = std::source_location;
+#else
+	struct BufferSite
+	{
+		static constexpr BufferSite current() { return {}; }
+	};
+#endif
+
+
 	// A pool of ManagedByteBuffer objects
 	//
+	// With TRACE_BUFFERS (the debug builds) the pool keeps a trace of each
+	// buffer: the site where it was got, its current owner and the site
+	// of the last operation on it. A put of a buffer that is already back
+	// in the pool is reported with the trace at once, and the buffers not
+	// returned when the pool is destroyed are reported as leaks (both to
+	// stderr, the program is about to stop). ForEachHeldBuffer finds the
+	// buffers held for too long, not counting the references that are kept
+	// on purpose (Keep).
+	//
 	template <size_t BufSize>
 	class ByteBufferPool : Lib::Pool<Lib::ManagedByteBuffer<BufSize>>
 	{
@@ -16,15 +39,47 @@ namespace Lib
 	public:
 		using Buffer = Base::ItemType;
 
+#ifdef TRACE_BUFFERS
+		struct Trace
+		{
+			BufferSite gotAt;
+			BufferSite lastAt;			// the last AddRef, PutBuffer or SetOwner
+			std::string_view owner;		// set with SetOwner
+			std::chrono::steady_clock::time_point ownedSince;
+			bool isHeld;
+			int numKept;				// of the references, see Keep
+		};
+#endif
+
 		ByteBufferPool(uint count)
 			: Base{ count }
+#ifdef TRACE_BUFFERS
+			, m_traces(count)
+#endif
 		{
 		}
 
+#ifdef TRACE_BUFFERS
+		~ByteBufferPool()
+		{
+			for (size_t index{}; index < m_traces.size(); ++index)
+			{
+				if (m_traces[index].isHeld)
+				{
+					std::cerr << "Buffer leaked: ";
+					PrintTrace(std::cerr, Base::GetItem(index));
+					std::cerr << std::endl;
+				}
+			}
+		}
+#endif
+
+		using Base::GetNumFree;
+
 		// Gets a new buffer from the pool, or nullptr if the pool was empty.
 		// The buffer's ref count is 1.
 		//
-		Buffer* GetBuffer()
+		Buffer* GetBuffer([[maybe_unused]] const BufferSite site = BufferSite::current())
 		{
 			Buffer* pBuffer{ Base::Get() };
 
@@ -32,23 +87,161 @@ namespace Lib
 			{
 				pBuffer->m_dataSize = 0;
 				pBuffer->m_refCount = 1;
+
+#ifdef TRACE_BUFFERS
+				m_traces[Base::GetIndex(pBuffer)] = { site, site, {}, std::chrono::steady_clock::now(), true, 0 };
+#endif
 			}
 
 			return pBuffer;
 		}
 
+		// Adds a reference to a buffer obtained from GetBuffer(), which must
+		// be released with one more call to PutBuffer()
+		//
+		void AddRef(const Buffer* pBuffer, const BufferSite site = BufferSite::current())
+		{
+			auto* pBuf{ const_cast<Buffer*>(pBuffer) };
+
+			CheckHeld(pBuffer, "AddRef", site);
+			assert(pBuf->m_refCount > 0);
+			++pBuf->m_refCount;
+		}
+
 		// Returns a buffer obtained from GetBuffer() to the pool.
 		// It decrements the buffer's ref count and if it becomes
 		// zero the buffer is put back into the pool.
 		//
-		void PutBuffer(const Buffer* pBuffer)
+		void PutBuffer(const Buffer* pBuffer, const BufferSite site = BufferSite::current())
 		{
 			auto* pBuf{ const_cast<Buffer*>(pBuffer) };
 
+			CheckHeld(pBuffer, "PutBuffer", site);
 			assert(pBuf->m_refCount > 0);
 
 			if (--pBuf->m_refCount == 0)
+			{
+#ifdef TRACE_BUFFERS
+				m_traces[Base::GetIndex(pBuf)].isHeld = false;
+#endif
 				Base::Put(pBuf);
+			}
+		}
+
+		// Records who holds the buffer now (a client, a filter or a queue).
+		// Does nothing without TRACE_BUFFERS, like Keep and Unkeep.
+		//
+		void SetOwner(
+				[[maybe_unused]] const Buffer* pBuffer,
+				[[maybe_unused]] const std::string_view owner,
+				[[maybe_unused]] const BufferSite site = BufferSite::current())
+		{
+#ifdef TRACE_BUFFERS
+			Trace& trace{ m_traces[Base::GetIndex(pBuffer)] };
+
+			trace.owner = owner;
+			trace.ownedSince = std::chrono::steady_clock::now();
+			trace.lastAt = site;
+#endif
 		}
+
+		// Marks one of the buffer's references as held for as long as it
+		// takes (a read waiting for data, a scrollback), until Unkeep
+		//
+		void Keep([[maybe_unused]] const Buffer* pBuffer, [[maybe_unused]] const BufferSite site = BufferSite::current())
+		{
+#ifdef TRACE_BUFFERS
+			Trace& trace{ m_traces[Base::GetIndex(pBuffer)] };
+
+			++trace.numKept;
+			trace.lastAt = site;
+#endif
+		}
+
+		void Unkeep([[maybe_unused]] const Buffer* pBuffer, [[maybe_unused]] const BufferSite site = BufferSite::current())
+		{
+#ifdef TRACE_BUFFERS
+			Trace& trace{ m_traces[Base::GetIndex(pBuffer)] };
+
+			assert(trace.numKept > 0);
+			--trace.numKept;
+			trace.ownedSince = std::chrono::steady_clock::now();
+			trace.lastAt = site;
+#endif
+		}
+
+#ifdef TRACE_BUFFERS
+		// Calls onBuffer(const Buffer*, std::chrono::milliseconds held) for
+		// each buffer held by its owner for longer than the threshold with
+		// references that are not kept
+		//
+		template<typename F>
+		void ForEachHeldBuffer(const std::chrono::milliseconds threshold, F onBuffer) const
+		{
+			auto now{ std::chrono::steady_clock::now() };
+
+			for (size_t index{}; index < m_traces.size(); ++index)
+			{
+				const Trace& trace{ m_traces[index] };
+				auto held{ std::chrono::duration_cast<std::chrono::milliseconds>(now - trace.ownedSince) };
+
+				if (trace.isHeld && Base::GetItem(index)->m_refCount > trace.numKept && held > threshold)
+					onBuffer(Base::GetItem(index), held);
+			}
+		}
+
+		const Trace& GetTrace(const Buffer* pBuffer) const { return m_traces[Base::GetIndex(pBuffer)]; }
+
+		// Prints the buffer's number, owner, ref count and sites
+		//
+		void PrintTrace(std::ostream& os, const Buffer* pBuffer) const
+		{
+			const Trace& trace{ GetTrace(pBuffer) };
+
+			os << '#' << Base::GetIndex(pBuffer) << " owner " << (trace.owner.empty() ? "unknown"sv : trace.owner)
+					<< ", refs " << pBuffer->m_refCount << ", got at ";
+			PrintSite(os, trace.gotAt);
+			os << ", last at ";
+			PrintSite(os, trace.lastAt);
+		}
+#endif
+
+	private:
+#ifdef TRACE_BUFFERS
+		static void PrintSite(std::ostream& os, const BufferSite& site)
+		{
+			std::string_view file{ site.file_name() };
+
+			os << file.substr(file.find_last_of("\\/") + 1) << '(' << site.line() << ") " << site.function_name();
+		}
+#endif
+
+		// Reports a buffer that is already back in the pool at once, before
+		// the ref count assert stops the program. Records the site.
+		//
+		void CheckHeld(
+				[[maybe_unused]] const Buffer* pBuffer,
+				[[maybe_unused]] const char* pOperation,
+				[[maybe_unused]] const BufferSite& site)
+		{
+#ifdef TRACE_BUFFERS
+			Trace& trace{ m_traces[Base::GetIndex(pBuffer)] };
+
+			if (!trace.isHeld)
+			{
+				std::cerr << pOperation << " of a buffer that is back in the pool at ";
+				PrintSite(std::cerr, site);
+				std::cerr << ": ";
+				PrintTrace(std::cerr, pBuffer);
+				std::cerr << std::endl;
+			}
+
+			trace.lastAt = site;
+#endif
+		}
+
+#ifdef TRACE_BUFFERS
+		std::vector<Trace> m_traces;		// of the buffers, in the order of the pool's items
+#endif
 	};
 }
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <cassert>
+#include "FrameArena.h"
+
+
+namespace Lib
+{
+	// All the coroutine frames come from one static arena, so a client
+	// allocates its frames when it opens and never again while running.
+	// The arena is global and has 32 slots of 2 KB for all the clients,
+	// and it is not thread-safe: the tasks must be created and destroyed
+	// on the thread of the event loop (Runner::Run).
+	//
+	// A frame that doesn't fit fails the client's Open. The coroutine
+	// bodies log with LogMessage (see Log.h), so the frames stay small
+	// also in the debug builds.
+	//
+	using TaskFrameArena = FrameArena<2048, 32>;
+
+	inline TaskFrameArena& GetTaskFrameArena()
+	{
+		static TaskFrameArena s_arena;
+		return s_arena;
+	}
+
+
+	// Coroutine that starts running as soon as it is called and runs until
+	// its first co_await. It is resumed by whoever the awaited object gave
+	// the coroutine handle to (see EventWaiters).
+	//
+	// The Task object owns the coroutine frame and destroys it, so the
+	// coroutine may be destroyed while suspended. A coroutine that finishes
+	// or is destroyed leaves the EventWaiters slot it waited in.
+	//
+	// If the frame arena has no room for the frame, the returned Task is
+	// empty and the coroutine doesn't run.
+	//
+	class Task
+	{
+	public:
+		struct promise_type
+		{
+			Task get_return_object() { return Task{ std::coroutine_handle<promise_type>::from_promise(*this) }; }
+			static Task get_return_object_on_allocation_failure() { return {}; }
+			std::suspend_never initial_suspend() noexcept { return {}; }
+			std::suspend_always final_suspend() noexcept { LeaveWaiter(); return {}; }
+			void return_void() {}
+			void unhandled_exception() { std::terminate(); }
+
+			static void* operator new(size_t size) noexcept { return GetTaskFrameArena().Allocate(size); }
+			static void operator delete(void* pFrame) noexcept { GetTaskFrameArena().Free(pFrame); }
+
+			// Puts the coroutine into the slot of the event it is about to
+			// wait for and takes it out of the previous one. A loop that waits
+			// for the same event again writes nothing.
+			//
+			void WaitIn(std::coroutine_handle<>& waiter, const std::coroutine_handle<> handle) noexcept
+			{
+				if (pWaiter == &waiter)
+					return;
+
+				LeaveWaiter();
+				assert(!waiter);
+				waiter = handle;
+				pWaiter = &waiter;
+			}
+
+			void LeaveWaiter() noexcept
+			{
+				if (pWaiter)
+				{
+					*pWaiter = {};
+					pWaiter = {};
+				}
+			}
+
+			std::coroutine_handle<>* pWaiter{};		// the slot the coroutine is in
+		};
+
+		Task() = default;
+
+		Task(Task&& other) noexcept
+			: m_handle{ std::exchange(other.m_handle, {}) }
+		{
+		}
+
+		Task& operator=(Task&& other) noexcept
+		{
+			if (this != &other)
+			{
+				Destroy();
+				m_handle = std::exchange(other.m_handle, {});
+			}
+
+			return *this;
+		}
+
+		~Task()
+		{
+			Destroy();
+		}
+
+		// Returns false if the task could not be created
+		explicit operator bool() const { return !!m_handle; }
+
+		// Returns true if the coroutine has finished (co_return)
+		bool IsDone() const { return !m_handle || m_handle.done(); }
+
+	private:
+		explicit Task(std::coroutine_handle<promise_type> handle)
+			: m_handle{ handle }
+		{
+		}
+
+		void Destroy()
+		{
+			if (m_handle)
+			{
+				m_handle.promise().LeaveWaiter();
+				m_handle.destroy();
+				m_handle = {};
+			}
+		}
+
+		std::coroutine_handle<promise_type> m_handle;
+	};
+
+
+	// Task coroutines waiting for numbered events.
+	// A coroutine suspends with co_await Wait(index) and continues when the
+	// owner of the events calls Resume(index). Only one coroutine may wait
+	// for a given event at a time.
+	//
+	// A slot keeps its coroutine while it runs after being resumed, until
+	// it waits for another event, finishes or is destroyed. Nothing is
+	// written for a loop that waits for the same event on every pass, which
+	// is most of the cost of an event. So a coroutine must not be resumed
+	// again from its own code, and the tasks must be destroyed before the
+	// EventWaiters.
+	//
+	template <uint N>
+	class EventWaiters : NonCopyable
+	{
+	public:
+		static constexpr uint cNumEvents{ N };
+
+		auto Wait(const uint index)
+		{
+			struct Awaiter
+			{
+				std::coroutine_handle<>& waiter;
+
+				bool await_ready() const noexcept { return false; }
+				void await_suspend(std::coroutine_handle<Task::promise_type> handle) noexcept { handle.promise().WaitIn(waiter, handle); }
+				void await_resume() const noexcept {}
+			};
+
+			assert(index < cNumEvents);
+			return Awaiter{ m_waiters[index] };
+		}
+
+		bool IsWaiting(const uint index) const { return !!m_waiters[index]; }
+
+		// The slot of the coroutine waiting for the event, null when none is,
+		// for resuming it without looking it up on each event
+		//
+		std::coroutine_handle<>* GetSlot(const uint index)
+		{
+			assert(index < cNumEvents);
+			return &m_waiters[index];
+		}
+
+		// Resumes the coroutine waiting for the event and returns when it
+		// suspends again. Returns false if no coroutine was waiting.
+		//
+		bool Resume(const uint index)
+		{
+			assert(index < cNumEvents);
+
+			if (auto waiter{ m_waiters[index] })
+			{
+				waiter.resume();
+				return true;
+			}
+
+			return false;
+		}
+
+	private:
+		std::array<std::coroutine_handle<>, cNumEvents> m_waiters{};
+	};
+}
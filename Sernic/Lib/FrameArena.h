@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cassert>
+#include "Types.h"
+
+
+namespace Lib
+{
+	// Fixed set of equal-size memory slots, used for coroutine frames.
+	// The slots are part of the object, so with a static arena the frames
+	// never come from the heap.
+	//
+	// Not thread-safe: all the slots of an arena must be allocated and
+	// freed on one thread. The arena doesn't grow, Allocate fails once
+	// NumSlots frames are in use.
+	//
+	template <size_t SlotSize, uint NumSlots>
+	class FrameArena : NonCopyable
+	{
+	public:
+		static constexpr size_t cSlotSize{ SlotSize };
+		static constexpr uint cNumSlots{ NumSlots };
+
+		FrameArena()
+		{
+			for (uint i{}; i < cNumSlots; ++i)
+				m_freeSlots[i] = cNumSlots - 1 - i;
+
+			m_numFreeSlots = cNumSlots;
+		}
+
+		uint GetNumFreeSlots() const { return m_numFreeSlots; }
+
+		// Returns a free slot, or nullptr if the size exceeds the slot size
+		// or there is no free slot left
+		//
+		void* Allocate(const size_t size) noexcept
+		{
+			if (size > cSlotSize || m_numFreeSlots == 0)
+				return nullptr;
+
+			return m_slots[m_freeSlots[--m_numFreeSlots]].data();
+		}
+
+		// Returns a slot obtained from Allocate() to the arena
+		//
+		void Free(void* pSlot) noexcept
+		{
+			auto index{ (Slot*)pSlot - m_slots.data() };
+
+			assert(index >= 0 && index < (std::ptrdiff_t)cNumSlots && m_numFreeSlots < cNumSlots);
+			m_freeSlots[m_numFreeSlots++] = (uint)index;
+		}
+
+	private:
+		using Slot = std::array<std::byte, cSlotSize>;
+
+		static_assert(cSlotSize % alignof(std::max_align_t) == 0, "Slots must keep the frames aligned");
+
+		alignas(std::max_align_t) std::array<Slot, cNumSlots> m_slots;
+		std::array<uint, cNumSlots> m_freeSlots;
+		uint m_numFreeSlots;
+	};
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cassert>
+#include "Types.h"
+
+
+namespace Lib
+{
+	// Keeps the most recent items: when the ring is full, pushing an item
+	// evicts the oldest one. Every item has a position (its sequence number)
+	// that doesn't change while the item is in the ring, so a reader can
+	// walk the items with its own position while new items are pushed, and
+	// find out from GetFirst that it has fallen behind.
+	// Not thread-safe.
+	//
+	template<typename T>
+	class HistoryRing : NonCopyable
+	{
+	public:
+		// A ring with no capacity keeps nothing
+		//
+		explicit HistoryRing(const uint capacity = 0)
+		{
+			SetCapacity(capacity);
+		}
+
+		// Discards all the items. Their positions are not reused.
+		//
+		void SetCapacity(const uint capacity)
+		{
+			m_items.assign(capacity, T{});
+			m_first = m_end;
+		}
+
+		uint GetCapacity() const { return (uint)m_items.size(); }
+		uint GetSize() const { return (uint)(m_end - m_first); }
+		bool IsEmpty() const { return m_end == m_first; }
+
+		// Positions of the oldest item and past the newest one
+		uint64_t GetFirst() const { return m_first; }
+		uint64_t GetEnd() const { return m_end; }
+
+		// Adds an item as the newest one. If the ring was full, the oldest
+		// item is moved to pEvicted and true is returned.
+		//
+		bool Push(const T& item, T* pEvicted)
+		{
+			assert(GetCapacity() > 0);
+
+			bool isFull{ GetSize() == GetCapacity() };
+
+			if (isFull)
+				*pEvicted = std::move(m_items[m_first++ % m_items.size()]);
+
+			m_items[m_end++ % m_items.size()] = item;
+
+			return isFull;
+		}
+
+		// Removes the oldest item into pItem. Returns false if the ring is empty.
+		//
+		bool PopFirst(T* pItem)
+		{
+			if (IsEmpty())
+				return false;
+
+			*pItem = std::move(m_items[m_first++ % m_items.size()]);
+
+			return true;
+		}
+
+		// Returns the item at a position in [GetFirst(), GetEnd())
+		//
+		const T& operator[](const uint64_t position) const
+		{
+			assert(position >= m_first && position < m_end);
+			return m_items[position % m_items.size()];
+		}
+
+	private:
+		std::vector<T> m_items;
+		uint64_t m_first{};			// position of the oldest item
+		uint64_t m_end{};			// position of the next item pushed
+	};
+}
@@ -0,0 +1,261 @@
+#pragma once
+
+#include <cstring>
+#include "Types.h"
+
+
+namespace Lib
+{
+	// Compresses and decompresses data in the LZ4 block format, so the
+	// blocks can also be read with the lz4 library (LZ4_decompress_safe).
+	//
+	// Each block is compressed on its own, without a dictionary from the
+	// blocks before it, so any block can be decompressed by itself.
+	// The compressor is the greedy one of LZ4's fast mode: a hash of the
+	// next 4 bytes finds the last position that had the same hash, and the
+	// search steps over the data faster while it finds no matches (text
+	// that doesn't repeat, binary data).
+	//
+	// A block is a series of sequences: a token (the number of literals and
+	// the length of the match, 4 bits each), more literal length bytes if
+	// it is 15 or more, the literals, the offset of the match (2 bytes) and
+	// more match length bytes. The last sequence has only literals, at
+	// least cLastLiterals of them.
+	//
+	class Lz4Block : NonCopyable
+	{
+	public:
+		static constexpr size_t npos{ std::numeric_limits<size_t>::max() };
+
+		// The largest block the compressor writes for size bytes of data
+		//
+		static constexpr size_t GetMaxCompressedSize(const size_t size) { return size + size / 255 + 16; }
+
+		// Compresses the data into out.
+		// Returns the size of the block, or 0 if it doesn't fit.
+		//
+		size_t Compress(const std::span<const uint8_t> data, const std::span<uint8_t> out)
+		{
+			const uint8_t* const pBegin{ data.data() };
+			const uint8_t* const pEnd{ pBegin + data.size() };
+			const uint8_t* pLiterals{ pBegin };
+			uint8_t* pOut{ out.data() };
+			uint8_t* const pOutEnd{ pOut + out.size() };
+
+			if (data.size() >= cMinMatchDistance + 1)
+			{
+				// A match must start cMinMatchDistance bytes before the end
+				// and end cLastLiterals bytes before it
+
+				const uint8_t* const pMatchLimit{ pEnd - cMinMatchDistance };
+				const uint8_t* const pMatchEnd{ pEnd - cLastLiterals };
+
+				m_table.fill(0);
+
+				const uint8_t* pData{ pBegin + 1 };
+				uint numMisses{};
+
+				while (pData <= pMatchLimit)
+				{
+					uint32_t value{ Read32(pData) };
+					uint32_t& position{ m_table[Hash(value)] };
+					const uint8_t* pMatch{ pBegin + position };
+
+					position = (uint32_t)(pData - pBegin);
+
+					if (pMatch >= pData || pData - pMatch > cMaxOffset || Read32(pMatch) != value)
+					{
+						pData += 1 + (numMisses++ >> cSkipShift);
+						continue;
+					}
+
+					numMisses = 0;
+
+					// Extend the match backwards over the literals and then forwards
+
+					while (pData > pLiterals && pMatch > pBegin && pData[-1] == pMatch[-1])
+					{
+						--pData;
+						--pMatch;
+					}
+
+					size_t length{ cMinMatch };
+
+					while (pData + length < pMatchEnd && pData[length] == pMatch[length])
+						++length;
+
+					pOut = WriteSequence(pOut, pOutEnd, pLiterals, pData, (uint16_t)(pData - pMatch), length);
+
+					if (!pOut)
+						return 0;
+
+					pData += length;
+					pLiterals = pData;
+				}
+			}
+
+			pOut = WriteSequence(pOut, pOutEnd, pLiterals, pEnd, 0, 0);
+
+			return pOut ? pOut - out.data() : 0;
+		}
+
+		// Decompresses a block into out, which must have room for all of it.
+		// Returns the size of the data, or npos if the block is not valid or
+		// doesn't fit.
+		//
+		static size_t Decompress(const std::span<const uint8_t> block, const std::span<uint8_t> out)
+		{
+			const uint8_t* pBlock{ block.data() };
+			const uint8_t* const pBlockEnd{ pBlock + block.size() };
+			uint8_t* pOut{ out.data() };
+			uint8_t* const pOutEnd{ pOut + out.size() };
+
+			while (pBlock < pBlockEnd)
+			{
+				uint token{ *pBlock++ };
+				size_t numLiterals{ token >> 4 };
+
+				if (!ReadLength(pBlock, pBlockEnd, numLiterals)
+					|| numLiterals > (size_t)(pBlockEnd - pBlock) || numLiterals > (size_t)(pOutEnd - pOut))
+				{
+					return npos;
+				}
+
+				std::memcpy(pOut, pBlock, numLiterals);
+				pBlock += numLiterals;
+				pOut += numLiterals;
+
+				if (pBlock == pBlockEnd)
+					return pOut - out.data();		// the last sequence
+
+				if (pBlockEnd - pBlock < 2)
+					return npos;
+
+				size_t offset{ (size_t)pBlock[0] | (size_t)pBlock[1] << 8 };
+				pBlock += 2;
+
+				size_t length{ token & 0xFu };
+
+				if (offset == 0 || offset > (size_t)(pOut - out.data()) || !ReadLength(pBlock, pBlockEnd, length))
+					return npos;
+
+				length += cMinMatch;
+
+				if (length > (size_t)(pOutEnd - pOut))
+					return npos;
+
+				// The match may overlap the data it produces (a repeated pattern)
+
+				const uint8_t* pMatch{ pOut - offset };
+
+				if (offset >= length)
+					std::memcpy(pOut, pMatch, length);
+				else
+				{
+					for (size_t index{}; index < length; ++index)
+						pOut[index] = pMatch[index];
+				}
+
+				pOut += length;
+			}
+
+			return npos;		// no last sequence
+		}
+
+	private:
+		static constexpr size_t cMinMatch{ 4 };
+		static constexpr size_t cLastLiterals{ 5 };
+		static constexpr size_t cMinMatchDistance{ 12 };	// from the start of the last match to the end
+		static constexpr ptrdiff_t cMaxOffset{ 65535 };
+		static constexpr uint cHashBits{ 12 };
+		static constexpr uint cSkipShift{ 6 };				// the step grows by 1 every 64 misses
+
+		static uint32_t Read32(const uint8_t* pData)
+		{
+			uint32_t value;
+			std::memcpy(&value, pData, sizeof(value));
+			return value;
+		}
+
+		static uint Hash(const uint32_t value)
+		{
+			return (value * 2654435761u) >> (32 - cHashBits);
+		}
+
+		// Writes a length of 15 or more as the extra bytes after the token
+		//
+		static uint8_t* WriteLength(uint8_t* pOut, size_t length)
+		{
+			for (length -= 15; length >= 255; length -= 255)
+				*pOut++ = 255;
+
+			*pOut++ = (uint8_t)length;
+
+			return pOut;
+		}
+
+		// Adds the extra length bytes (if the length in the token is 15)
+		// Returns false at the end of the block.
+		//
+		static bool ReadLength(const uint8_t*& pBlock, const uint8_t* pBlockEnd, size_t& length)
+		{
+			if (length != 15)
+				return true;
+
+			for (;;)
+			{
+				if (pBlock == pBlockEnd)
+					return false;
+
+				uint8_t byte{ *pBlock++ };
+				length += byte;
+
+				if (byte != 255)
+					return true;
+			}
+		}
+
+		// Writes the literals and the match (none if length is 0).
+		// Returns the end of the sequence, or nullptr if it doesn't fit.
+		//
+		static uint8_t* WriteSequence(
+				uint8_t* pOut,
+				uint8_t* const pOutEnd,
+				const uint8_t* const pLiterals,
+				const uint8_t* const pLiteralsEnd,
+				const uint16_t offset,
+				const size_t length)
+		{
+			size_t numLiterals{ (size_t)(pLiteralsEnd - pLiterals) };
+			size_t matchLength{ length > 0 ? length - cMinMatch : 0 };
+
+			if ((size_t)(pOutEnd - pOut) < 1 + numLiterals / 255 + 1 + numLiterals + 2 + matchLength / 255 + 1)
+				return nullptr;
+
+			uint8_t* pToken{ pOut++ };
+
+			*pToken = (uint8_t)(std::min<size_t>(numLiterals, 15) << 4);
+
+			if (numLiterals >= 15)
+				pOut = WriteLength(pOut, numLiterals);
+
+			std::memcpy(pOut, pLiterals, numLiterals);
+			pOut += numLiterals;
+
+			if (length == 0)
+				return pOut;
+
+			*pOut++ = (uint8_t)offset;
+			*pOut++ = (uint8_t)(offset >> 8);
+
+			*pToken |= (uint8_t)std::min<size_t>(matchLength, 15);
+
+			if (matchLength >= 15)
+				pOut = WriteLength(pOut, matchLength);
+
+			return pOut;
+		}
+
+		std::array<uint32_t, 1 << cHashBits> m_table{};		// the last position of each hash
+	};
+}
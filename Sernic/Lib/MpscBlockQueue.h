@@ -0,0 +1,261 @@
+#pragma once
+
+#include <cassert>
+#include "Types.h"
+
+
+namespace Lib
+{
+	// Queue of same-size data blocks for many writer threads and one reader thread.
+	// Each block stores L items of type T.
+	//
+	// A writer claims a contiguous run of blocks by advancing the shared write
+	// index, copies its data into the run and then publishes the run with a
+	// single store to the sequence number of the run's first block. The reader
+	// consumes the published runs in the order they were claimed, so a slow
+	// writer holds back the runs claimed after its own until it publishes.
+	//
+	// Runs never wrap around the end of the buffer, so the reader always sees
+	// a run as one contiguous span.
+	//
+	template<typename T, size_t L>
+	class MpscBlockQueue : NonCopyable
+	{
+	public:
+		static constexpr size_t cBlockLength{ L };				// in items of type T
+
+		// Allocates a queue for the given number of blocks (rounded up to a power of two)
+		MpscBlockQueue(const uint numBlocks)
+			: c_numBlocks{ std::bit_ceil(numBlocks) }
+			, c_indexMask{ c_numBlocks - 1 }
+			, c_pBuffer{ new T[c_numBlocks * cBlockLength] }
+			, c_pRuns{ new Run[c_numBlocks] }
+		{
+			Clear();
+		}
+
+		~MpscBlockQueue()
+		{
+			delete[] c_pBuffer;
+			delete[] c_pRuns;
+		}
+
+		uint GetNumBlocks() const { return c_numBlocks; }
+		uint GetNumFreeBlocks() const { return c_numBlocks - GetNumUsedBlocks(); }
+
+		// Can be called from any thread (see BlockQueue::GetNumUsedBlocks)
+		//
+		uint GetNumUsedBlocks() const
+		{
+			uint readIndex{ m_readIndex.load(std::memory_order_acquire) };
+
+			return std::min(m_writeIndex.load(std::memory_order_acquire) - readIndex, c_numBlocks);
+		}
+
+		// --- Writer side (any thread)
+
+		// Pushes a copy of an element at the back of the queue.
+		// Returns true on success, false if the queue is full.
+		//
+		bool Enqueue(const T& element)
+		{
+			uint index;
+
+			if (Claim(1, index) == 0)
+				return false;
+
+			*ToPointer(index) = element;
+			Publish(index, 1);
+
+			return true;
+		}
+
+		// Copies whole blocks from the items span to the back of the queue.
+		// The blocks are published as one run, or as several runs if they wrap
+		// around the end of the buffer or the queue fills up while claiming, and
+		// then blocks from other writers may come between the runs.
+		// Returns the number of blocks copied.
+		//
+		uint EnqueueN(std::span<const T> items)
+		{
+			uint numBlocksTotal{};
+			uint numWanted{ (uint)(items.size() / cBlockLength) };
+
+			while (numWanted > 0)
+			{
+				uint index;
+				uint numBlocks{ Claim(numWanted, index) };
+
+				if (numBlocks == 0)
+					break;
+
+				std::copy_n(items.data(), numBlocks * cBlockLength, ToPointer(index));
+				Publish(index, numBlocks);
+
+				items = items.subspan(numBlocks * cBlockLength);
+				numWanted -= numBlocks;
+				numBlocksTotal += numBlocks;
+			}
+
+			return numBlocksTotal;
+		}
+
+		// --- Reader side (one thread)
+
+		// Returns a pointer to the front of the queue, or nullptr if no block is ready.
+		// The caller must read the data and call Pop.
+		//
+		T* Front()
+		{
+			return FrontN(1).empty() ? nullptr : ToPointer(m_readIndex.load(std::memory_order_relaxed));
+		}
+
+		// Pops the block previously obtained by calling Front
+		//
+		void Pop()
+		{
+			PopN(1);
+		}
+
+		// Returns a contiguous span of up to maxBlocks published blocks from the
+		// front of the queue. Adjacent runs are merged into one span.
+		// The caller must read the data and call PopN.
+		//
+		std::span<T> FrontN(const uint maxBlocks)
+		{
+			auto readIndex{ m_readIndex.load(std::memory_order_relaxed) };
+			auto runIndex{ readIndex + m_numReadyBlocks };
+
+			// Collect published runs while they continue up to the end of the buffer
+
+			while (m_numReadyBlocks == 0 || (m_numReadyBlocks < maxBlocks && (runIndex & c_indexMask) != 0))
+			{
+				const Run& run{ c_pRuns[runIndex & c_indexMask] };
+
+				if (run.sequence.load(std::memory_order_acquire) != runIndex + 1)
+					break;
+
+				m_numReadyBlocks += run.numBlocks;
+				runIndex += run.numBlocks;
+			}
+
+			return { ToPointer(readIndex), std::min(maxBlocks, m_numReadyBlocks) * cBlockLength };
+		}
+
+		// Pops numBlocks blocks previously obtained by calling FrontN
+		//
+		void PopN(const uint numBlocks)
+		{
+			assert(numBlocks <= m_numReadyBlocks);
+
+			m_numReadyBlocks -= numBlocks;
+			m_readIndex.store(m_readIndex.load(std::memory_order_relaxed) + numBlocks, std::memory_order_release);
+		}
+
+		// Pops a copy of an element from the front of the queue.
+		// Returns true on success, false if no block is ready.
+		//
+		bool Dequeue(T* pElement)
+		{
+			if (T* pBlock{ Front() })
+			{
+				*pElement = *pBlock;
+				Pop();
+
+				return true;
+			}
+
+			return false;
+		}
+
+		// Discards all data from the buffer.
+		// Not thread-safe: no other thread may use the queue at the same time.
+		//
+		void Clear()
+		{
+			for (uint i{}; i < c_numBlocks; ++i)
+				c_pRuns[i].sequence.store(0, std::memory_order_relaxed);
+
+			m_writeIndex.store(0, std::memory_order_relaxed);
+			m_cachedReadIndex.store(0, std::memory_order_relaxed);
+			m_readIndex.store(0, std::memory_order_relaxed);
+			m_numReadyBlocks = 0;
+		}
+
+	private:
+		// Publication record of a run of blocks, stored at the run's first block
+		struct Run
+		{
+			std::atomic<uint> sequence;		// index of the run's first block + 1 when published
+			uint numBlocks;
+		};
+
+		T* ToPointer(const uint index) const { return c_pBuffer + (index & c_indexMask) * cBlockLength; }
+
+		// Claims up to numWanted contiguous blocks and sets index to the first one.
+		// Returns the number of blocks claimed (0 if the queue is full).
+		//
+		uint Claim(const uint numWanted, uint& index)
+		{
+			auto writeIndex{ m_writeIndex.load(std::memory_order_relaxed) };
+			uint numBlocks;
+
+			do
+			{
+				uint numFree{ GetNumFree(writeIndex, m_cachedReadIndex.load(std::memory_order_acquire)) };
+
+				if (numFree < numWanted)
+				{
+					// Read the write index again after the read index, so that
+					// it can't be older than the read index
+
+					auto readIndex{ m_readIndex.load(std::memory_order_acquire) };
+					writeIndex = m_writeIndex.load(std::memory_order_relaxed);
+
+					m_cachedReadIndex.store(readIndex, std::memory_order_release);
+					numFree = GetNumFree(writeIndex, readIndex);
+				}
+
+				numBlocks = std::min({ numWanted, numFree, c_numBlocks - (writeIndex & c_indexMask) });
+
+				if (numBlocks == 0)
+					return 0;
+			} while (!m_writeIndex.compare_exchange_weak(writeIndex, writeIndex + numBlocks, std::memory_order_acquire, std::memory_order_relaxed));
+
+			index = writeIndex;
+
+			return numBlocks;
+		}
+
+		// The cached read index may lag behind by more than the queue size
+		// when other writers have moved the write index on since it was read
+		//
+		uint GetNumFree(const uint writeIndex, const uint readIndex) const
+		{
+			uint numUsed{ writeIndex - readIndex };
+
+			return numUsed < c_numBlocks ? c_numBlocks - numUsed : 0;
+		}
+
+		void Publish(const uint index, const uint numBlocks)
+		{
+			Run& run{ c_pRuns[index & c_indexMask] };
+
+			run.numBlocks = numBlocks;
+			run.sequence.store(index + 1, std::memory_order_release);
+		}
+
+		const uint			c_numBlocks;
+		const uint			c_indexMask;
+		T* const			c_pBuffer;
+		Run* const			c_pRuns;
+
+		// Writer section (shared by all writers)
+		alignas(cCacheLineSize) std::atomic<uint> m_writeIndex{};		// index of the next block to be claimed
+		std::atomic<uint>	m_cachedReadIndex{};	// writers' copy of m_readIndex
+
+		// Reader section
+		alignas(cCacheLineSize) std::atomic<uint> m_readIndex{};		// index of the block at the read position
+		uint				m_numReadyBlocks{};		// published blocks from m_readIndex on
+	};
+}
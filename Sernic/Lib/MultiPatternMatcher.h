@@ -0,0 +1,152 @@
+#pragma once
+
+#include <cassert>
+#include "Types.h"
+
+
+namespace Lib
+{
+	// Finds any of a set of byte patterns in a stream (Aho-Corasick).
+	//
+	// The patterns are compiled into a DFA with a transition for every state
+	// and byte value, so scanning takes one table lookup per byte whatever
+	// the number of patterns. A transition into a state where patterns end
+	// has cMatchFlag set, so the scan loop tests no other table.
+	//
+	// The state is kept between the calls to Scan, so a match may straddle
+	// the buffers of the stream. Not thread-safe.
+	//
+	class MultiPatternMatcher : NonCopyable
+	{
+	public:
+		static constexpr uint cMaxPatterns{ 32 };
+
+		// Adds a pattern, before Build is called. Returns false if the
+		// pattern is empty or there are cMaxPatterns patterns already.
+		//
+		bool AddPattern(const std::string_view pattern)
+		{
+			if (pattern.empty() || m_patterns.size() == cMaxPatterns)
+				return false;
+
+			m_patterns.emplace_back(pattern);
+
+			return true;
+		}
+
+		uint GetNumPatterns() const { return (uint)m_patterns.size(); }
+		std::string_view GetPattern(const uint index) const { return m_patterns[index]; }
+		bool IsEmpty() const { return m_patterns.empty(); }
+
+		// Compiles the patterns into the DFA and resets the stream
+		//
+		void Build()
+		{
+			// The trie of the patterns, with 0 for the missing transitions
+
+			m_transitions.assign(cAlphabetSize, 0);
+			m_matches.assign(1, 0);
+
+			for (uint index{}; index < GetNumPatterns(); ++index)
+			{
+				uint state{};
+
+				for (uint8_t byte : m_patterns[index])
+				{
+					auto& next{ m_transitions[state * cAlphabetSize + byte] };
+
+					if (next == 0)
+					{
+						next = (uint)m_matches.size();
+						m_transitions.resize(m_transitions.size() + cAlphabetSize, 0);
+						m_matches.push_back(0);
+					}
+
+					state = m_transitions[state * cAlphabetSize + byte];
+				}
+
+				m_matches[state] |= 1u << index;
+			}
+
+			// Breadth first, so the fallback (the longest proper suffix that is
+			// also in the trie) of a state is complete before the state: each
+			// missing transition is the fallback's transition, and a state
+			// matches what its fallback matches
+
+			std::vector<uint> fallbacks(m_matches.size());
+			std::vector<uint> queue;
+			queue.reserve(m_matches.size());
+
+			for (uint byte{}; byte < cAlphabetSize; ++byte)
+			{
+				if (uint child{ m_transitions[byte] }; child != 0)
+					queue.push_back(child);
+			}
+
+			for (size_t head{}; head < queue.size(); ++head)
+			{
+				uint state{ queue[head] };
+
+				for (uint byte{}; byte < cAlphabetSize; ++byte)
+				{
+					auto& next{ m_transitions[state * cAlphabetSize + byte] };
+					uint fallbackNext{ m_transitions[fallbacks[state] * cAlphabetSize + byte] };
+
+					if (next != 0)
+					{
+						fallbacks[next] = fallbackNext;
+						m_matches[next] |= m_matches[fallbackNext];
+						queue.push_back(next);
+					}
+					else
+						next = fallbackNext;
+				}
+			}
+
+			for (auto& next : m_transitions)
+			{
+				if (m_matches[next] != 0)
+					next |= cMatchFlag;
+			}
+
+			Reset();
+		}
+
+		// Starts a new stream
+		void Reset() { m_state = 0; }
+
+		// Scans the next data of the stream and calls onMatch(patternIndex)
+		// for each pattern that ends in the data
+		//
+		template<typename F>
+		void Scan(const std::span<const uint8_t> data, F onMatch)
+		{
+			assert(!m_transitions.empty());
+
+			const uint* pTransitions{ m_transitions.data() };
+			uint state{ m_state };
+
+			for (uint8_t byte : data)
+			{
+				state = pTransitions[(state & ~cMatchFlag) * cAlphabetSize + byte];
+
+				if (state & cMatchFlag) [[unlikely]]
+				{
+					for (uint matches{ m_matches[state & ~cMatchFlag] }; matches != 0; matches &= matches - 1)
+						onMatch((uint)std::countr_zero(matches));
+				}
+			}
+
+			m_state = state;
+		}
+
+	private:
+		static constexpr uint cAlphabetSize{ 256 };
+		static constexpr uint cMatchFlag{ 0x80000000 };
+
+		std::vector<std::string> m_patterns;
+		std::vector<uint> m_transitions;		// cAlphabetSize per state, state 0 is the root
+		std::vector<uint32_t> m_matches;		// bit mask of the patterns that end in each state
+		uint m_state{};
+	};
+}
@@ -45,6 +45,19 @@ namespace Lib
 			return pElement;
 		}
 
+		size_t GetNumFree() const { return m_pointers.size(); }
+
+		// Returns the index of an item of the pool
+		//
+		size_t GetIndex(const T* pElement) const
+		{
+			assert(pElement >= m_pBuffer && pElement < m_pBuffer + c_capacity);
+
+			return (size_t)(pElement - m_pBuffer);
+		}
+
+		const T* GetItem(size_t index) const { return m_pBuffer + index; }
+
 		// Returns the item previously obtained by Get() to the pool
 		//
 		void Put(T* pElement)
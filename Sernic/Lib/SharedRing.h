@@ -0,0 +1,229 @@
+#pragma once
+
+#include <cassert>
+#include "Types.h"
+
+
+namespace Lib
+{
+	// Control part of a SharedRing, at the start of the shared memory and
+	// followed by the blocks. Each side keeps its index in its own cache line.
+	//
+	struct SharedRingHeader
+	{
+		static constexpr uint32_t cMagic{ 0x676E5253 };		// "SRng"
+
+		uint32_t magic;
+		uint32_t blockSize;			// bytes per block, including the data size field
+		uint32_t numBlocks;			// a power of two
+
+		alignas(cCacheLineSize) std::atomic<uint32_t> writeIndex;
+
+		alignas(cCacheLineSize) std::atomic<uint32_t> readIndex;
+		std::atomic<uint32_t> isReaderWaiting;		// the reader sleeps until the doorbell rings
+	};
+
+	static_assert(std::atomic<uint32_t>::is_always_lock_free, "The indices must work across processes");
+
+
+	// Queue of data blocks in memory shared by two processes, thread-safe
+	// for one writer and one reader (usually in different processes).
+	//
+	// The layout follows BlockQueue: a power-of-two number of same-size
+	// blocks with free-running indices, and each side caches the other
+	// side's index. Each block starts with the size of its data.
+	// The reader gets the data in place, without copying.
+	//
+	// Doorbell: a reader that finds the ring empty calls ArmDoorbell and
+	// goes to sleep (on an event, for example) only if it returns true.
+	// Push returns true when the writer must wake up a sleeping reader.
+	// Every process makes its own SharedRing object for the shared memory.
+	//
+	class SharedRing : NonCopyable
+	{
+	public:
+		static constexpr size_t cBlockHeaderSize{ sizeof(uint32_t) };
+
+		// Returns the size of shared memory needed for a ring
+		//
+		static constexpr size_t GetMemorySize(const uint blockSize, const uint numBlocks)
+		{
+			return sizeof(SharedRingHeader) + (size_t)blockSize * numBlocks;
+		}
+
+		// Sets up a new ring in the memory, which must have GetMemorySize bytes.
+		// The number of blocks must be a power of two.
+		//
+		void Initialize(void* pMemory, const uint blockSize, const uint numBlocks)
+		{
+			assert(std::has_single_bit(numBlocks) && blockSize > cBlockHeaderSize && blockSize % sizeof(uint32_t) == 0);
+
+			auto* pHeader{ new (pMemory) SharedRingHeader{} };
+
+			pHeader->blockSize = blockSize;
+			pHeader->numBlocks = numBlocks;
+			pHeader->magic = SharedRingHeader::cMagic;
+
+			Attach(pMemory, GetMemorySize(blockSize, numBlocks));
+		}
+
+		// Uses a ring set up by Initialize (possibly in another process).
+		// Returns false if the memory doesn't hold a valid ring.
+		//
+		bool Attach(void* pMemory, const size_t memorySize)
+		{
+			auto* pHeader{ (SharedRingHeader*)pMemory };
+
+			if (memorySize < sizeof(SharedRingHeader)
+				|| pHeader->magic != SharedRingHeader::cMagic
+				|| !std::has_single_bit(pHeader->numBlocks)
+				|| pHeader->blockSize <= cBlockHeaderSize
+				|| pHeader->blockSize % sizeof(uint32_t) != 0
+				|| memorySize < GetMemorySize(pHeader->blockSize, pHeader->numBlocks))
+			{
+				return false;
+			}
+
+			m_pHeader = pHeader;
+			m_pBlocks = (uint8_t*)(pHeader + 1);
+			m_blockSize = pHeader->blockSize;
+			m_numBlocks = pHeader->numBlocks;
+			m_indexMask = m_numBlocks - 1;
+			m_cachedReadIndex = pHeader->readIndex.load(std::memory_order_acquire);
+			m_cachedWriteIndex = pHeader->writeIndex.load(std::memory_order_acquire);
+
+			return true;
+		}
+
+		bool IsAttached() const { return !!m_pHeader; }
+		uint GetNumBlocks() const { return m_numBlocks; }
+		size_t GetMaxDataSize() const { return m_blockSize - cBlockHeaderSize; }
+
+		uint GetNumUsedBlocks() const
+		{
+			return m_pHeader->writeIndex.load(std::memory_order_acquire) - m_pHeader->readIndex.load(std::memory_order_acquire);
+		}
+
+		// --- Writer
+
+		// Returns the data space of the back block, or an empty span if the
+		// ring is full. The caller must write the data and call Push.
+		//
+		std::span<uint8_t> Back()
+		{
+			auto writeIndex{ m_pHeader->writeIndex.load(std::memory_order_relaxed) };
+
+			if (writeIndex - m_cachedReadIndex == m_numBlocks)
+			{
+				m_cachedReadIndex = m_pHeader->readIndex.load(std::memory_order_acquire);
+
+				if (writeIndex - m_cachedReadIndex == m_numBlocks)
+					return {};
+			}
+
+			return { GetBlock(writeIndex) + cBlockHeaderSize, GetMaxDataSize() };
+		}
+
+		// Enqueues the block obtained from Back with the given data size,
+		// which must not be 0 (Front returns an empty span for no data).
+		// Returns true if the reader is asleep and has to be woken up.
+		//
+		bool Push(const size_t dataSize)
+		{
+			assert(dataSize > 0 && dataSize <= GetMaxDataSize());
+
+			auto writeIndex{ m_pHeader->writeIndex.load(std::memory_order_relaxed) };
+
+			*(uint32_t*)GetBlock(writeIndex) = (uint32_t)dataSize;
+
+			// Sequentially consistent, paired with ArmDoorbell: either the
+			// reader sees the new block or the writer sees the reader waiting
+
+			m_pHeader->writeIndex.store(writeIndex + 1, std::memory_order_seq_cst);
+
+			return m_pHeader->isReaderWaiting.load(std::memory_order_seq_cst)
+				&& m_pHeader->isReaderWaiting.exchange(0) != 0;
+		}
+
+		// Copies the data into one block. Returns false if the ring is full
+		// or the data doesn't fit in a block. Sets mustRing if the reader
+		// has to be woken up.
+		//
+		bool Write(std::span<const uint8_t> data, bool& mustRing)
+		{
+			mustRing = false;
+
+			if (data.empty())
+				return true;
+
+			auto space{ Back() };
+
+			if (space.empty() || data.size() > space.size())
+				return false;
+
+			std::copy(data.begin(), data.end(), space.begin());
+			mustRing = Push(data.size());
+
+			return true;
+		}
+
+		// --- Reader
+
+		// Returns the data of the front block in place, or an empty span if
+		// the ring is empty. The caller must call Pop when done with the data.
+		//
+		std::span<const uint8_t> Front()
+		{
+			auto readIndex{ m_pHeader->readIndex.load(std::memory_order_relaxed) };
+
+			if (readIndex == m_cachedWriteIndex)
+			{
+				m_cachedWriteIndex = m_pHeader->writeIndex.load(std::memory_order_acquire);
+
+				if (readIndex == m_cachedWriteIndex)
+					return {};
+			}
+
+			const uint8_t* pBlock{ GetBlock(readIndex) };
+
+			// The size comes from the other process, don't trust it
+			size_t dataSize{ std::min((size_t)*(const uint32_t*)pBlock, GetMaxDataSize()) };
+
+			return { pBlock + cBlockHeaderSize, dataSize };
+		}
+
+		// Dequeues the block obtained from Front
+		//
+		void Pop()
+		{
+			auto readIndex{ m_pHeader->readIndex.load(std::memory_order_relaxed) };
+
+			assert(readIndex != m_cachedWriteIndex);
+			m_pHeader->readIndex.store(readIndex + 1, std::memory_order_release);
+		}
+
+		// Tells the writer that the reader is going to sleep.
+		// Returns true if the ring is still empty, so the reader may sleep,
+		// or false if data has arrived in the meantime.
+		//
+		bool ArmDoorbell()
+		{
+			m_pHeader->isReaderWaiting.store(1, std::memory_order_seq_cst);
+
+			m_cachedWriteIndex = m_pHeader->writeIndex.load(std::memory_order_seq_cst);
+
+			return m_pHeader->readIndex.load(std::memory_order_relaxed) == m_cachedWriteIndex;
+		}
+
+	private:
+		uint8_t* GetBlock(const uint index) const { return m_pBlocks + (size_t)(index & m_indexMask) * m_blockSize; }
+
+		SharedRingHeader* m_pHeader{};
+		uint8_t* m_pBlocks{};
+		uint m_blockSize{};
+		uint m_numBlocks{};
+		uint m_indexMask{};
+		uint m_cachedReadIndex{};		// writer's copy of the reader's index
+		uint m_cachedWriteIndex{};		// reader's copy of the writer's index
+	};
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "Types.h"
+
+
+namespace Lib
+{
+	// Counts sizes (of receives, writes...) in power-of-two buckets.
+	// Bucket 0 counts size 0 and bucket n counts the sizes from 2^(n-1)
+	// to 2^n - 1. The last bucket also counts all the larger sizes.
+	// Not thread-safe.
+	//
+	class SizeHistogram
+	{
+	public:
+		static constexpr uint cNumBuckets{ 17 };
+
+		static uint GetBucket(const size_t size) { return std::min((uint)std::bit_width(size), cNumBuckets - 1); }
+		static size_t GetMinSize(const uint bucket) { return bucket > 0 ? (size_t)1 << (bucket - 1) : 0; }
+
+		void Add(const size_t size)
+		{
+			++m_counts[GetBucket(size)];
+			++m_numSamples;
+			m_totalSize += size;
+		}
+
+		void Clear()
+		{
+			m_counts = {};
+			m_numSamples = 0;
+			m_totalSize = 0;
+		}
+
+		uint64_t GetCount(const uint bucket) const { return m_counts[bucket]; }
+		uint64_t GetNumSamples() const { return m_numSamples; }
+		uint64_t GetTotalSize() const { return m_totalSize; }
+
+		// Writes the non-empty buckets as " min-max:count"
+		//
+		void Print(std::ostream& out) const
+		{
+			for (uint bucket{}; bucket < cNumBuckets; ++bucket)
+			{
+				if (m_counts[bucket] == 0)
+					continue;
+
+				out << ' ' << GetMinSize(bucket) << '-';
+
+				if (bucket < cNumBuckets - 1)
+					out << GetMinSize(bucket + 1) - 1;
+
+				out << ':' << m_counts[bucket];
+			}
+		}
+
+	private:
+		std::array<uint64_t, cNumBuckets> m_counts{};
+		uint64_t m_numSamples{};
+		uint64_t m_totalSize{};
+	};
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cassert>
+#include <cstring>
+#include <emmintrin.h>
+#include "Types.h"
+
+
+namespace Lib
+{
+	// Finds a byte pattern in data, 16 positions at a time (SSE2).
+	//
+	// For each block of 16 positions the first and the last byte of the
+	// pattern are compared with the data at once, and only the positions
+	// where both match are compared in full. In text the pair rarely
+	// matches, so most of the data is only looked at by the two compares.
+	//
+	class SubstringSearch
+	{
+	public:
+		static constexpr size_t npos{ std::numeric_limits<size_t>::max() };
+
+		// The pattern must not be empty and must outlive the object
+		//
+		explicit SubstringSearch(const std::span<const uint8_t> pattern)
+			: m_pattern{ pattern }
+		{
+			assert(!pattern.empty());
+		}
+
+		size_t GetPatternSize() const { return m_pattern.size(); }
+
+		// Returns the position of the first match at or after start,
+		// or npos if there is none
+		//
+		size_t Find(const std::span<const uint8_t> data, size_t start = 0) const
+		{
+			const size_t patternSize{ m_pattern.size() };
+
+			if (data.size() < patternSize)
+				return npos;
+
+			const size_t end{ data.size() - patternSize + 1 };		// past the last possible match
+			const uint8_t* pData{ data.data() };
+
+			const __m128i first{ _mm_set1_epi8((char)m_pattern.front()) };
+			const __m128i last{ _mm_set1_epi8((char)m_pattern.back()) };
+
+			for (; start + cBlockSize <= end; start += cBlockSize)
+			{
+				__m128i firstBlock{ _mm_loadu_si128((const __m128i*)(pData + start)) };
+				__m128i lastBlock{ _mm_loadu_si128((const __m128i*)(pData + start + patternSize - 1)) };
+
+				auto mask{ (uint)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, firstBlock), _mm_cmpeq_epi8(last, lastBlock))) };
+
+				for (; mask != 0; mask &= mask - 1)
+				{
+					size_t position{ start + std::countr_zero(mask) };
+
+					if (IsMatch(pData + position))
+						return position;
+				}
+			}
+
+			for (; start < end; ++start)
+			{
+				if (pData[start] == m_pattern.front() && pData[start + patternSize - 1] == m_pattern.back() && IsMatch(pData + start))
+					return start;
+			}
+
+			return npos;
+		}
+
+	private:
+		static constexpr size_t cBlockSize{ sizeof(__m128i) };
+
+		// The first and last bytes have been compared already
+		//
+		bool IsMatch(const uint8_t* pData) const
+		{
+			return m_pattern.size() < 3 || std::memcmp(pData + 1, m_pattern.data() + 1, m_pattern.size() - 2) == 0;
+		}
+
+		std::span<const uint8_t> m_pattern;
+	};
+}
@@ -3,12 +3,17 @@
 #ifndef UNDER_TEST
 import std;
 #endif
+using std::uint64_t;
 using std::uint32_t;
 using std::uint16_t;
 using std::uint8_t;
 using uint = unsigned int;
 using namespace std::literals;
 
+// Size of a cache line, for keeping data written by different threads apart
+//
+constexpr inline size_t cCacheLineSize{ 64 };
+
 // Prevents the object being copied or moved
 //
 struct NonCopyable
@@ -0,0 +1,160 @@
+#include "LocalClient.h"
+#include "Log.h"
+
+
+// The data to be sent is passed to the callback at once, BaseClient's
+// TX queue is not used. The free buffers for Write are taken before the
+// runner's thread uses the pool.
+//
+LocalClient::LocalClient(
+		std::string_view name,
+		BufferPool& bufferPool,
+		DataCallback onData,
+		std::unique_ptr<IFilter> pTxFilter)
+	: BaseClient{ name, bufferPool, 1, std::move(pTxFilter) }
+	, m_onData{ std::move(onData) }
+	, m_rxEvent{ CreateEventA(NULL, TRUE, FALSE, NULL) }		// before Write can be called
+{
+	TakeFreeBuffers();
+}
+
+
+LocalClient::~LocalClient()
+{
+	// The buffers not yet written or not yet sent go back to the pool
+
+	for (auto* pQueue : { &m_freeBuffers, &m_rxQueue })
+	{
+		while (Buffer** ppBuffer{ pQueue->Front() })
+		{
+			m_bufferPool.Unkeep(*ppBuffer);
+			m_bufferPool.PutBuffer(*ppBuffer);
+			pQueue->Pop();
+		}
+	}
+
+	if (m_rxEvent)
+		CloseHandle(m_rxEvent);
+}
+
+
+uint LocalClient::Open(std::span<WSAEVENT> events)
+{
+	if (!m_rxEvent)
+	{
+		LogError() << "Failed to create event for " << m_name;
+		return 0;
+	}
+
+	events[0] = m_rxEvent;
+
+	LogInfo() << m_name << " local channel open";
+
+	return 1;
+}
+
+
+// Takes pool buffers for Write until it has cNumRxBuffers or the pool
+// is empty
+//
+void LocalClient::TakeFreeBuffers()
+{
+	while (m_freeBuffers.GetNumFreeBlocks() > 0)
+	{
+		Buffer* pBuffer{ m_bufferPool.GetBuffer() };
+
+		if (!pBuffer)
+			break;
+
+		m_bufferPool.SetOwner(pBuffer, m_name);
+		m_bufferPool.Keep(pBuffer);		// until it is written
+		m_freeBuffers.Enqueue(pBuffer);
+	}
+}
+
+
+// Copies the data into the free buffers, up to a buffer each, and wakes
+// up the runner. The runner is also woken up when the free buffers have
+// run out, so it takes new ones.
+//
+size_t LocalClient::Write(std::span<const uint8_t> data)
+{
+	size_t numQueued{};
+
+	AcquireSRWLockExclusive(&m_writeLock);
+
+	while (!data.empty() && m_rxQueue.GetNumFreeBlocks() > 0)
+	{
+		Buffer** ppBuffer{ m_freeBuffers.Front() };
+
+		if (!ppBuffer)
+			break;			// the runner doesn't keep up
+
+		Buffer* pBuffer{ *ppBuffer };
+		m_freeBuffers.Pop();
+
+		size_t size{ std::min(data.size(), pBuffer->GetBufferSize()) };
+		std::copy_n(data.begin(), size, pBuffer->GetBufferPtr());
+		pBuffer->SetDataSize(size);
+		m_rxQueue.Enqueue(pBuffer);
+
+		numQueued += size;
+		data = data.subspan(size);
+	}
+
+	ReleaseSRWLockExclusive(&m_writeLock);
+
+	if (numQueued > 0 || !data.empty())
+		SetEvent(m_rxEvent);
+
+	return numQueued;
+}
+
+
+// Hands over one buffer written by the consumer and replaces the buffers
+// Write has used. If the pool is empty, Write queues less data until the
+// pool has recovered.
+// Returns the number of bytes received, or 0 if no data was received.
+//
+int LocalClient::ProcessEvent(const uint index, Buffer** ppRxBuffer)
+{
+	// Reset the event before looking at the queue, so a buffer written
+	// meanwhile sets it again
+
+	ResetEvent(m_rxEvent);
+
+	TakeFreeBuffers();
+
+	Buffer** ppBuffer{ m_rxQueue.Front() };
+
+	if (!ppBuffer)
+		return 0;
+
+	Buffer* pBuffer{ *ppBuffer };
+	m_rxQueue.Pop();
+	m_bufferPool.Unkeep(pBuffer);
+
+	// Come back for the next buffer
+
+	if (m_rxQueue.Front())
+		SetEvent(m_rxEvent);
+
+	*ppRxBuffer = pBuffer;
+
+	return (int)pBuffer->GetDataSize();
+}
+
+
+// Passes the data (filtered if there is a TX filter) to the callback
+// and frees the buffer(s)
+//
+bool LocalClient::Send(const Buffer* pBuffer)
+{
+	FilterTx(pBuffer, [this](const Buffer* pTxBuffer)
+		{
+			m_onData(pTxBuffer->GetData());
+			m_bufferPool.PutBuffer(pTxBuffer);
+		});
+
+	return true;
+}
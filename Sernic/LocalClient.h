@@ -0,0 +1,56 @@
+#pragma once
+
+#include "BaseClient.h"
+
+
+// Channel for a consumer in the same process, for example a test harness
+// that drives gdb itself, instead of a socket.
+//
+// The data received on the serial port is passed to the data callback on
+// the runner's thread, as a view of the pool buffer: no copy is made, and
+// the view is only valid during the call. The consumer sends data to the
+// serial port with Write, from any thread.
+//
+// Write copies the data straight into pool buffers taken for it in advance
+// (by the constructor, then by the runner's thread when it receives the
+// written buffers), because the pool is not thread-safe. The local channel
+// keeps up to cNumRxBuffers pool buffers until it is destroyed.
+//
+class LocalClient : public BaseClient
+{
+public:
+	using DataCallback = std::function<void(std::span<const uint8_t> data)>;
+
+	// The maximum number of buffers written and not yet sent to the serial
+	// port, taken from the pool in advance
+	static constexpr uint cNumRxBuffers{ 8 };
+
+	LocalClient(
+			std::string_view name,
+			BufferPool& bufferPool,
+			DataCallback onData,
+			std::unique_ptr<IFilter> pTxFilter = {});
+	~LocalClient();
+
+	// Queues the data for the serial port. Can be called from any thread.
+	// Returns the number of bytes queued, which is less than the size of
+	// the data if there are no buffers left (the runner doesn't keep up,
+	// or the pool is empty); the caller writes the rest later.
+	size_t Write(std::span<const uint8_t> data);
+
+private:
+	uint Open(std::span<WSAEVENT> events) override;
+	int ProcessEvent(uint index, Buffer** ppRxBuffer) override;
+	bool Send(const Buffer* pBuffer) override;
+
+	void TakeFreeBuffers();
+
+	// The writers take m_writeLock, so each queue has one writer and one
+	// reader thread at a time
+
+	DataCallback m_onData;
+	Lib::BlockQueue<Buffer*, 1> m_freeBuffers{ cNumRxBuffers };		// for Write, from the pool
+	Lib::BlockQueue<Buffer*, 1> m_rxQueue{ cNumRxBuffers };			// written, for ProcessEvent
+	SRWLOCK m_writeLock{ SRWLOCK_INIT };
+	HANDLE m_rxEvent;
+};
@@ -0,0 +1,196 @@
+#include "Log.h"
+
+
+Log& Log::Get()
+{
+	static Log s_log;
+
+	return s_log;
+}
+
+
+Log::Log()
+	: m_wakeEvent{ CreateEventA(NULL, TRUE, FALSE, NULL) }
+{
+}
+
+
+bool Log::Start()
+{
+	if (m_isRunning.load(std::memory_order_relaxed) || !m_wakeEvent)
+		return false;
+
+	m_isStopping.store(false, std::memory_order_relaxed);
+	m_thread = std::thread{ &Log::WriterThread, this };
+	m_isRunning.store(true, std::memory_order_release);
+
+	return true;
+}
+
+
+void Log::Stop()
+{
+	if (!m_isRunning.load(std::memory_order_relaxed))
+		return;
+
+	m_isStopping.store(true, std::memory_order_release);
+	SetEvent(m_wakeEvent);
+	m_thread.join();
+
+	m_isRunning.store(false, std::memory_order_release);
+}
+
+
+// Finds the site's entry in the open-addressed table, or claims a free
+// one. Returns nullptr if the table is full, then the site is not limited.
+//
+Log::Site* Log::FindSite(const std::source_location& location)
+{
+	// The file name is a literal, so its address identifies the file
+
+	uint64_t key{ ((uint64_t)location.line() << 48) ^ (uint64_t)(uintptr_t)location.file_name() };
+
+	for (uint probe{}; probe < cNumSites; ++probe)
+	{
+		Site& site{ m_sites[(key + probe) % cNumSites] };
+		uint64_t siteKey{ site.key.load(std::memory_order_relaxed) };
+
+		if (siteKey == 0 && site.key.compare_exchange_strong(siteKey, key, std::memory_order_relaxed))
+			return &site;
+
+		if (siteKey == key)
+			return &site;
+	}
+
+	return nullptr;
+}
+
+
+bool Log::Admit(const std::source_location& location, uint& numSuppressed)
+{
+	numSuppressed = 0;
+
+	Site* pSite{ FindSite(location) };
+
+	if (!pSite)
+		return true;
+
+	auto now{ Clock::now().time_since_epoch().count() };
+	auto intervalStart{ pSite->intervalStart.load(std::memory_order_relaxed) };
+
+	if (now - intervalStart >= Clock::duration{ cRepeatInterval }.count()
+		&& pSite->intervalStart.compare_exchange_strong(intervalStart, now, std::memory_order_relaxed))
+	{
+		pSite->numMessages.store(0, std::memory_order_relaxed);
+	}
+
+	if (pSite->numMessages.fetch_add(1, std::memory_order_relaxed) >= cMaxRepeats)
+	{
+		pSite->numSuppressed.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	numSuppressed = pSite->numSuppressed.exchange(0, std::memory_order_relaxed);
+
+	return true;
+}
+
+
+void Log::Write(const Record& record)
+{
+	if (!m_isRunning.load(std::memory_order_acquire))
+	{
+		Output(record);
+		return;
+	}
+
+	if (!m_records.Enqueue(record))
+	{
+		m_numDropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	SetEvent(m_wakeEvent);
+}
+
+
+void Log::Output(const Record& record)
+{
+	auto& os{ record.level >= Level::Warning ? std::cerr : std::cout };
+
+	os.write(record.text.data(), record.size);
+	os.put('\n');
+}
+
+
+// Writes the queued records until Stop is called, then writes the rest.
+// The streams are flushed when the ring is empty, not after each line.
+//
+void Log::WriterThread()
+{
+	for (;;)
+	{
+		WaitForSingleObject(m_wakeEvent, INFINITE);
+		ResetEvent(m_wakeEvent);
+
+		// Read the flag before emptying the ring, so no record is left behind
+
+		bool isStopping{ m_isStopping.load(std::memory_order_acquire) };
+
+		while (const Record* pRecord{ m_records.Front() })
+		{
+			Output(*pRecord);
+			m_records.Pop();
+		}
+
+		if (auto numDropped{ m_numDropped.exchange(0, std::memory_order_relaxed) })
+			std::cerr << numDropped << " log messages lost (log ring full)\n";
+
+		std::cout.flush();
+		std::cerr.flush();
+
+		if (isStopping)
+			break;
+	}
+}
+
+
+LogLine::LogLine(const Log::Level level, const std::source_location& location)
+	: m_stream{ GetThreadStream() }
+	, m_isEnabled{ Log::Get().IsEnabled(level) && Log::Get().Admit(location, m_numSuppressed) }
+{
+	m_record.level = level;
+	m_stream.rdbuf(&m_textBuffer);
+}
+
+
+// Queues the message and puts the thread's stream back in its initial state
+//
+LogLine::~LogLine()
+{
+	if (m_isEnabled)
+	{
+		if (m_numSuppressed > 0)
+			m_stream << " (" << m_numSuppressed << " similar messages suppressed)";
+
+		m_record.size = (uint)m_textBuffer.GetSize();
+		Log::Get().Write(m_record);
+	}
+
+	m_stream.rdbuf(nullptr);
+	m_stream.flags(std::ios_base::skipws | std::ios_base::dec);
+	m_stream.precision(6);
+	m_stream.width(0);
+	m_stream.fill(' ');
+}
+
+
+// Constructing a stream may allocate memory (the locale, with some
+// libraries), so a thread makes one for its first message and reuses it
+//
+std::ostream& LogLine::GetThreadStream()
+{
+	thread_local std::ostream s_stream{ nullptr };
+
+	return s_stream;
+}
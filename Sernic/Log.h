@@ -0,0 +1,204 @@
+#pragma once
+
+#include <Windows.h>
+#include "Lib/MpscBlockQueue.h"
+
+
+// Logging that doesn't block the I/O thread.
+//
+// A message is formatted with operator<< into a fixed-size record on the
+// stack (no allocation) and queued into a preallocated ring, from which
+// a background thread writes it to stdout (debug and info) or stderr
+// (warnings and errors). If the ring is full the message is lost and
+// counted. Until the thread is started (see LogWriter) the messages are
+// written at once, which is what the unit tests want.
+//
+// A call site that logs more than cMaxRepeats messages in cRepeatInterval
+// is muted for the rest of the interval, so a failing operation retried
+// in a loop doesn't flood the ring. The next message from the site tells
+// how many were suppressed.
+//
+class Log : NonCopyable
+{
+public:
+	enum class Level
+	{
+		Debug,
+		Info,
+		Warning,
+		Error
+	};
+
+	static constexpr size_t cMaxMessageSize{ 500 };		// longer messages are cut
+	static constexpr uint cNumRecords{ 256 };
+	static constexpr uint cMaxRepeats{ 10 };
+	static constexpr auto cRepeatInterval{ 1s };
+
+	// A formatted message
+	struct Record
+	{
+		Level level;
+		uint size;
+		std::array<char, cMaxMessageSize> text;
+	};
+
+	// The logger of the process
+	static Log& Get();
+
+	// Messages below the level are ignored. The default is Info.
+	void SetLevel(Level level) { m_level.store(level, std::memory_order_relaxed); }
+	bool IsEnabled(Level level) const { return level >= m_level.load(std::memory_order_relaxed); }
+
+	// Starts and stops the writer thread. Stop writes the queued messages first.
+	bool Start();
+	void Stop();
+
+	// Returns false if the call site is muted, otherwise sets numSuppressed
+	// to the number of its messages suppressed since the last one
+	bool Admit(const std::source_location& location, uint& numSuppressed);
+
+	// Queues the record, or writes it if the writer thread is not running.
+	// Can be called from any thread.
+	void Write(const Record& record);
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	// Rate limiting state of a call site. Updated without locks, so the
+	// counts are approximate when several threads log from the same site.
+	struct Site
+	{
+		std::atomic<uint64_t> key;
+		std::atomic<Clock::rep> intervalStart;
+		std::atomic<uint> numMessages;
+		std::atomic<uint> numSuppressed;
+	};
+
+	static constexpr uint cNumSites{ 64 };
+
+	Log();
+
+	Site* FindSite(const std::source_location& location);
+	void WriterThread();
+	static void Output(const Record& record);
+
+	Lib::MpscBlockQueue<Record, 1> m_records{ cNumRecords };
+	std::array<Site, cNumSites> m_sites{};
+	std::atomic<Level> m_level{ Level::Info };
+	std::atomic<bool> m_isRunning{};
+	std::atomic<bool> m_isStopping{};
+	std::atomic<uint64_t> m_numDropped{};
+	HANDLE m_wakeEvent;
+	std::thread m_thread;
+};
+
+
+// Runs the writer thread of the logger while it exists
+//
+class LogWriter : NonCopyable
+{
+public:
+	LogWriter() { Log::Get().Start(); }
+	~LogWriter() { Log::Get().Stop(); }
+};
+
+
+// One message, queued when the object is destroyed at the end of
+// the statement, for example
+//
+//	LogError() << "Failed to open " << m_name;
+//
+// The message is a line, without the new line character. A thread
+// formats one message at a time.
+//
+class LogLine : NonCopyable
+{
+public:
+	LogLine(Log::Level level, const std::source_location& location);
+	~LogLine();
+
+	template<typename T>
+	LogLine& operator<<(const T& value)
+	{
+		if (m_isEnabled)
+			m_stream << value;
+
+		return *this;
+	}
+
+	// For the functions that print to a stream
+	std::ostream& GetStream() { return m_stream; }
+
+private:
+	// Stream buffer over the record's text, which fails when the text is full
+	//
+	class TextBuffer : public std::streambuf
+	{
+	public:
+		explicit TextBuffer(std::span<char> text) { setp(text.data(), text.data() + text.size()); }
+
+		size_t GetSize() const { return pptr() - pbase(); }
+	};
+
+	static std::ostream& GetThreadStream();
+
+	Log::Record m_record;
+	TextBuffer m_textBuffer{ m_record.text };
+	std::ostream& m_stream;			// the thread's stream, writing to m_textBuffer
+	uint m_numSuppressed{};			// before m_isEnabled, whose initializer sets it
+	bool m_isEnabled;
+};
+
+
+inline LogLine LogDebug(const std::source_location& location = std::source_location::current())
+{
+	return LogLine{ Log::Level::Debug, location };
+}
+
+inline LogLine LogInfo(const std::source_location& location = std::source_location::current())
+{
+	return LogLine{ Log::Level::Info, location };
+}
+
+inline LogLine LogWarning(const std::source_location& location = std::source_location::current())
+{
+	return LogLine{ Log::Level::Warning, location };
+}
+
+inline LogLine LogError(const std::source_location& location = std::source_location::current())
+{
+	return LogLine{ Log::Level::Error, location };
+}
+
+
+// The level of a message and the call site, taken where it is converted
+// from the level
+//
+struct LogSite
+{
+	LogSite(const Log::Level level, const std::source_location& location = std::source_location::current())
+		: level{ level }
+		, location{ location }
+	{
+	}
+
+	Log::Level level;
+	std::source_location location;
+};
+
+
+// Logs the values as one message, for example
+//
+//	LogMessage(Log::Level::Error, "Failed to send to ", m_name);
+//
+// This is for coroutine bodies. A LogLine there may be kept in the
+// coroutine frame (the MSVC debug build keeps the temporaries there),
+// where its record alone takes a quarter of an arena slot (see
+// Lib::TaskFrameArena). Here it is on the stack.
+//
+template<typename... Args>
+void LogMessage(const LogSite site, const Args&... args)
+{
+	LogLine line{ site.level, site.location };
+	(line << ... << args);
+}
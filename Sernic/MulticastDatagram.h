@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstring>
+#include "Lib/Types.h"
+
+
+// Datagrams of the multicast channel (option -u): a MulticastHeader followed
+// by the data, the serial data of one or more of Sernic's pool buffers in the
+// order it was received. The data of a pool buffer is never split between
+// datagrams, and a datagram is at most cMaxMulticastDatagramSize bytes, so
+// it is not fragmented on an Ethernet network.
+//
+// UDP doesn't resend what is lost, and a receiver that doesn't keep up
+// loses datagrams as well. Each datagram has the sequence number of the one
+// before it plus one, also when Sernic fails to send one, so a receiver
+// finds the gaps with MulticastSequence. The first datagram Sernic sends
+// has the sequence number 0.
+//
+// Any number of receivers join the group without Sernic knowing about
+// them, and one of them can't slow down the others or the serial port.
+//
+// This header is all a receiver needs.
+//
+
+struct MulticastHeader
+{
+	std::array<char, 4> magic;
+	uint32_t dataSize;			// of the data that follows
+	uint64_t sequence;
+};
+
+static_assert(sizeof(MulticastHeader) == 16);
+
+constexpr inline std::array cMulticastMagic{ 'S', 'N', 'm', '1' };
+constexpr inline size_t cMaxMulticastDatagramSize{ 1472 };		// the UDP payload of a 1500 byte Ethernet frame
+constexpr inline size_t cMaxMulticastDataSize{ cMaxMulticastDatagramSize - sizeof(MulticastHeader) };
+
+
+// Reads the header of a received datagram and gets its data.
+// Returns false if it is not a datagram of the channel.
+//
+inline bool ReadMulticastDatagram(
+		const std::span<const uint8_t> datagram,
+		MulticastHeader& header,
+		std::span<const uint8_t>& data)
+{
+	if (datagram.size() < sizeof(header))
+		return false;
+
+	std::memcpy(&header, datagram.data(), sizeof(header));
+
+	if (header.magic != cMulticastMagic || header.dataSize != datagram.size() - sizeof(header))
+		return false;
+
+	data = datagram.subspan(sizeof(header));
+
+	return true;
+}
+
+
+// Follows the sequence numbers of the received datagrams and counts the
+// lost ones. A datagram that arrives after a later one (the network
+// reordered them) was counted as lost, and it is counted as late as well.
+// Sequence number 0 is a new start of Sernic, the count goes on from it.
+//
+class MulticastSequence
+{
+public:
+	// Adds the sequence number of a received datagram.
+	// Returns the number of datagrams lost just before it, 0 if none.
+	//
+	uint64_t Add(const uint64_t sequence)
+	{
+		if (sequence == 0 && m_numReceived > 0)
+			++m_numRestarts;
+
+		if (sequence < m_next && sequence != 0)
+		{
+			++m_numLate;
+			return 0;
+		}
+
+		// The first datagram received may come in the middle of the stream
+
+		uint64_t numLost{ m_numReceived > 0 && sequence != 0 ? sequence - m_next : 0 };
+
+		m_numLost += numLost;
+		m_next = sequence + 1;
+		++m_numReceived;
+
+		return numLost;
+	}
+
+	uint64_t GetNumReceived() const { return m_numReceived; }
+	uint64_t GetNumLost() const { return m_numLost; }
+	uint64_t GetNumLate() const { return m_numLate; }
+	uint64_t GetNumRestarts() const { return m_numRestarts; }
+
+private:
+	uint64_t m_next{};				// the expected sequence number
+	uint64_t m_numReceived{};		// not counting the late ones
+	uint64_t m_numLost{};
+	uint64_t m_numLate{};
+	uint64_t m_numRestarts{};
+};
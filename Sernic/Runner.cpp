@@ -1,205 +1,472 @@
 #include "Runner.h"
+#include "BaseClient.h"
+#include "Log.h"
+#include "Lib/AllocationAudit.h"
 
 
 Runner::Runner(
 		IClient& serialClient,
 		IClient* pConsoleClient,
 		IClient* pGdbClient,
-		IClient* pRawClient)
+		IClient* pRawClient,
+		IClient* pShmClient)
 	: m_serialClient{ serialClient }
 	, m_pConsoleClient{ pConsoleClient  }
 	, m_pGdbClient{ pGdbClient }
 	, m_pRawClient{ pRawClient }
+	, m_pShmClient{ pShmClient }
 {
 }
 
 
+void Runner::SetTriggers(
+		Lib::MultiPatternMatcher& matcher,
+		const TriggerActions& actions,
+		BufferPool& bufferPool,
+		TriggerCallback onTrigger)
+{
+	m_pTriggerMatcher = &matcher;
+	m_triggerActions = actions;
+	m_pBufferPool = &bufferPool;
+	m_onTrigger = std::move(onTrigger);
+}
+
+
+void Runner::SetBusyPoll(const int core, const std::chrono::microseconds spinBudget)
+{
+	constexpr int cMaxCores{ (int)(sizeof(DWORD_PTR) * 8) };
+
+	m_pollCore = core;
+
+	if (core != cNoCore && (core < 0 || core >= cMaxCores))
+	{
+		LogWarning() << "Core " << core << " can't be pinned (0-" << cMaxCores - 1 << "), the event loop is not pinned";
+		m_pollCore = cNoCore;
+	}
+
+	m_spinBudget = spinBudget;
+}
+
+
 void Runner::Run()
 {
 	WSADATA wsaData;
 
 	if (WSAStartup(0x0202, &wsaData))
 	{
-		std::cerr << "WSAStartup failed\n";
+		LogError() << "WSAStartup failed";
 		return;
 	}
 
-	WSAEVENT events[WSA_MAXIMUM_WAIT_EVENTS]{};
-	std::span<WSAEVENT> dstEvents{ events };
-	uint firstConsoleEventIndex{};
-	uint firstGdbEventIndex{};
-	uint firstRawEventIndex{};
-	uint firstSerialEventIndex{};
-	DWORD numEvents{};
-	int numTelnetClients{};
+	if (m_pollCore != cNoCore && !SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << m_pollCore))
+		LogWarning() << "Failed to pin the event loop to core " << m_pollCore;
+
+	// In the audit build, count the allocations of the event loop's thread:
+	// opening the clients may allocate, forwarding must not
+
+	Lib::AllocationAudit allocationAudit;
+
+	m_numEvents = 0;
+	m_firstEvent = 0;
+	m_numChannels = 0;
 
 	m_cancelEvent = WSACreateEvent();
 	bool isOk{ m_cancelEvent != WSA_INVALID_EVENT };
 
 	if (isOk)
 	{
-		dstEvents[numEvents++] = m_cancelEvent;
-		dstEvents = dstEvents.subspan(numEvents);
+		m_events[m_numEvents] = m_cancelEvent;
+		m_handlers[m_numEvents++] = {};
 	}
 	else
-		std::cerr << "Failed to create WSA event\n";
+		LogError() << "Failed to create WSA event";
 
-	if (isOk && m_pConsoleClient)
-	{
-		++numTelnetClients;
-		firstConsoleEventIndex = numEvents;
-		auto eventCount = m_pConsoleClient->Open(dstEvents);
+	// Data received from any of the channels is forwarded to serial port,
+	// data received on serial port is forwarded to all the channels.
+
+	isOk = isOk
+		&& AddClient(m_pConsoleClient, &Runner::OnChannelData, TxSource::Console)
+		&& AddClient(m_pGdbClient, &Runner::OnChannelData, TxSource::Gdb)
+		&& AddClient(m_pRawClient, &Runner::OnChannelData, TxSource::Raw)
+		&& AddClient(m_pShmClient, &Runner::OnChannelData, TxSource::Shm)
+		&& AddClient(m_pCaptureClient, &Runner::OnChannelData)		// receives nothing
+		&& AddClient(m_pMulticastClient, &Runner::OnChannelData)	// receives nothing
+		&& AddClient(&m_serialClient, &Runner::OnSerialData);
+
+	m_numChannels = !!m_pConsoleClient + !!m_pGdbClient + !!m_pRawClient + !!m_pShmClient + !!m_pMulticastClient;
+
+	bool running{ isOk };
+	[[maybe_unused]] auto numStartupAllocations{ allocationAudit.NextPhase() };
 
-		isOk = eventCount > 0;
+#ifdef TRACE_BUFFERS
+	auto nextBufferTrace{ std::chrono::steady_clock::now() + cBufferTraceInterval };
+#endif
 
-		if (isOk)
+	while (running)
+	{
+		auto result{ WaitForEvents() };
+
+		if (result == WSA_WAIT_FAILED)
 		{
-			numEvents += eventCount;
-			dstEvents = dstEvents.subspan(eventCount);
+			LogError() << "WSAWaitForMultipleEvents failed";
+			running = false;
 		}
-	}
+		else if (result != WSA_WAIT_TIMEOUT)
+		{
+			// The wait only reports the lowest signaled event, so handle every
+			// event that is ready now. The scan starts from a different event
+			// after each wake-up, so that no client always goes first.
 
-	if (isOk && m_pGdbClient)
-	{
-		++numTelnetClients;
-		firstGdbEventIndex = numEvents;
-		auto eventCount = m_pGdbClient->Open(dstEvents);
+			running = DispatchReadyEvents(m_firstEvent, m_numEvents) && DispatchReadyEvents(0, m_firstEvent);
 
-		isOk = eventCount > 0;
+			if (++m_firstEvent == m_numEvents)
+				m_firstEvent = 0;
+		}
 
-		if (isOk)
+#ifdef TRACE_BUFFERS
+		if (m_pBufferPool && std::chrono::steady_clock::now() >= nextBufferTrace)
 		{
-			numEvents += eventCount;
-			dstEvents = dstEvents.subspan(eventCount);
+			ReportHeldBuffers();
+			nextBufferTrace = std::chrono::steady_clock::now() + cBufferTraceInterval;
 		}
+#endif
 	}
 
-	if (isOk && m_pRawClient)
-	{
-		++numTelnetClients;
-		firstRawEventIndex = numEvents;
-		auto eventCount = m_pRawClient->Open(dstEvents);
+	if (m_spinBudget > 0us)
+		LogInfo() << "Busy poll: " << m_numPolledWakeUps << " wake-ups while polling, " << m_numBlockingWakeUps << " while blocked";
+
+#ifdef AUDIT_ALLOCATIONS
+	LogInfo() << "Allocations on the event loop thread: " << numStartupAllocations << " opening the clients, "
+			<< allocationAudit.GetCount() << " forwarding";
+#endif
 
-		isOk = eventCount > 0;
+	WSACloseEvent(m_cancelEvent);
+	m_cancelEvent = WSA_INVALID_EVENT;
+
+	WSACleanup();
+}
 
-		if (isOk)
+
+void Runner::Close()
+{
+	WSASetEvent(m_cancelEvent);
+	LogInfo() << "Closing...";
+}
+
+
+// Logs the buffers held for too long, a leak or a client that is stuck.
+// The buffers kept on purpose (pending reads, the scrollback) are left out.
+//
+void Runner::ReportHeldBuffers()
+{
+#ifdef TRACE_BUFFERS
+	uint numHeld{};
+
+	m_pBufferPool->ForEachHeldBuffer(cBufferHoldThreshold, [&](const Buffer* pBuffer, const std::chrono::milliseconds held)
+		{
+			if (numHeld++ < cMaxReportedBuffers)
+			{
+				LogLine line{ LogWarning() };
+				line << "Buffer held for " << held.count() / 1000 << " s: ";
+				m_pBufferPool->PrintTrace(line.GetStream(), pBuffer);
+			}
+		});
+
+	if (numHeld > cMaxReportedBuffers)
+		LogWarning() << numHeld << " buffers held for more than " << cBufferHoldThreshold.count() << " s";
+#endif
+}
+
+
+// Waits for any event. In busy-poll mode the events are polled first, for
+// m_spinBudget from the end of the previous wait's handling.
+// Returns the result of WSAWaitForMultipleEvents.
+//
+DWORD Runner::WaitForEvents()
+{
+	if (m_spinBudget > 0us)
+	{
+		auto spinEnd{ std::chrono::steady_clock::now() + m_spinBudget };
+
+		do
 		{
-			numEvents += eventCount;
-			dstEvents = dstEvents.subspan(eventCount);
+			DWORD result{ WSAWaitForMultipleEvents(m_numEvents, m_events.data(), FALSE, 0, FALSE) };
+
+			if (result != WSA_WAIT_TIMEOUT)
+			{
+				++m_numPolledWakeUps;
+				return result;
+			}
+
+			YieldProcessor();
 		}
+		while (std::chrono::steady_clock::now() < spinEnd);
 	}
 
-	if (isOk)
+	DWORD result
 	{
-		firstSerialEventIndex = numEvents;
-		auto eventCount = m_serialClient.Open(dstEvents);
+		WSAWaitForMultipleEvents(
+				m_numEvents,
+				m_events.data(),
+				FALSE,		// wait for any event set
+				1000,		// timeout in ms
+				FALSE)		// not alertable
+	};
+
+	if (result != WSA_WAIT_TIMEOUT)
+		++m_numBlockingWakeUps;
+
+	return result;
+}
 
-		isOk = eventCount > 0;
 
-		if (isOk)
-			numEvents += eventCount;
+// Opens the client (if present) and adds its events to the dispatch table.
+// Returns false on error.
+//
+bool Runner::AddClient(IClient* pClient, DataHandler onData, const TxSource source)
+{
+	if (!pClient)
+		return true;
+
+	auto eventCount{ pClient->Open(std::span{ m_events }.subspan(m_numEvents)) };
+	BaseClient* pCoroutineClient{ pClient->GetCoroutineClient() };
+
+	for (uint index{}; index < eventCount; ++index)
+	{
+		m_handlers[m_numEvents++] = {
+				pClient,
+				index,
+				onData,
+				source,
+				pCoroutineClient,
+				pCoroutineClient ? pCoroutineClient->GetWaiterSlot(index) : nullptr };
 	}
 
-	bool running{ isOk };
+	return eventCount > 0;
+}
 
-	while (running)
+
+// Dispatches all the signaled events with indices in [firstIndex, endIndex).
+// Returns false if the runner has to stop.
+//
+bool Runner::DispatchReadyEvents(uint firstIndex, const uint endIndex)
+{
+	while (firstIndex < endIndex)
 	{
 		auto result
 		{
 			WSAWaitForMultipleEvents(
-					numEvents,
-					events,
+					endIndex - firstIndex,
+					&m_events[firstIndex],
 					FALSE,		// wait for any event set
-					1000,		// timeout in ms
+					0,			// don't wait
 					FALSE)		// not alertable
 		};
 
-		if (result != WSA_WAIT_TIMEOUT)
+		if (result == WSA_WAIT_TIMEOUT)
+			break;				// no more events ready in this range
+
+		if (result == WSA_WAIT_FAILED)
 		{
-			auto index{ result - WSA_WAIT_EVENT_0 };
+			LogError() << "WSAWaitForMultipleEvents failed";
+			return false;
+		}
 
-			if (index == 0)
-				running = false;
-			else if (index >= firstSerialEventIndex)
-			{
-				// If data was received on serial port forward it to all the remaining ports
+		firstIndex += result - WSA_WAIT_EVENT_0;
 
-				Buffer* pBuffer{};
-				auto bytesReceived{ m_serialClient.ProcessEvent(index - firstSerialEventIndex, &pBuffer) };
+		if (!DispatchEvent(firstIndex++))
+			return false;
+	}
 
-				if (bytesReceived > 0)
-				{
-					pBuffer->SetRefCount(numTelnetClients);
+	return true;
+}
 
-					if (m_pGdbClient && !m_pGdbClient->Send(pBuffer))
-						running = false;
 
-					if (m_pConsoleClient && !m_pConsoleClient->Send(pBuffer))
-						running = false;
+// Processes the indexed event and passes any received data to the handler.
+// The loop of a coroutine client that waits for the event is resumed
+// directly, the other events go through ProcessEvent.
+// Returns false if the runner has to stop.
+//
+bool Runner::DispatchEvent(const uint index)
+{
+	const EventHandler& handler{ m_handlers[index] };
 
-					if (m_pRawClient && !m_pRawClient->Send(pBuffer))
-						running = false;
-				}
-				else if (bytesReceived < 0)
-					running = false;
-			}
-			else if (m_pRawClient && index >= firstRawEventIndex)
-			{
-				// If data was received from raw console forward the data to serial port
-
-				Buffer* pBuffer{};
-				auto bytesReceived{ m_pRawClient->ProcessEvent(index - firstRawEventIndex, &pBuffer) };
-
-				if (bytesReceived > 0)
-				{
-					if (!m_serialClient.Send(pBuffer))
-						running = false;
-				}
-				else if (bytesReceived < 0)
-					running = false;
-			}
-			else if (m_pGdbClient && index >= firstGdbEventIndex)
-			{
-				// If data was received from gdb forward the data to serial port
-
-				Buffer* pBuffer{};
-				auto bytesReceived{ m_pGdbClient->ProcessEvent(index - firstGdbEventIndex, &pBuffer) };
-
-				if (bytesReceived > 0)
-				{
-					if (!m_serialClient.Send(pBuffer))
-						running = false;
-				}
-				else if (bytesReceived < 0)
-					running = false;
-			}
-			else if (m_pConsoleClient && index >= firstConsoleEventIndex)
-			{
-				// If data was received from console forward the data to serial port
-
-				Buffer* pBuffer{};
-				auto bytesReceived{ m_pConsoleClient->ProcessEvent(index - firstConsoleEventIndex, &pBuffer) };
-
-				if (bytesReceived > 0)
-				{
-					if (!m_serialClient.Send(pBuffer))
-						running = false;
-				}
-				else if (bytesReceived < 0)
-					running = false;
-			}
-		}
+	if (!handler.pClient)
+		return false;			// cancel event
+
+	Buffer* pBuffer{};
+	int bytesReceived;
+
+	if (handler.pWaiter && *handler.pWaiter)
+		bytesReceived = handler.pCoroutineClient->ResumeWaiter(*handler.pWaiter, &pBuffer);
+	else
+		bytesReceived = handler.pClient->ProcessEvent(handler.clientEventIndex, &pBuffer);
+
+	if (bytesReceived > 0)
+		return (this->*handler.onData)(pBuffer, handler.source);
+
+	return bytesReceived == 0;
+}
+
+
+// Forwards the data received on serial port to all the channels.
+// The data is scanned for the trigger patterns before it is sent, because
+// the clients may release the buffer, and the actions are taken after it
+// is sent, so the console gets the data that caused a pause.
+//
+bool Runner::OnSerialData(Buffer* pBuffer, TxSource)
+{
+	uint32_t triggerMask{};
+
+	if (m_pTriggerMatcher)
+		m_pTriggerMatcher->Scan(pBuffer->GetData(), [&](const uint index) { triggerMask |= 1u << index; });
+
+	IClient* pConsoleClient{ m_isConsolePaused ? nullptr : m_pConsoleClient };
+	int numReceivers{ m_numChannels - (pConsoleClient != m_pConsoleClient) + !!m_pCaptureClient };
+
+	if (numReceivers == 0 && m_isConsolePaused)
+	{
+		pBuffer->SetRefCount(1);
+		m_pBufferPool->PutBuffer(pBuffer);		// the paused console is the only channel
 	}
+	else
+		pBuffer->SetRefCount(numReceivers);
 
-	WSACloseEvent(m_cancelEvent);
-	m_cancelEvent = WSA_INVALID_EVENT;
+	bool isOk{ true };
 
-	WSACleanup();
+	if (m_pCaptureClient && !m_pCaptureClient->Send(pBuffer))
+		isOk = false;
+
+	if (m_pGdbClient && !m_pGdbClient->Send(pBuffer))
+		isOk = false;
+
+	if (pConsoleClient && !pConsoleClient->Send(pBuffer))
+		isOk = false;
+
+	if (m_pRawClient && !m_pRawClient->Send(pBuffer))
+		isOk = false;
+
+	if (m_pShmClient && !m_pShmClient->Send(pBuffer))
+		isOk = false;
+
+	if (m_pMulticastClient && !m_pMulticastClient->Send(pBuffer))
+		isOk = false;
+
+	if (triggerMask != 0)
+		OnTrigger(triggerMask);
+
+	return isOk;
 }
 
 
-void Runner::Close()
+// Forwards the data received from a channel to serial port (and to the
+// capture client). The serial client sends the data of each channel by priority.
+// Data from the console resumes the console after a trigger paused it.
+// The serial client gets its reference of the buffer even if the capture fails.
+//
+bool Runner::OnChannelData(Buffer* pBuffer, const TxSource source)
 {
-	WSASetEvent(m_cancelEvent);
-	std::cout << "Closing...\n";
+	if (source == TxSource::Console && m_isConsolePaused)
+	{
+		m_isConsolePaused = false;
+		LogInfo() << "Console resumed";
+	}
+
+	bool isCaptured{ true };
+
+	if (m_pCaptureClient)
+	{
+		pBuffer->SetRefCount(2);		// the channel's buffer goes to both
+		isCaptured = m_pCaptureClient->SendFrom(pBuffer, source);
+	}
+
+	return m_serialClient.SendFrom(pBuffer, source) && isCaptured;
+}
+
+
+// Takes the trigger actions for the patterns found in one buffer of
+// serial data
+//
+void Runner::OnTrigger(const uint32_t patternMask)
+{
+	std::array<std::string_view, 2 * Lib::MultiPatternMatcher::cMaxPatterns + 3> texts{};
+	uint numTexts{};
+
+	texts[numTexts++] = "\r\n*** Sernic trigger: "sv;
+
+	for (uint matches{ patternMask }; matches != 0; matches &= matches - 1)
+	{
+		auto pattern{ m_pTriggerMatcher->GetPattern((uint)std::countr_zero(matches)) };
+
+		LogWarning() << "Trigger: \"" << pattern << "\" in the serial data";
+
+		if (m_onTrigger)
+			m_onTrigger(pattern);
+
+		if (numTexts > 1)
+			texts[numTexts++] = ", "sv;
+
+		texts[numTexts++] = pattern;
+	}
+
+	if (m_triggerActions.freezeScrollback)
+	{
+		if (m_pConsoleClient)
+			m_pConsoleClient->FreezeScrollback();
+
+		if (m_pRawClient)
+			m_pRawClient->FreezeScrollback();
+	}
+
+	if (m_triggerActions.pauseConsole && m_pConsoleClient && !m_isConsolePaused)
+	{
+		m_isConsolePaused = true;
+		texts[numTexts++] = " (console paused, type to resume)"sv;
+		LogInfo() << "Console paused";
+	}
+
+	texts[numTexts++] = " ***\r\n"sv;
+
+	if (m_triggerActions.notifyChannels)
+	{
+		std::array clients{ m_pConsoleClient, m_pRawClient };
+		SendNotice(clients, std::span{ texts }.first(numTexts));
+	}
+}
+
+
+// Sends the concatenated texts to the clients (those that are not null)
+// in one buffer, truncated to the buffer size
+//
+void Runner::SendNotice(const std::span<IClient* const> clients, const std::span<const std::string_view> texts)
+{
+	auto numReceivers{ (int)std::ranges::count_if(clients, [](const IClient* pClient) { return pClient != nullptr; }) };
+
+	if (numReceivers == 0)
+		return;
+
+	Buffer* pBuffer{ m_pBufferPool->GetBuffer() };
+
+	if (!pBuffer)
+	{
+		LogWarning() << "No buffer for the trigger notice";
+		return;
+	}
+
+	size_t size{};
+
+	for (auto text : texts)
+	{
+		auto free{ pBuffer->GetBuffer().subspan(size) };
+		size += std::ranges::copy(text.substr(0, free.size()), free.begin()).out - free.begin();
+	}
+
+	pBuffer->SetDataSize(size);
+	pBuffer->SetRefCount(numReceivers);
+
+	for (IClient* pClient : clients)
+	{
+		if (pClient)
+			pClient->Send(pBuffer);
+	}
 }
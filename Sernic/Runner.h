@@ -1,6 +1,7 @@
 #pragma once
 
 #include "IClient.h"
+#include "Lib/MultiPatternMatcher.h"
 
 
 class Runner : NonCopyable
@@ -10,16 +11,112 @@ public:
 			IClient& serialClient,
 			IClient* pConsoleClient,
 			IClient* pGdbClient,
-			IClient* pRawClient);
+			IClient* pRawClient,
+			IClient* pShmClient);
+
+	// What is done when a trigger pattern is found in the serial data
+	struct TriggerActions
+	{
+		bool freezeScrollback;		// keep the data around the match for the next console and raw client
+		bool pauseConsole;			// stop sending serial data to the console until it sends data
+		bool notifyChannels;		// send a notice to the console and raw channels
+	};
+
+	// Called with each pattern found, on the thread of Run
+	using TriggerCallback = std::function<void(std::string_view pattern)>;
+
+	// Scans the serial data with the matcher (which must be built) and takes
+	// the actions when a pattern is found. Must be called before Run.
+	//
+	void SetTriggers(
+			Lib::MultiPatternMatcher& matcher,
+			const TriggerActions& actions,
+			BufferPool& bufferPool,
+			TriggerCallback onTrigger = {});
+
+	// The capture client gets the data received from the serial port with
+	// Send and the data the channels send to it with SendFrom. Must be
+	// called before Run.
+	//
+	void SetCapture(IClient* pCaptureClient) { m_pCaptureClient = pCaptureClient; }
+
+	// The multicast client gets the data received from the serial port,
+	// like the other channels, but sends nothing to it. Must be called
+	// before Run.
+	//
+	void SetMulticast(IClient* pMulticastClient) { m_pMulticastClient = pMulticastClient; }
+
+	// In the builds with TRACE_BUFFERS (see ByteBufferPool.h), reports the
+	// buffers of the pool held for longer than cBufferHoldThreshold, every
+	// cBufferTraceInterval. Must be called before Run.
+	//
+	void TraceBuffers(BufferPool& bufferPool) { m_pBufferPool = &bufferPool; }
+
+	// Busy-poll mode, for the lowest latency: after handling the events
+	// the thread of Run polls them for spinBudget before it blocks, so
+	// a burst of data that arrives meanwhile is handled without waking the
+	// thread up. The thread is pinned to the core, unless it is cNoCore.
+	// A core that an affinity mask can't hold is reported and not pinned.
+	// Must be called before Run.
+	//
+	void SetBusyPoll(int core, std::chrono::microseconds spinBudget);
+
+	static constexpr int cNoCore{ -1 };
 
 	void Run();
 	void Close();
 
 private:
+	// Handles data received by a client, returns false on error
+	using DataHandler = bool (Runner::*)(Buffer* pBuffer, TxSource source);
+
+	// Dispatch table entry, one for each event
+	struct EventHandler
+	{
+		IClient* pClient;			// nullptr for the cancel event
+		uint clientEventIndex;		// index of the event among the client's events
+		DataHandler onData;
+		TxSource source;			// the client as a source of serial data
+		BaseClient* pCoroutineClient;			// the client if it is written as coroutines
+		std::coroutine_handle<>* pWaiter;		// its loop waiting for the event
+	};
+
+	bool AddClient(IClient* pClient, DataHandler onData, TxSource source = {});
+	DWORD WaitForEvents();
+	bool DispatchReadyEvents(uint firstIndex, uint endIndex);
+	bool DispatchEvent(uint index);
+	bool OnSerialData(Buffer* pBuffer, TxSource source);
+	bool OnChannelData(Buffer* pBuffer, TxSource source);
+	void OnTrigger(uint32_t patternMask);
+	void SendNotice(std::span<IClient* const> clients, std::span<const std::string_view> texts);
+	void ReportHeldBuffers();
+
+	static constexpr auto cBufferTraceInterval{ 10s };
+	static constexpr auto cBufferHoldThreshold{ 10s };
+	static constexpr uint cMaxReportedBuffers{ 8 };		// at a time, Log mutes a site that logs more
+
 	IClient& m_serialClient;
 	IClient* m_pConsoleClient;
 	IClient* m_pGdbClient;
 	IClient* m_pRawClient;
+	IClient* m_pShmClient;
+	IClient* m_pCaptureClient{};
+	IClient* m_pMulticastClient{};
 	WSAEVENT m_cancelEvent{ WSA_INVALID_EVENT };
-};
 
+	std::array<WSAEVENT, WSA_MAXIMUM_WAIT_EVENTS> m_events{};
+	std::array<EventHandler, WSA_MAXIMUM_WAIT_EVENTS> m_handlers{};
+	uint m_numEvents{};
+	uint m_firstEvent{};			// the event checked first after a wake-up
+	int m_pollCore{ cNoCore };
+	std::chrono::microseconds m_spinBudget{};		// 0 when not busy-polling
+	uint64_t m_numPolledWakeUps{};
+	uint64_t m_numBlockingWakeUps{};
+	int m_numChannels{};
+
+	Lib::MultiPatternMatcher* m_pTriggerMatcher{};
+	TriggerActions m_triggerActions{};
+	BufferPool* m_pBufferPool{};
+	TriggerCallback m_onTrigger;
+	bool m_isConsolePaused{};
+};
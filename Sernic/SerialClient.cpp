@@ -1,6 +1,7 @@
 #include "SerialClient.h"
 #include <cassert>
 #include "IFilter.h"
+#include "Log.h"
 
 
 namespace
@@ -9,6 +10,11 @@ namespace
 	{
 		Send,
 		Receive,
+		ResumeTimer,
+		CommEvent,
+		MetricsTimer,
+		HoldTimer,
+		ProbeTimer,
 		_NumEvents
 	};
 
@@ -16,9 +22,21 @@ namespace
 }
 
 
-SerialClient::SerialClient(std::string_view name, uint baudrate, BufferPool& bufferPool)
-	: BaseClient{ name, bufferPool, cNumTxBuffers, {} }
+// The data to be sent is queued per source in m_txScheduler, BaseClient's
+// TX queue is not used
+//
+SerialClient::SerialClient(
+		std::string_view name,
+		uint baudrate,
+		FlowControl flowControl,
+		uint numReads,
+		uint gdbTxWeight,
+		BufferPool& bufferPool)
+	: BaseClient{ name, bufferPool, 1, {} }
 	, m_baudrate{ baudrate }
+	, m_flowControl{ flowControl }
+	, m_numReads{ std::clamp(numReads, 1u, cMaxReads) }
+	, m_txScheduler{ cNumTxBuffers, gdbTxWeight }
 {
 }
 
@@ -26,18 +44,36 @@ SerialClient::SerialClient(std::string_view name, uint baudrate, BufferPool& buf
 SerialClient::~SerialClient()
 {
 	Cleanup();
+
+	m_txScheduler.PrintStats(m_name);
+
+	if (m_numPauses > 0)
+		LogInfo() << m_name << " receiving paused " << m_numPauses << " times (buffer pool low)";
+
+	if (m_numErrorIntervals > 0)
+		LogInfo() << m_name << " had line errors in " << m_numErrorIntervals << " intervals";
+
+	if (m_numReconnects > 0)
+	{
+		LogInfo() << m_name << " reconnected " << m_numReconnects << " times, the longest after " << m_maxReconnectTime.count()
+				<< " ms; " << m_numLostTxBuffers << " buffers from the channels lost meanwhile";
+	}
+}
+
+
+void SerialClient::SetMetricsInterval(const std::chrono::seconds interval)
+{
+	m_metricsInterval = interval;
+	m_isMetricsReported = true;
 }
 
 
 void SerialClient::Cleanup()
 {
 	if (m_handle != INVALID_HANDLE_VALUE)
-	{
 		CancelIo(m_handle);
-		CloseHandle(m_handle);
 
-		m_handle = INVALID_HANDLE_VALUE;
-	}
+	ClosePort();
 
 	if (m_ovSend.hEvent)
 	{
@@ -45,15 +81,111 @@ void SerialClient::Cleanup()
 		m_ovSend.hEvent = NULL;
 	}
 
-	if (m_ovReceive.hEvent)
+	if (m_receiveEvent)
+	{
+		CloseHandle(m_receiveEvent);
+		m_receiveEvent = NULL;
+	}
+
+	if (m_ovCommEvent.hEvent)
 	{
-		CloseHandle(m_ovReceive.hEvent);
-		m_ovReceive.hEvent = NULL;
+		CloseHandle(m_ovCommEvent.hEvent);
+		m_ovCommEvent.hEvent = NULL;
 	}
+
+	m_resumeTimer.Close();
+	m_metricsTimer.Close();
+	m_holdTimer.Close();
+	m_probeTimer.Close();
+}
+
+
+// Sets the flow control fields of the DCB. With flow control on, the driver
+// pauses the target when its receive buffer fills up, which happens when
+// the receive loop pauses because the channels don't take the data.
+//
+void SerialClient::SetFlowControl(DCB& dcb) const
+{
+	if (m_flowControl == FlowControl::Default)
+		return;
+
+	dcb.fOutxCtsFlow = m_flowControl == FlowControl::Hardware;
+	dcb.fOutxDsrFlow = FALSE;
+	dcb.fDsrSensitivity = FALSE;
+	dcb.fRtsControl = m_flowControl == FlowControl::Hardware ? RTS_CONTROL_HANDSHAKE : RTS_CONTROL_ENABLE;
+	dcb.fDtrControl = DTR_CONTROL_ENABLE;
+
+	dcb.fOutX = m_flowControl == FlowControl::Software;
+	dcb.fInX = m_flowControl == FlowControl::Software;
+	dcb.fTXContinueOnXoff = TRUE;
+	dcb.XonChar = 0x11;		// DC1
+	dcb.XoffChar = 0x13;	// DC3
+
+	// The target is paused when the buffer is 3/4 full
+	// and continues when it is down to 1/4
+
+	dcb.XoffLim = cDriverRxBufferSize / 4;
+	dcb.XonLim = cDriverRxBufferSize / 4;
 }
 
 
 uint SerialClient::Open(std::span<WSAEVENT> events)
+{
+	// The events and timers are kept when the port is reopened
+
+	m_ovSend.hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+	events[(int)EventType::Send] = m_ovSend.hEvent;
+
+	m_receiveEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+	events[(int)EventType::Receive] = m_receiveEvent;
+
+	for (auto& ov : m_ovReceive)
+		ov.hEvent = m_receiveEvent;
+
+	m_ovCommEvent.hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+	events[(int)EventType::CommEvent] = m_ovCommEvent.hEvent;
+
+	if (!m_resumeTimer.Create() || !m_metricsTimer.Create() || !m_holdTimer.Create() || !m_probeTimer.Create())
+	{
+		LogError() << "Failed to create timer for " << m_name;
+		return 0;
+	}
+
+	events[(int)EventType::ResumeTimer] = m_resumeTimer.GetEvent();
+	events[(int)EventType::MetricsTimer] = m_metricsTimer.GetEvent();
+	events[(int)EventType::HoldTimer] = m_holdTimer.GetEvent();
+	events[(int)EventType::ProbeTimer] = m_probeTimer.GetEvent();
+
+	if (!OpenPort(false))
+		return 0;
+
+	LogInfo() << m_name << " port open";
+
+	m_metricsStartTime = std::chrono::steady_clock::now();
+
+	if (!StartLoops())
+		return 0;
+
+	if (m_receiveTask.IsDone() || m_errorTask.IsDone())
+		return 0;		// failed to start receiving
+
+	m_reconnectTask = ReconnectLoop();
+
+	if (!m_reconnectTask)
+	{
+		LogError() << "No memory for " << m_name << " coroutines";
+		return 0;
+	}
+
+	return (uint)EventType::_NumEvents;
+}
+
+
+// Opens the port and applies the settings. When probing for a lost port,
+// a port that is not there yet is not reported.
+// Returns false on error.
+//
+bool SerialClient::OpenPort(const bool isProbe)
 {
 	m_handle = CreateFileA(
 			m_name.data(),
@@ -66,24 +198,35 @@ uint SerialClient::Open(std::span<WSAEVENT> events)
 
 	if (m_handle == INVALID_HANDLE_VALUE)
 	{
-		std::cerr << "Failed to open " << m_name;
+		if (isProbe)
+			return false;
+
+		LogLine line{ LogError() };
+		line << "Failed to open " << m_name;
 
 		switch (GetLastError())
 		{
 		case ERROR_FILE_NOT_FOUND:
-			std::cerr << " - port not found.";
+			line << " - port not found.";
 			break;
 
 		case ERROR_ACCESS_DENIED:
-			std::cerr << " - port is in use.";
+			line << " - port is in use.";
 			break;
 		}
 
-		std::cerr << std::endl;
-
-		return 0;
+		return false;
 	}
 
+	return ConfigurePort();
+}
+
+
+// Applies the settings to the open port.
+// Returns false on error.
+//
+bool SerialClient::ConfigurePort()
+{
 	DCB dcb
 	{
 		.DCBlength = sizeof(DCB)
@@ -91,19 +234,25 @@ uint SerialClient::Open(std::span<WSAEVENT> events)
 
 	if (!GetCommState(m_handle, &dcb))
 	{
-		std::cerr << "Failed to query " << m_name << std::endl;
-		return 0;
+		LogError() << "Failed to query " << m_name;
+		return false;
 	}
 
 	dcb.BaudRate = m_baudrate;
 	dcb.ByteSize = 8;
 	dcb.Parity = NOPARITY;
 	dcb.StopBits = ONESTOPBIT;
+	dcb.fAbortOnError = FALSE;		// line errors are counted, they don't stop the I/O
+
+	SetFlowControl(dcb);
+
+	if (m_flowControl != FlowControl::Default && !SetupComm(m_handle, cDriverRxBufferSize, 0))
+		LogWarning() << "Failed to set the buffer size of " << m_name;
 
 	if (!SetCommState(m_handle, &dcb))
 	{
-		std::cerr << "Failed to set baud rate for " << m_name << std::endl;
-		return 0;
+		LogError() << "Failed to set baud rate or flow control for " << m_name;
+		return false;
 	}
 
 	// Timeout behaviuor:
@@ -122,128 +271,577 @@ uint SerialClient::Open(std::span<WSAEVENT> events)
 
 	if (!SetCommTimeouts(m_handle, &timeouts))
 	{
-		std::cerr << "Failed to configure " << m_name << std::endl;
-		return 0;
+		LogError() << "Failed to configure " << m_name;
+		return false;
 	}
 
-	m_ovSend.hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
-	events[(int)EventType::Send] = m_ovSend.hEvent;
+	if (!SetCommMask(m_handle, EV_ERR | EV_BREAK))
+	{
+		LogError() << "Failed to set the event mask of " << m_name;
+		return false;
+	}
 
-	m_ovReceive.hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
-	events[(int)EventType::Receive] = m_ovReceive.hEvent;
+	return true;
+}
 
-	std::cout << m_name << " port open\n";
 
-	if (!StartReceiving())
-		return 0;
+// While the port is lost, the operations of the loops that have finished
+// still complete (or are cancelled) and set their events. Until the port
+// is closed, such an event is reset and ignored.
+//
+int SerialClient::ProcessEvent(const uint index, Buffer** ppRxBuffer)
+{
+	if (m_isPortLost && !IsWaitingFor(index))
+	{
+		switch ((EventType)index)
+		{
+		case EventType::Send:
+			ResetEvent(m_ovSend.hEvent);
+			return 0;
 
-	return (uint)EventType::_NumEvents;
+		case EventType::Receive:
+			ResetEvent(m_receiveEvent);
+			return 0;
+
+		case EventType::CommEvent:
+			ResetEvent(m_ovCommEvent.hEvent);
+			return 0;
+
+		default:
+			break;
+		}
+	}
+
+	return BaseClient::ProcessEvent(index, ppRxBuffer);
+}
+
+
+// Starts the loops that use the open port.
+// Returns false if there was no memory for them.
+//
+bool SerialClient::StartLoops()
+{
+	m_sendTask = SendLoop();
+	m_receiveTask = ReceiveLoop();
+	m_errorTask = ErrorLoop();
+	m_metricsTask = MetricsLoop();
+	m_holdTask = HoldLoop();
+
+	if (!m_sendTask || !m_receiveTask || !m_errorTask || !m_metricsTask || !m_holdTask)
+	{
+		LogError() << "No memory for " << m_name << " coroutines";
+		return false;
+	}
+
+	return true;
 }
 
 
-bool SerialClient::StartReceiving()
+// Starts the indexed read into a new buffer.
+// Returns false on error.
+//
+bool SerialClient::StartReceiving(const uint read)
 {
-	m_pRxBuffer = m_bufferPool.GetBuffer();
-	bool isOk{ !!m_pRxBuffer };
+	auto& pRxBuffer{ m_rxBuffers[read] };
+
+	pRxBuffer = m_bufferPool.GetBuffer();
+	bool isOk{ !!pRxBuffer };
 
 	if (isOk)
 	{
+		m_bufferPool.SetOwner(pRxBuffer, m_name);
+		m_bufferPool.Keep(pRxBuffer);		// until data arrives
+
 		// NOTE: Because we set lpNumberOfBytesRead to NULL, if the
 		// call finishes synchronously it will still fire the event.
 		// This function is only valid in Windows 10 or above.
 		//
 		if (!ReadFile(
 			m_handle,
-			m_pRxBuffer->GetBufferPtr(),
-			m_pRxBuffer->GetBufferSize(),
+			pRxBuffer->GetBufferPtr(),
+			pRxBuffer->GetBufferSize(),
 			NULL,		// lpNumberOfBytesRead
-			&m_ovReceive))
+			&m_ovReceive[read]))
 		{
 			isOk = GetLastError() == ERROR_IO_PENDING;
 		}
 	}
 
 	if (!isOk)
-		std::cerr << "Failed to receive from " << m_name << std::endl;
+		LogError() << "Failed to receive from " << m_name;
 
 	return isOk;
 }
 
 
+// Data of unknown origin is sent like raw channel data
+//
 bool SerialClient::Send(const Buffer* pBuffer)
+{
+	return SendFrom(pBuffer, TxSource::Raw);
+}
+
+
+// Queues the buffer with the data of its source and wakes up the send loop.
+// If the source's queue is full the data is lost. While the port is lost
+// the data stays queued until it is reopened.
+//
+bool SerialClient::SendFrom(const Buffer* pBuffer, const TxSource source)
 {
 	assert(pBuffer);
-	bool isOk{ true };
 
-	if (BaseClient::PrepareSend(pBuffer))
+	if (m_txScheduler.Push(source, pBuffer))
+		m_bufferPool.SetOwner(pBuffer, m_name);
+	else
 	{
-		// Sender is ready, so send the buffer now
+		m_numLostTxBuffers += m_isPortLost;
+		m_bufferPool.PutBuffer(pBuffer);
+	}
 
-		if (!WriteFile(
+	return ResumeSendLoop();
+}
+
+
+// Receives data from the port and hands it over to the caller of ProcessEvent.
+// Finishes on error, after LosePort.
+//
+// m_numReads reads are kept in flight, so the driver always has a buffer to
+// fill while a completed one is being passed on. The driver completes the
+// reads in the order they were started, and they are handed over in the same
+// order, one per ProcessEvent call.
+//
+// All the reads share one event. Starting a read resets the event, which may
+// hide the completion of the next read, so the event is set again if that
+// read has already completed.
+//
+// When the buffer pool runs low (the channels don't send the data as fast as
+// it comes), the completed reads are not started again. Once all of them have
+// completed, the loop polls the pool with the resume timer and starts the
+// reads again in the same order when the pool has recovered. Meanwhile the
+// data stays in the driver, which pauses the target if flow control is on.
+//
+Lib::Task SerialClient::ReceiveLoop()
+{
+	uint numReadsInFlight{};
+	bool isPaused{};
+
+	for (uint read{};;)
+	{
+		if (numReadsInFlight == 0)
+		{
+			while (isPaused && m_bufferPool.GetNumFree() < cResumeFreeBuffers)
+			{
+				m_resumeTimer.Start(cResumeCheckInterval);
+				co_await WaitForEvent((uint)EventType::ResumeTimer);
+				m_resumeTimer.Stop();
+			}
+
+			isPaused = false;
+
+			for (; numReadsInFlight < m_numReads; ++numReadsInFlight)
+			{
+				if (!StartReceiving((read + numReadsInFlight) % m_numReads))
+				{
+					LosePort();
+					co_return;
+				}
+			}
+
+			if (HasOverlappedIoCompleted(&m_ovReceive[read]))
+				SetEvent(m_receiveEvent);
+		}
+
+		co_await WaitForEvent((uint)EventType::Receive);
+		ResetEvent(m_receiveEvent);
+
+		auto& ov{ m_ovReceive[read] };
+
+		if (!HasOverlappedIoCompleted(&ov))
+			continue;
+
+		DWORD bytesReceived;
+
+		if (!GetOverlappedResult(
 				m_handle,
-				m_pTxBuffer->GetBufferPtr(),
-				m_pTxBuffer->GetDataSize(),
-				NULL,		// lpNumberOfBytesWritten
-				&m_ovSend))
+				&ov,
+				&bytesReceived,
+				FALSE))			// don't wait
 		{
-			isOk = GetLastError() == ERROR_IO_PENDING;
+			break;
+		}
 
-			if (!isOk)
-				std::cerr << "Failed to send to " << m_name << std::endl;
+		Buffer* pRxBuffer{ std::exchange(m_rxBuffers[read], {}) };
+		m_bufferPool.Unkeep(pRxBuffer);
+
+		if (bytesReceived > 0)
+		{
+			m_metrics.rxBytes += bytesReceived;
+			pRxBuffer->SetDataSize(bytesReceived);
+			Deliver(pRxBuffer);		// the caller now owns the buffer
+		}
+		else
+		{
+			// Weird...
+			m_bufferPool.PutBuffer(pRxBuffer);
+		}
+
+		--numReadsInFlight;
+
+		if (!isPaused && m_bufferPool.GetNumFree() < cPauseFreeBuffers)
+		{
+			isPaused = true;
+			++m_numPauses;
+			++m_metrics.numPauses;
+		}
+
+		if (!isPaused)
+		{
+			if (!StartReceiving(read))
+				break;
+
+			++numReadsInFlight;
 		}
+
+		read = (read + 1) % m_numReads;
+
+		if (numReadsInFlight > 0 && HasOverlappedIoCompleted(&m_ovReceive[read]))
+			SetEvent(m_receiveEvent);
 	}
 
-	return isOk;
+	LosePort();
+}
+
+
+// Copies as many queued buffers as fit into m_txData and frees them,
+// in the order chosen by m_txScheduler.
+// Returns the number of bytes gathered.
+//
+DWORD SerialClient::GatherTxData()
+{
+	size_t size{};
+
+	while (const Buffer* pBuffer{ m_txScheduler.Front() })
+	{
+		auto data{ pBuffer->GetData() };
+
+		if (size + data.size() > m_txData.size())
+			break;
+
+		std::copy(data.begin(), data.end(), m_txData.begin() + size);
+		size += data.size();
+
+		m_txScheduler.Pop();
+		m_bufferPool.PutBuffer(pBuffer);
+	}
+
+	return (DWORD)size;
 }
 
 
-int SerialClient::ProcessEvent(uint index, Buffer** ppRxBuffer)
+// Sends the queued data. The buffers queued while a write is in progress
+// are gathered and sent with the next write, so data received from
+// the channels in many small buffers goes out as a continuous stream.
+// Finishes on error, after LosePort.
+//
+// Data held for an unfinished gdb packet is sent when gdb continues the
+// packet, or when the hold timer wakes the loop after cGdbPacketTimeout.
+//
+Lib::Task SerialClient::SendLoop()
 {
-	switch ((EventType)index)
+	for (;;)
 	{
-	case EventType::Send:		// finished sending a buffer
+		DWORD size{ GatherTxData() };
+
+		if (size == 0)
+		{
+			if (auto holdTime{ m_txScheduler.GetHoldTime() }; holdTime > 0us)
+				m_holdTimer.Start(holdTime);
+
+			co_await WaitForTxData();
+			continue;
+		}
+
+		if (!WriteFile(
+				m_handle,
+				m_txData.data(),
+				size,
+				NULL,		// lpNumberOfBytesWritten
+				&m_ovSend)
+			&& GetLastError() != ERROR_IO_PENDING)
+		{
+			LogMessage(Log::Level::Error, "Failed to send to ", m_name);
+			break;
+		}
+
+		co_await WaitForEvent((uint)EventType::Send);
 		ResetEvent(m_ovSend.hEvent);
-		return OnDataSent();
+	}
+
+	LosePort();
+}
 
-	case EventType::Receive:	// finished receiving
-		ResetEvent(m_ovReceive.hEvent);
-		return OnDataReceived(ppRxBuffer);
 
-	default:
-		std::cerr << "BUG: SerialClient::ProcessEvent\n";
+// Starts waiting for a line error or a break.
+// Returns false on error.
+//
+bool SerialClient::StartWaitingForErrors()
+{
+	if (!WaitCommEvent(m_handle, &m_commEvents, &m_ovCommEvent) && GetLastError() != ERROR_IO_PENDING)
+	{
+		LogError() << "Failed to wait for errors of " << m_name;
+		return false;
 	}
 
-	return -1;
+	return true;
 }
 
 
-int SerialClient::OnDataReceived(Buffer** ppRxBuffer)
+// Collects the line errors that occurred since the last call and samples
+// the queue depths, both in the driver and in Sernic.
+// Returns false on error.
+//
+bool SerialClient::UpdateMetrics()
 {
-	assert(m_pRxBuffer);
+	DWORD errors{};
+	COMSTAT comStat{};
 
-	int bytesReceived{ -1 };
+	if (!ClearCommError(m_handle, &errors, &comStat))
+		return false;
 
-	if (GetOverlappedResult(
-			m_handle,
-			&m_ovReceive,
-			(DWORD*)&bytesReceived,
-			FALSE))			// don't wait
+	m_metrics.AddErrors(errors);
+	m_metrics.AddSample(comStat, (uint)m_bufferPool.GetNumFree(), m_txScheduler.GetNumQueued());
+
+	return true;
+}
+
+
+// Reports the metrics of the interval that has just finished and starts
+// a new one
+//
+void SerialClient::ReportMetrics()
+{
+	auto now{ std::chrono::steady_clock::now() };
+
+	if (m_metrics.HasErrors())
+		++m_numErrorIntervals;
+
+	if (m_isMetricsReported || m_metrics.HasErrors() || m_metrics.numReconnects > 0)
+		m_metrics.Print(LogInfo().GetStream(), m_name, now - m_metricsStartTime);
+
+	m_metrics = {};
+	m_metricsStartTime = now;
+}
+
+
+// Counts the line errors (framing, parity, overrun, ...) and breaks as
+// the driver reports them. Without fAbortOnError the driver goes on
+// receiving after an error, so the data around it is still delivered.
+// Finishes on error, after LosePort.
+//
+Lib::Task SerialClient::ErrorLoop()
+{
+	while (StartWaitingForErrors())
 	{
-		if (bytesReceived > 0)
+		co_await WaitForEvent((uint)EventType::CommEvent);
+		ResetEvent(m_ovCommEvent.hEvent);
+
+		DWORD bytesTransferred;
+
+		if (!GetOverlappedResult(m_handle, &m_ovCommEvent, &bytesTransferred, FALSE))
+			break;
+
+		if (!UpdateMetrics())
+			break;
+	}
+
+	LosePort();
+}
+
+
+// Samples the queue depths every cMetricsSampleInterval and reports
+// the metrics every m_metricsInterval. The interval goes on while the
+// port is lost, so the reconnection is reported with it.
+// Finishes on error, after LosePort.
+//
+Lib::Task SerialClient::MetricsLoop()
+{
+	for (;;)
+	{
+		m_metricsTimer.Start(cMetricsSampleInterval);
+		co_await WaitForEvent((uint)EventType::MetricsTimer);
+		m_metricsTimer.Stop();
+
+		if (!UpdateMetrics())
+			break;
+
+		if (std::chrono::steady_clock::now() - m_metricsStartTime >= m_metricsInterval)
+			ReportMetrics();
+	}
+
+	LogMessage(Log::Level::Error, "Failed to query the state of ", m_name);
+	LosePort();
+}
+
+
+// Wakes the send loop when the data held for an unfinished gdb packet
+// is due, so it goes out without waiting for more data to send
+//
+Lib::Task SerialClient::HoldLoop()
+{
+	for (;;)
+	{
+		co_await WaitForEvent((uint)EventType::HoldTimer);
+		m_holdTimer.Stop();
+
+		ResumeSendLoop();
+	}
+}
+
+
+// Starts reopening the port after an error. Called by the loops, which
+// then finish. The port is closed by the reconnect loop, which runs on the
+// next event, because a loop can't destroy itself. Until the port has been
+// opened (no reconnect loop yet) an error fails the client.
+//
+void SerialClient::LosePort()
+{
+	if (!m_reconnectTask)
+	{
+		Fail();
+		return;
+	}
+
+	if (m_isPortLost)
+		return;
+
+	LogWarning() << m_name << " lost, reopening it";
+
+	// The operations still in flight finish early, ProcessEvent ignores
+	// the events of those whose loop has finished
+
+	CancelIoEx(m_handle, NULL);
+
+	m_isPortLost = true;
+	m_lostTime = std::chrono::steady_clock::now();
+	m_probeTimer.Start(0us);
+}
+
+
+// Stops the loops and cancels the operations in flight, keeping the
+// events and the data queued in m_txScheduler
+//
+void SerialClient::StopLoops()
+{
+	// The loops are suspended or finished, they leave the events they
+	// wait for when they are destroyed
+
+	m_receiveTask = {};
+	m_sendTask = {};
+	m_errorTask = {};
+	m_metricsTask = {};
+	m_holdTask = {};
+
+	if (m_handle != INVALID_HANDLE_VALUE)
+		CancelIo(m_handle);
+}
+
+
+// Returns true if the operations cancelled by StopLoops have finished,
+// so their OVERLAPPED structures and buffers may be reused
+//
+bool SerialClient::HasIoFinished() const
+{
+	for (uint read{}; read < m_numReads; ++read)
+	{
+		if (!HasOverlappedIoCompleted(&m_ovReceive[read]))
+			return false;
+	}
+
+	return HasOverlappedIoCompleted(&m_ovSend) && HasOverlappedIoCompleted(&m_ovCommEvent);
+}
+
+
+// Closes the port after StopLoops and returns the buffers of the
+// cancelled reads to the pool
+//
+void SerialClient::ClosePort()
+{
+	if (m_handle != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_handle);
+		m_handle = INVALID_HANDLE_VALUE;
+	}
+
+	for (auto& pRxBuffer : m_rxBuffers)
+	{
+		if (pRxBuffer)
 		{
-			m_pRxBuffer->SetDataSize((size_t)bytesReceived);
-			*ppRxBuffer = m_pRxBuffer;
-			m_pRxBuffer = {};	// the caller now owns the buffer
+			m_bufferPool.Unkeep(pRxBuffer);
+			m_bufferPool.PutBuffer(std::exchange(pRxBuffer, {}));
 		}
-		else
+	}
+
+	ResetEvent(m_ovSend.hEvent);
+	ResetEvent(m_receiveEvent);
+	ResetEvent(m_ovCommEvent.hEvent);
+	m_resumeTimer.Stop();
+	m_metricsTimer.Stop();
+	m_holdTimer.Stop();
+}
+
+
+// Reopens the port after LosePort: stops the loops, waits for the
+// cancelled operations, closes the port, probes it every cProbeInterval
+// until it opens with the settings applied, and starts the loops again.
+// The send loop then sends the data held meanwhile.
+// Finishes if the loops can't be started.
+//
+// The cancelled operations are polled on the probe timer, so the event
+// loop goes on meanwhile. After cCancelTimeout the port is closed anyway,
+// because an operation that failed at once may look pending for ever.
+//
+Lib::Task SerialClient::ReconnectLoop()
+{
+	for (;;)
+	{
+		co_await WaitForEvent((uint)EventType::ProbeTimer);
+		m_probeTimer.Stop();
+
+		StopLoops();
+
+		auto deadline{ std::chrono::steady_clock::now() + cCancelTimeout };
+
+		while (!HasIoFinished() && std::chrono::steady_clock::now() < deadline)
 		{
-			// Weird...
-			m_bufferPool.PutBuffer(m_pRxBuffer);
+			m_probeTimer.Start(cCancelCheckInterval);
+			co_await WaitForEvent((uint)EventType::ProbeTimer);
+			m_probeTimer.Stop();
 		}
 
-		if (!StartReceiving())
-			bytesReceived = -1;
+		ClosePort();
+
+		while (!OpenPort(true))
+		{
+			ClosePort();		// it may have opened without the settings
+
+			m_probeTimer.Start(cProbeInterval);
+			co_await WaitForEvent((uint)EventType::ProbeTimer);
+			m_probeTimer.Stop();
+		}
+
+		auto reconnectTime{ std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_lostTime) };
+
+		LogMessage(Log::Level::Info, m_name, " reopened after ", reconnectTime.count(), " ms, sending ",
+				m_txScheduler.GetNumQueued(), " buffers held meanwhile");
+
+		m_metrics.AddReconnect(reconnectTime);
+		++m_numReconnects;
+		m_maxReconnectTime = std::max(m_maxReconnectTime, reconnectTime);
+		m_isPortLost = false;
+
+		if (!StartLoops())
+			break;
 	}
 
-	return bytesReceived;
+	Fail();
 }
@@ -1,25 +1,132 @@
 #pragma once
 
 #include "BaseClient.h"
+#include "TxScheduler.h"
+#include "EventTimer.h"
+#include "SerialMetrics.h"
 
 
+// Client of the serial port. When the port fails (the USB-serial adapter
+// is removed or glitches) the client doesn't fail: it closes the port and
+// probes for it until it is back, reopens it with the same settings and
+// goes on. The channels stay connected meanwhile, and the data they send
+// is held in the TX queues (as much as fits, the rest is lost).
+//
 class SerialClient : public BaseClient
 {
 public:
-	SerialClient(std::string_view name, uint baudrate, BufferPool& bufferPool);
+	// Flow control between the port and the target
+	enum class FlowControl
+	{
+		Default,		// as set up in the driver
+		None,
+		Hardware,		// RTS/CTS
+		Software		// XON/XOFF
+	};
+
+	// The maximum number of reads in flight
+	static constexpr uint cMaxReads{ 8 };
+
+	// The maximum number of bytes written to the port at a time
+	static constexpr size_t cTxDataSize{ 1024 };
+
+	// gdbTxWeight is the share of the port given to gdb data against each
+	// of the other channels, or TxScheduler::cStrictPriority
+	SerialClient(
+			std::string_view name,
+			uint baudrate,
+			FlowControl flowControl,
+			uint numReads,
+			uint gdbTxWeight,
+			BufferPool& bufferPool);
 	~SerialClient();
 
+	// Reports the metrics of the port every interval. By default only the
+	// intervals with line errors are reported, every cErrorReportInterval.
+	void SetMetricsInterval(std::chrono::seconds interval);
+
+protected:
+	// The operations that need a serial port, not just a device that reads
+	// and writes. A test can stand in for them to use a pipe as the port.
+	virtual bool ConfigurePort();
+	virtual bool StartWaitingForErrors();
+	virtual bool UpdateMetrics();
+
 private:
 	uint Open(std::span<WSAEVENT> events) override;
 	int ProcessEvent(uint index, Buffer** ppRxBuffer) override;
 	bool Send(const Buffer* pBuffer) override;
+	bool SendFrom(const Buffer* pBuffer, TxSource source) override;
 
 	void Cleanup();
-	bool StartReceiving();
-	int OnDataReceived(Buffer** ppRxBuffer);
+	void SetFlowControl(DCB& dcb) const;
+	bool OpenPort(bool isProbe);
+	bool StartLoops();
+	void LosePort();
+	void StopLoops();
+	bool HasIoFinished() const;
+	void ClosePort();
+	bool StartReceiving(uint read);
+	DWORD GatherTxData();
+	void ReportMetrics();
+	Lib::Task ReceiveLoop();
+	Lib::Task SendLoop();
+	Lib::Task ErrorLoop();
+	Lib::Task MetricsLoop();
+	Lib::Task HoldLoop();
+	Lib::Task ReconnectLoop();
+
+	// Receiving pauses when the pool has less than cPauseFreeBuffers free
+	// buffers and resumes when it has cResumeFreeBuffers
+	static constexpr uint cPauseFreeBuffers{ 64 };
+	static constexpr uint cResumeFreeBuffers{ 256 };
+	static constexpr auto cResumeCheckInterval{ 1ms };
+
+	// Size of the driver's receive buffer with flow control
+	static constexpr uint cDriverRxBufferSize{ 65536 };
+
+	// The queue depths are sampled every cMetricsSampleInterval
+	static constexpr auto cMetricsSampleInterval{ 100ms };
+	static constexpr std::chrono::seconds cErrorReportInterval{ 10s };
+
+	// A lost port is probed this often until it can be opened again.
+	// Before that, the cancelled operations are checked every
+	// cCancelCheckInterval, for at most cCancelTimeout.
+	static constexpr auto cProbeInterval{ 20ms };
+	static constexpr auto cCancelCheckInterval{ 1ms };
+	static constexpr auto cCancelTimeout{ 100ms };
 
 	uint m_baudrate;
+	FlowControl m_flowControl;
+	uint m_numReads;
 	HANDLE m_handle{ INVALID_HANDLE_VALUE };
+	HANDLE m_receiveEvent{};		// shared by all the reads
 	OVERLAPPED m_ovSend{};
-	OVERLAPPED m_ovReceive{};
+	OVERLAPPED m_ovCommEvent{};
+	DWORD m_commEvents{};			// set by WaitCommEvent
+	std::array<OVERLAPPED, cMaxReads> m_ovReceive{};
+	std::array<Buffer*, cMaxReads> m_rxBuffers{};
+	std::array<uint8_t, cTxDataSize> m_txData{};		// queued buffers gathered for one write
+	TxScheduler m_txScheduler;
+	EventTimer m_resumeTimer;
+	uint64_t m_numPauses{};
+	EventTimer m_metricsTimer;
+	EventTimer m_holdTimer;			// of the data held for an unfinished gdb packet
+	SerialMetrics m_metrics;		// of the current interval
+	std::chrono::seconds m_metricsInterval{ cErrorReportInterval };
+	bool m_isMetricsReported{};		// every interval, not only with errors
+	std::chrono::steady_clock::time_point m_metricsStartTime;
+	uint64_t m_numErrorIntervals{};
+	EventTimer m_probeTimer;
+	bool m_isPortLost{};
+	std::chrono::steady_clock::time_point m_lostTime;
+	uint64_t m_numLostTxBuffers{};	// from the channels while the port was lost, because the queue was full
+	uint64_t m_numReconnects{};
+	std::chrono::milliseconds m_maxReconnectTime{};
+	Lib::Task m_receiveTask;
+	Lib::Task m_sendTask;
+	Lib::Task m_errorTask;
+	Lib::Task m_metricsTask;
+	Lib::Task m_holdTask;
+	Lib::Task m_reconnectTask;
 };
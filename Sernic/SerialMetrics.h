@@ -0,0 +1,79 @@
+#pragma once
+
+#include <Windows.h>
+#include "Lib/Types.h"
+
+
+// Counters of one reporting interval of the serial port: the line errors
+// reported by the driver (ClearCommError) and the highest queue depths seen,
+// both in the driver and in Sernic, sampled by the serial client.
+//
+// Driver queues that fill up while Sernic's queues stay short mean that the
+// limit is the UART (or the target), the other way round the limit is in
+// Sernic or its clients.
+//
+struct SerialMetrics
+{
+	// Counts the CE_xxx flags returned by ClearCommError
+	//
+	void AddErrors(const DWORD errors)
+	{
+		numFramingErrors += !!(errors & CE_FRAME);
+		numParityErrors += !!(errors & CE_RXPARITY);
+		numOverruns += !!(errors & CE_OVERRUN);
+		numRxOverflows += !!(errors & CE_RXOVER);
+		numBreaks += !!(errors & CE_BREAK);
+	}
+
+	void AddSample(const COMSTAT& comStat, const uint numFreeBuffers, const uint numTxQueued)
+	{
+		maxDriverRxQueue = std::max(maxDriverRxQueue, (uint)comStat.cbInQue);
+		maxDriverTxQueue = std::max(maxDriverTxQueue, (uint)comStat.cbOutQue);
+		minFreeBuffers = std::min(minFreeBuffers, numFreeBuffers);
+		maxTxQueued = std::max(maxTxQueued, numTxQueued);
+	}
+
+	// Counts a reconnection of the port that took the time since it was lost
+	//
+	void AddReconnect(const std::chrono::milliseconds time)
+	{
+		++numReconnects;
+		maxReconnectTime = std::max(maxReconnectTime, (uint)time.count());
+	}
+
+	bool HasErrors() const
+	{
+		return numFramingErrors + numParityErrors + numOverruns + numRxOverflows + numBreaks > 0;
+	}
+
+	void Print(std::ostream& os, const std::string_view name, const std::chrono::duration<double> interval) const
+	{
+		os << name << " " << std::fixed << std::setprecision(1) << interval.count() << " s: received " << rxBytes
+			<< " bytes; errors: framing " << numFramingErrors
+			<< ", parity " << numParityErrors
+			<< ", overrun " << numOverruns
+			<< ", rx overflow " << numRxOverflows
+			<< ", break " << numBreaks
+			<< "; driver queue max: rx " << maxDriverRxQueue << " tx " << maxDriverTxQueue
+			<< " bytes; Sernic: min free buffers " << minFreeBuffers
+			<< ", max tx queued " << maxTxQueued
+			<< ", receive pauses " << numPauses;
+
+		if (numReconnects > 0)
+			os << "; reconnects " << numReconnects << ", longest " << maxReconnectTime << " ms";
+	}
+
+	uint64_t rxBytes{};
+	uint numFramingErrors{};
+	uint numParityErrors{};
+	uint numOverruns{};				// the UART's FIFO overflowed
+	uint numRxOverflows{};			// the driver's buffer overflowed
+	uint numBreaks{};
+	uint maxDriverRxQueue{};		// bytes
+	uint maxDriverTxQueue{};
+	uint minFreeBuffers{ std::numeric_limits<uint>::max() };
+	uint maxTxQueued{};				// buffers waiting to be sent to the port
+	uint numPauses{};				// of receiving, see SerialClient::ReceiveLoop
+	uint numReconnects{};			// of the port after it was lost, see SerialClient::ReconnectLoop
+	uint maxReconnectTime{};		// ms
+};
@@ -1,22 +1,24 @@
 #include <csignal>
 #include "Lib/CmdLine.h"
-#include "SerialClient.h"
-#include "TcpClient.h"
-#include "GdbOutputFilter.h"
-#include "Runner.h"
-#include "Defs.h"
+#include "Connector.h"
+#include <afunix.h>		// after Connector.h because it needs WinSock2.h
 
 
 namespace
 {
 	constexpr auto cLogo{ "Serial-Network Inter-Connector v1.0\n"sv };
+
 	void Usage(std::string_view progName);
+	bool GetNumber(std::string_view text, uint32_t& value);
+	bool GetChannelAddress(const CmdLine& cmdLine, std::string_view option, Connector::Channel& address);
+	bool GetMulticastAddress(std::string_view text, Connector::Config& config);
+	bool GetTriggerActions(std::string_view text, Runner::TriggerActions& actions);
 }
 
 
 int main(int argc, char* argv[])
 {
-	CmdLine cmdLine{ argc, argv, { "h"sv, "c"sv, "g"sv, "r"sv}};
+	CmdLine cmdLine{ argc, argv, { "h"sv, "c"sv, "g"sv, "r"sv, "m"sv, "n"sv, "w"sv, "s"sv, "f"sv, "i"sv, "t"sv, "k"sv, "o"sv, "z"sv, "p"sv, "b"sv, "u"sv, "x"sv }};
 
 	if (cmdLine.GetNumArguments() == 0 && cmdLine.GetNumOptions() == 0 && cmdLine.HasOption("h"sv))
 	{
@@ -30,21 +32,38 @@ int main(int argc, char* argv[])
 		return -1;
 	}
 
+	// The baud rate follows the port name after a colon
+
 	const auto comText{ "COM"sv };
-	std::string_view comPort{ cmdLine.GetArgument(0) };
+	std::string_view portText{ cmdLine.GetArgument(0) };
+	std::string_view baudText{};
+	auto colon{ portText.find(':') };
+
+	if (colon != std::string_view::npos)
+	{
+		baudText = portText.substr(colon + 1);
+		portText = portText.substr(0, colon);
+	}
+
+	// The port name is copied to be null-terminated for CreateFile,
+	// the argument is not changed
 
+	const std::string comPort{ portText };
 	uint32_t baudRate{ 115200 };
-	char* pEnd{};
-	bool isOk{ comPort.starts_with(comText) };
+	bool isOk{};
 
-	if (isOk)
+	if (comPort == cSimulatedPort)
 	{
-		auto portText{ comPort };
-		portText.remove_prefix(comText.size());
-		
-		auto portNum{ std::strtoul(portText.data(), &pEnd, 10) };
+		// Without a baud rate the simulator isn't paced
 
-		isOk = (*pEnd == ':' || *pEnd == 0) && portNum > 0 && portNum < 99;
+		isOk = true;
+		baudRate = 0;
+	}
+	else if (comPort.starts_with(comText))
+	{
+		uint32_t portNum{};
+
+		isOk = GetNumber(portText.substr(comText.size()), portNum) && portNum > 0 && portNum < 99;
 	}
 
 	if (!isOk)
@@ -53,70 +72,170 @@ int main(int argc, char* argv[])
 		return -1;
 	}
 
-	if (*pEnd == ':')
+	if (colon != std::string_view::npos && (!GetNumber(baudText, baudRate) || baudRate < 100 || baudRate > 5000000))
 	{
-		*pEnd = 0;	// null-terminate the COMxx string (HACK: should be const!)
-		comPort = comPort.substr(0, pEnd - comPort.data());
-		baudRate = std::strtoul(pEnd + 1, &pEnd, 10);
-
-		if (*pEnd != 0 || baudRate < 100 || baudRate > 5000000)
-		{
-			std::cerr << "Invalid baud rate value\n";
-			return -1;
-		}
+		std::cerr << "Invalid baud rate value\n";
+		return -1;
 	}
 
-	uint16_t portConsole{};
+	Connector::Config config
+	{
+		.comPort = comPort,
+		.baudRate = baudRate
+	};
 
-	if (cmdLine.HasOption("c"sv) && (!cmdLine.GetOption("c"sv, portConsole) || portConsole) == 0)
+	if (!GetChannelAddress(cmdLine, "c"sv, config.console))
 	{
 		std::cerr << "Invalid value for the console port\n";
 		return -1;
 	}
 
-	uint16_t portGdb{};
-
-	if (cmdLine.HasOption("g"sv) && (!cmdLine.GetOption("g"sv, portGdb) || portGdb) == 0)
+	if (!GetChannelAddress(cmdLine, "g"sv, config.gdb))
 	{
 		std::cerr << "Invalid value for the gdb port\n";
 		return -1;
 	}
 
-	uint16_t portRaw{};
-
-	if (cmdLine.HasOption("r"sv) && (!cmdLine.GetOption("r"sv, portRaw) || portRaw) == 0)
+	if (!GetChannelAddress(cmdLine, "r"sv, config.raw))
 	{
 		std::cerr << "Invalid value for the raw console port\n";
 		return -1;
 	}
 
-	std::cout << cLogo;
+	config.shmName = cmdLine.GetOption("m"sv);
+
+	if (cmdLine.HasOption("m"sv) && config.shmName.empty())
+	{
+		std::cerr << "Invalid name for the shared memory channel\n";
+		return -1;
+	}
+
+	config.capturePath = cmdLine.GetOption("o"sv);
+
+	if (cmdLine.HasOption("o"sv) && config.capturePath.empty())
+	{
+		std::cerr << "Invalid capture file name\n";
+		return -1;
+	}
+
+	config.isCaptureCompressed = cmdLine.HasOption("z"sv);
+
+	if (config.isCaptureCompressed && (config.capturePath.empty() || !cmdLine.GetOption("z"sv).empty()))
+	{
+		std::cerr << "Invalid capture compression (-z has no value and requires -o)\n";
+		return -1;
+	}
+
+	if (cmdLine.HasOption("u"sv) && !GetMulticastAddress(cmdLine.GetOption("u"sv), config))
+	{
+		std::cerr << "Invalid multicast address (IPv4 address:port)\n";
+		return -1;
+	}
+
+	config.isMulticastFiltered = cmdLine.HasOption("x"sv);
+
+	if (config.isMulticastFiltered && (config.multicastAddress.empty() || !cmdLine.GetOption("x"sv).empty()))
+	{
+		std::cerr << "Invalid multicast filtering (-x has no value and requires -u)\n";
+		return -1;
+	}
+
+	if (!cmdLine.GetOption("n"sv, config.numSerialReads, cDefaultNumSerialReads)
+		|| config.numSerialReads == 0 || config.numSerialReads > SerialClient::cMaxReads)
+	{
+		std::cerr << "Invalid number of serial reads (1-" << SerialClient::cMaxReads << ")\n";
+		return -1;
+	}
+
+	if (cmdLine.HasOption("f"sv))
+	{
+		auto flowText{ cmdLine.GetOption("f"sv) };
+
+		if (flowText == "rtscts"sv)
+			config.flowControl = SerialClient::FlowControl::Hardware;
+		else if (flowText == "xonxoff"sv)
+			config.flowControl = SerialClient::FlowControl::Software;
+		else if (flowText == "none"sv)
+			config.flowControl = SerialClient::FlowControl::None;
+		else
+		{
+			std::cerr << "Invalid flow control (rtscts, xonxoff or none)\n";
+			return -1;
+		}
+	}
+
+	if (!cmdLine.GetOption("w"sv, config.gdbTxWeight, TxScheduler::cStrictPriority) || config.gdbTxWeight > cMaxGdbTxWeight)
+	{
+		std::cerr << "Invalid gdb weight (0-" << cMaxGdbTxWeight << ")\n";
+		return -1;
+	}
+
+	if (!cmdLine.GetOption("s"sv, config.scrollbackSize, cDefaultScrollbackSize) || config.scrollbackSize > cMaxScrollbackSize)
+	{
+		std::cerr << "Invalid scrollback size (0-" << cMaxScrollbackSize << " KB)\n";
+		return -1;
+	}
 
-	BufferPool bufferPool{ cNumBuffers };
-	SerialClient serialClient{ comPort, baudRate, bufferPool };
+	if (!cmdLine.GetOption("i"sv, config.metricsInterval, 0u) || config.metricsInterval > cMaxMetricsInterval)
+	{
+		std::cerr << "Invalid metrics interval (0-" << cMaxMetricsInterval << " s)\n";
+		return -1;
+	}
+
+	if (cmdLine.HasOption("p"sv))
+	{
+		uint core{};
 
-	std::unique_ptr<TcpClient> pConsoleClient{};
-	std::unique_ptr<TcpClient> pGdbClient{};
-	std::unique_ptr<TcpClient> pRawClient{};
+		if (!cmdLine.GetOption("p"sv, core) || core >= std::min(std::thread::hardware_concurrency(), 64u))
+		{
+			std::cerr << "Invalid core number (0-" << std::min(std::thread::hardware_concurrency(), 64u) - 1 << ")\n";
+			return -1;
+		}
+
+		config.pollCore = (int)core;
+	}
+
+	if (cmdLine.HasOption("p"sv) || cmdLine.HasOption("b"sv))
+	{
+		if (!cmdLine.GetOption("b"sv, config.spinBudget, cDefaultSpinBudget) || config.spinBudget > cMaxSpinBudget)
+		{
+			std::cerr << "Invalid spin budget (0-" << cMaxSpinBudget << " us)\n";
+			return -1;
+		}
+	}
 
-	if (portConsole)
+	if (cmdLine.HasOption("t"sv))
 	{
-		auto pGdbOutFilter = std::make_unique<GdbOutputFilter>(bufferPool);
-		pConsoleClient = std::make_unique<TcpClient>("Console"sv, portConsole, bufferPool, std::move(pGdbOutFilter));
+		if (!GetTriggerActions(cmdLine.GetOption("t"sv), config.triggerActions))
+		{
+			std::cerr << "Invalid trigger actions (freeze, pause, notify or log, separated by commas)\n";
+			return -1;
+		}
+
+		config.triggerPatterns.assign(cDefaultTriggerPatterns.begin(), cDefaultTriggerPatterns.end());
 	}
 
-	if (portGdb)
-		pGdbClient = std::make_unique<TcpClient>("GDB"sv, portGdb, bufferPool);
+	if (cmdLine.HasOption("k"sv))
+	{
+		auto marker{ cmdLine.GetOption("k"sv) };
 
-	if (portRaw)
-		pRawClient = std::make_unique<TcpClient>("Raw console"sv, portRaw, bufferPool);
+		if (marker.empty() || !cmdLine.HasOption("t"sv))
+		{
+			std::cerr << "Invalid trigger marker (requires -t)\n";
+			return -1;
+		}
+
+		config.triggerPatterns.push_back(marker);
+	}
 
-	Runner runner{ serialClient, pConsoleClient.get(), pGdbClient.get(), pRawClient.get()};
-	static Runner* s_pRunner{ &runner };
+	std::cout << cLogo;
 
-	std::signal(SIGINT, [](int) { s_pRunner->Close(); });
+	Connector connector{ config };
+	static Connector* s_pConnector{ &connector };
 
-	runner.Run();
+	std::signal(SIGINT, [](int) { s_pConnector->Close(); });
+
+	connector.Run();
 
 	return 0;
 }
@@ -130,14 +249,125 @@ namespace
 
 		std::cout << cLogo;
 		std::cout << "\nUsage:\n\n";
-		std::cout << name << " COMx[:baudrate] [-c portConsole] [-g portGdb] [-r portRaw]\n\n";
+		std::cout << name << " COMx[:baudrate] [-c portConsole] [-g portGdb] [-r portRaw] [-m shmName] [-n numReads] [-w gdbWeight] [-s scrollback]\n";
+		std::cout << std::string(name.size(), ' ') << " [-f flowControl] [-i interval] [-t actions] [-k marker] [-o captureFile]\n";
+		std::cout << std::string(name.size(), ' ') << " [-z] [-p core] [-b spinBudget] [-u address:port] [-x]\n\n";
 		std::cout << "where\n";
 		std::cout << "\tCOMx - serial port for kgdb connection\n";
-		std::cout << "\tbaudrate - baud rate (default 115200)\n\n";
+		std::cout << "\tbaudrate - baud rate (default 115200)\n";
+		std::cout << "\t(SIM[:baudrate] instead of COMx runs a simulated target, for load tests)\n";
+		std::cout << "\tflowControl - rtscts, xonxoff or none (default: as set up in Windows)\n\n";
 		std::cout << "\tportConsole - port number on localhost for console (telnet)\n";
 		std::cout << "\tportGdb - port number on localhost for gdb\n";
 		std::cout << "\tportRaw - port number on localhost for unfiltered console\n";
+		std::cout << "\t(instead of a port number, a Unix domain socket path can be given\n";
+		std::cout << "\tfor any of the ports, or @name for an abstract socket name)\n";
+		std::cout << "\tshmName - name of a shared memory channel for local consumers\n";
+		std::cout << "\tnumReads - number of serial reads in flight (1-" << SerialClient::cMaxReads
+				<< ", default " << cDefaultNumSerialReads << ")\n";
+		std::cout << "\tgdbWeight - share of the serial port given to gdb data against each of the other\n";
+		std::cout << "\tchannels (1-" << cMaxGdbTxWeight << "), or 0 to always send gdb data first (default)\n";
+		std::cout << "\tscrollback - KB of recent data sent to new console and raw clients (0-"
+				<< cMaxScrollbackSize << ", default " << cDefaultScrollbackSize << ")\n";
+		std::cout << "\tinterval - seconds between reports of the serial port errors and queue depths\n";
+		std::cout << "\t(1-" << cMaxMetricsInterval << "), or 0 to report only intervals with errors (default)\n";
+		std::cout << "\tactions - what to do when the serial data has \"Kernel panic\", \"Oops:\" or \"BUG:\",\n";
+		std::cout << "\tseparated by commas: freeze (the scrollback), pause (the console), notify (the\n";
+		std::cout << "\tconsole and raw clients) or log (only)\n";
+		std::cout << "\tmarker - one more text that triggers the actions\n";
+		std::cout << "\tcaptureFile - file for the data received from and sent to the serial port, with\n";
+		std::cout << "\ttimes (read it with CaptureSearch)\n";
+		std::cout << "\t-z - compress the capture file, in blocks that can be read on their own\n";
+		std::cout << "\tcore - core the serial path runs on, polling for the data (for interactive kgdb)\n";
+		std::cout << "\tspinBudget - us of polling after the last data before waiting again (0-"
+				<< cMaxSpinBudget << ", default " << cDefaultSpinBudget << "), also without -p\n";
+		std::cout << "\taddress:port - multicast group (or any IPv4 address, e.g. 127.0.0.1) that gets the\n";
+		std::cout << "\tunfiltered console in sequenced UDP datagrams, for passive monitors\n";
+		std::cout << "\t-x - send the console data (without the gdb packets) to the multicast group\n";
 		std::cout << "Example:\n\n";
-		std::cout << name << " COM3:115200 -c 4321 -g 4322 -r 4323\n\n";
+		std::cout << name << " COM3:115200 -c 4321 -g 4322 -r 4323\n";
+		std::cout << name << " COM3:115200 -c 4321 -g C:\\Temp\\gdb.sock\n\n";
+	}
+
+
+	// Gets the channel address from the option's value, which is a port number
+	// or a socket path. Returns false if the value is invalid.
+	//
+	bool GetChannelAddress(const CmdLine& cmdLine, const std::string_view option, Connector::Channel& address)
+	{
+		if (!cmdLine.HasOption(option))
+			return true;		// the channel is not used
+
+		auto value{ cmdLine.GetOption(option) };
+
+		if (value.empty())
+			return false;
+
+		if (std::isdigit((unsigned char)value.front()))
+			return cmdLine.GetOption(option, address.port) && address.port != 0;
+
+		address.socketPath = value;
+
+		return value.size() < sizeof(SOCKADDR_UN::sun_path);
+	}
+
+
+	// Gets the address and the port of the multicast channel from
+	// "address:port". Returns false if the value is invalid.
+	//
+	bool GetMulticastAddress(const std::string_view text, Connector::Config& config)
+	{
+		auto colon{ text.rfind(':') };
+
+		if (colon == std::string_view::npos || colon == 0)
+			return false;
+
+		auto portText{ text.substr(colon + 1) };
+		uint port{};
+		auto result{ std::from_chars(portText.data(), portText.data() + portText.size(), port) };
+
+		if (result.ec != std::errc{} || result.ptr != portText.data() + portText.size() || port == 0 || port > 65535)
+			return false;
+
+		// The client checks the address when it opens
+
+		config.multicastAddress = text.substr(0, colon);
+		config.multicastPort = (uint16_t)port;
+
+		return true;
+	}
+
+
+	// Sets the actions given as a comma separated list.
+	// Returns false if an action is unknown.
+	//
+	bool GetTriggerActions(const std::string_view text, Runner::TriggerActions& actions)
+	{
+		for (auto part : std::views::split(text, ","sv))
+		{
+			std::string_view action{ part.begin(), part.end() };
+
+			if (action == "freeze"sv)
+				actions.freezeScrollback = true;
+			else if (action == "pause"sv)
+				actions.pauseConsole = true;
+			else if (action == "notify"sv)
+				actions.notifyChannels = true;
+			else if (action != "log"sv)
+				return false;
+		}
+
+		return true;
+	}
+
+
+	// Converts the whole text to a number.
+	// Returns false if it is not a number.
+	//
+	bool GetNumber(const std::string_view text, uint32_t& value)
+	{
+		auto result{ std::from_chars(text.data(), text.data() + text.size(), value) };
+
+		return result.ec == std::errc{} && result.ptr == text.data() + text.size();
 	}
 }
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <Windows.h>
+#include "Lib/SharedRing.h"
+
+
+// Shared-memory channel: a named file mapping holding two SharedRings,
+// with a named event as the doorbell of each ring.
+//
+// Sernic creates the channel, writes the data received on the serial port
+// into one ring and sends the data it reads from the other ring to the
+// serial port. A consumer process opens the channel by name and uses the
+// rings the other way round. It reads the serial data in place, without
+// copies or socket calls.
+//
+// This header is all a consumer needs (together with Lib/SharedRing.h).
+//
+class ShmChannel : NonCopyable
+{
+public:
+	// The data of a block fits in one of Sernic's pool buffers
+	static constexpr size_t cMaxDataSize{ 120 };
+	static constexpr uint cBlockSize{ (uint)(Lib::SharedRing::cBlockHeaderSize + cMaxDataSize) };
+
+	static constexpr uint cNumSerialBlocks{ 4096 };		// Sernic to consumer
+	static constexpr uint cNumInputBlocks{ 256 };		// consumer to Sernic
+
+	ShmChannel() = default;
+
+	~ShmChannel()
+	{
+		Close();
+	}
+
+	// Creates the channel (Sernic side). Returns false on error.
+	//
+	bool Create(const std::string_view name)
+	{
+		return Map(name, true);
+	}
+
+	// Opens a channel created by Sernic (consumer side). Returns false on error.
+	//
+	bool Open(const std::string_view name)
+	{
+		return Map(name, false);
+	}
+
+	void Close()
+	{
+		if (m_pMemory)
+		{
+			UnmapViewOfFile(m_pMemory);
+			m_pMemory = nullptr;
+		}
+
+		for (HANDLE* pHandle : { &m_mapping, &m_outputEvent, &m_inputEvent })
+		{
+			if (*pHandle)
+			{
+				CloseHandle(*pHandle);
+				*pHandle = NULL;
+			}
+		}
+	}
+
+	// Copies the data into one block of the output ring and rings the doorbell
+	// if the other side sleeps. Returns false if the ring is full.
+	//
+	bool Write(std::span<const uint8_t> data)
+	{
+		bool mustRing{};
+
+		if (!m_output.Write(data, mustRing))
+			return false;
+
+		if (mustRing)
+			SetEvent(m_outputEvent);
+
+		return true;
+	}
+
+	// Returns the data of the next input block in place, or an empty span
+	// if there is no data. The caller must call Pop when done with the data.
+	//
+	std::span<const uint8_t> Peek() { return m_input.Front(); }
+	void Pop() { m_input.Pop(); }
+
+	// Returns the event set by the doorbell of the input ring (manual reset)
+	HANDLE GetInputEvent() const { return m_inputEvent; }
+
+	// Resets the input event and asks the other side to ring the doorbell.
+	// Returns true if the input ring is still empty, so the caller may wait
+	// for the input event, or false if data has arrived in the meantime.
+	//
+	bool ArmInputDoorbell()
+	{
+		ResetEvent(m_inputEvent);
+		return m_input.ArmDoorbell();
+	}
+
+	// Waits up to the given number of ms for input data.
+	// Returns false on timeout.
+	//
+	bool WaitForInput(const DWORD timeout)
+	{
+		while (Peek().empty())
+		{
+			if (ArmInputDoorbell() && WaitForSingleObject(m_inputEvent, timeout) != WAIT_OBJECT_0)
+				return false;
+		}
+
+		return true;
+	}
+
+private:
+	static constexpr size_t cSerialRingSize{ Lib::SharedRing::GetMemorySize(cBlockSize, cNumSerialBlocks) };
+	static constexpr size_t cInputRingSize{ Lib::SharedRing::GetMemorySize(cBlockSize, cNumInputBlocks) };
+
+	bool Map(const std::string_view name, const bool isCreator)
+	{
+		std::string objectName{ "Local\\Sernic." };
+		objectName += name;
+
+		if (isCreator)
+		{
+			m_mapping = CreateFileMappingA(
+					INVALID_HANDLE_VALUE,	// backed by the paging file
+					NULL,					// security attributes
+					PAGE_READWRITE,
+					0,						// size (high)
+					(DWORD)(cSerialRingSize + cInputRingSize),
+					objectName.c_str());
+
+			if (m_mapping && GetLastError() == ERROR_ALREADY_EXISTS)
+			{
+				Close();
+				return false;				// in use by another instance
+			}
+		}
+		else
+			m_mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, objectName.c_str());
+
+		if (!m_mapping)
+			return false;
+
+		m_pMemory = MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, cSerialRingSize + cInputRingSize);
+
+		if (!m_pMemory)
+		{
+			Close();
+			return false;
+		}
+
+		auto* pSerialRing{ (uint8_t*)m_pMemory };
+		auto* pInputRing{ pSerialRing + cSerialRingSize };
+
+		// Sernic writes the serial ring and reads the input ring
+
+		Lib::SharedRing& serialRing{ isCreator ? m_output : m_input };
+		Lib::SharedRing& inputRing{ isCreator ? m_input : m_output };
+
+		if (isCreator)
+		{
+			serialRing.Initialize(pSerialRing, cBlockSize, cNumSerialBlocks);
+			inputRing.Initialize(pInputRing, cBlockSize, cNumInputBlocks);
+		}
+		else if (!serialRing.Attach(pSerialRing, cSerialRingSize) || !inputRing.Attach(pInputRing, cInputRingSize))
+		{
+			Close();
+			return false;
+		}
+
+		// Both sides create the events, whoever comes first
+
+		HANDLE serialEvent{ CreateEventA(NULL, TRUE, FALSE, (objectName + ".serial").c_str()) };
+		HANDLE inputEvent{ CreateEventA(NULL, TRUE, FALSE, (objectName + ".input").c_str()) };
+
+		m_outputEvent = isCreator ? serialEvent : inputEvent;
+		m_inputEvent = isCreator ? inputEvent : serialEvent;
+
+		if (!m_outputEvent || !m_inputEvent)
+		{
+			Close();
+			return false;
+		}
+
+		return true;
+	}
+
+	HANDLE m_mapping{};
+	void* m_pMemory{};
+	HANDLE m_outputEvent{};
+	HANDLE m_inputEvent{};
+	Lib::SharedRing m_output;
+	Lib::SharedRing m_input;
+};
@@ -0,0 +1,125 @@
+#include "ShmClient.h"
+#include "Log.h"
+
+
+static_assert(ShmChannel::cMaxDataSize <= cBufferSize, "A block must fit in a pool buffer");
+
+
+namespace
+{
+	enum class EventType
+	{
+		Input,
+		RetryTimer,
+		_NumEvents
+	};
+}
+
+
+ShmClient::ShmClient(std::string_view name, BufferPool& bufferPool)
+	: m_name{ name }
+	, m_bufferPool{ bufferPool }
+{
+}
+
+
+ShmClient::~ShmClient()
+{
+	if (m_numDroppedBlocks)
+		LogInfo() << "Shared memory " << m_name << ": " << m_numDroppedBlocks << " blocks dropped (ring full)";
+
+	if (m_numRetries)
+		LogWarning() << "Shared memory " << m_name << ": receive waited " << m_numRetries << " times for free buffers";
+}
+
+
+// Returns the number of events, 0 on error
+//
+uint ShmClient::Open(std::span<WSAEVENT> events)
+{
+	if (!m_channel.Create(m_name) || !m_retryTimer.Create())
+	{
+		LogError() << "Failed to create shared memory channel " << m_name;
+		return 0;
+	}
+
+	events[(int)EventType::Input] = m_channel.GetInputEvent();
+	events[(int)EventType::RetryTimer] = m_retryTimer.GetEvent();
+	WaitForInput();
+
+	LogInfo() << "Shared memory channel " << m_name << " open";
+
+	return (uint)EventType::_NumEvents;
+}
+
+
+// Asks the consumer to ring the doorbell when it writes data.
+// If data has already arrived, sets the event to be called back.
+//
+void ShmClient::WaitForInput()
+{
+	if (!m_channel.ArmInputDoorbell())
+		SetEvent(m_channel.GetInputEvent());
+}
+
+
+// Copies one block written by the consumer into a new buffer. If the pool
+// is empty, the block is left in the ring and the retry timer comes back
+// for it.
+// Returns the number of bytes received, or 0 if no data was received.
+//
+int ShmClient::ProcessEvent(const uint index, Buffer** ppRxBuffer)
+{
+	if (index == (uint)EventType::RetryTimer)
+		m_retryTimer.Stop();
+	else
+		ResetEvent(m_channel.GetInputEvent());
+
+	auto data{ m_channel.Peek() };
+
+	if (data.empty())
+	{
+		WaitForInput();
+		return 0;
+	}
+
+	Buffer* pBuffer{ m_bufferPool.GetBuffer() };
+
+	if (!pBuffer)
+	{
+		if (m_numRetries++ == 0)
+			LogWarning() << "Shared memory " << m_name << " receive waits for free buffers";
+
+		m_retryTimer.Start(cRetryInterval);
+		return 0;
+	}
+
+	std::copy(data.begin(), data.end(), pBuffer->GetBufferPtr());
+	pBuffer->SetDataSize(data.size());
+	m_channel.Pop();
+
+	// Come back for the next block, or wait for the doorbell
+
+	if (!m_channel.Peek().empty())
+		SetEvent(m_channel.GetInputEvent());
+	else
+		WaitForInput();
+
+	*ppRxBuffer = pBuffer;
+
+	return (int)data.size();
+}
+
+
+// Copies the data into the shared ring. If the consumer doesn't keep
+// up and the ring is full, the data is lost.
+//
+bool ShmClient::Send(const Buffer* pBuffer)
+{
+	if (!m_channel.Write(pBuffer->GetData()))
+		++m_numDroppedBlocks;
+
+	m_bufferPool.PutBuffer(pBuffer);
+
+	return true;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "IClient.h"
+#include "EventTimer.h"
+#include "ShmChannel.h"
+
+
+// Channel for consumer processes on the same machine, through a
+// shared-memory channel (see ShmChannel.h) instead of a socket.
+// The data received on the serial port is copied into the shared ring
+// once and the consumer reads it in place.
+// If the pool has no buffer for a block written by the consumer, the
+// block stays in the ring and is read again every cRetryInterval.
+//
+class ShmClient : public IClient
+{
+public:
+	ShmClient(std::string_view name, BufferPool& bufferPool);
+	~ShmClient();
+
+private:
+	static constexpr auto cRetryInterval{ 10ms };
+
+	uint Open(std::span<WSAEVENT> events) override;
+	int ProcessEvent(uint index, Buffer** ppRxBuffer) override;
+	bool Send(const Buffer* pBuffer) override;
+
+	void WaitForInput();
+
+	std::string_view m_name;
+	BufferPool& m_bufferPool;
+	ShmChannel m_channel;
+	EventTimer m_retryTimer;
+	uint64_t m_numDroppedBlocks{};
+	uint64_t m_numRetries{};			// of blocks that waited for a buffer
+};
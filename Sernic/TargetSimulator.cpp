@@ -0,0 +1,543 @@
+#include "TargetSimulator.h"
+#include <cassert>
+#include "Log.h"
+
+
+namespace
+{
+	enum class EventType
+	{
+		OutputTimer,
+		ConsoleTimer,
+		_NumEvents
+	};
+
+	constexpr auto cPrompt{ "~ # "sv };
+	constexpr auto cHexDigits{ "0123456789abcdef"sv };
+
+	// Printed in turn by the boot log
+	constexpr std::array cBootMessages
+	{
+		"Linux version 6.6.0-sim (sernic@sim) (gcc 13.2.0) #1 SMP PREEMPT"sv,
+		"Command line: console=ttyS0,115200 kgdboc=ttyS0,115200 nokaslr"sv,
+		"x86/fpu: Supporting XSAVE feature 0x001: 'x87 floating point registers'"sv,
+		"Memory: 2014520K/2096696K available (18432K kernel code, 2810K rwdata)"sv,
+		"pci 0000:00:1f.2: [8086:2922] type 00 class 0x010601 conventional PCI endpoint"sv,
+		"serial8250: ttyS0 at I/O 0x3f8 (irq = 4, base_baud = 115200) is a 16550A"sv,
+		"EXT4-fs (vda1): mounted filesystem with ordered data mode. Quota mode: none."sv,
+		"systemd[1]: Started Journal Service."sv
+	};
+
+
+	// Returns the value of a hex digit, or -1
+	//
+	int GetHexValue(const uint8_t digit)
+	{
+		if (digit >= '0' && digit <= '9')
+			return digit - '0';
+
+		if (digit >= 'a' && digit <= 'f')
+			return digit - 'a' + 10;
+
+		if (digit >= 'A' && digit <= 'F')
+			return digit - 'A' + 10;
+
+		return -1;
+	}
+
+
+	// Writes the number with at least minDigits digits, padded with the fill.
+	// Returns the end of the text.
+	//
+	char* WriteNumber(char* pText, const uint64_t value, const size_t minDigits, const char fill)
+	{
+		std::array<char, 20> digits;
+		auto pEnd{ std::to_chars(digits.data(), digits.data() + digits.size(), value).ptr };
+		size_t numDigits{ (size_t)(pEnd - digits.data()) };
+
+		if (numDigits < minDigits)
+			pText = std::fill_n(pText, minDigits - numDigits, fill);
+
+		return std::copy(digits.data(), pEnd, pText);
+	}
+}
+
+
+// The data sent to the target is handled as it is sent, BaseClient's TX
+// queue is not used
+//
+TargetSimulator::TargetSimulator(const std::string_view name, const Config& config, BufferPool& bufferPool)
+	: BaseClient{ name, bufferPool, 1, {} }
+	, m_config{ config }
+	, m_readSize{ config.baudRate == 0 ? cBufferSize : std::clamp<size_t>(config.baudRate / 10 / 1000 * cReadInterval.count(), 1, cBufferSize) }
+	, m_output(cOutputSize)
+{
+}
+
+
+TargetSimulator::~TargetSimulator()
+{
+	LogInfo() << m_name << " sent " << m_numBytesOut << " bytes, answered " << m_numPackets << " gdb packets";
+
+	if (m_numBadPackets > 0)
+		LogWarning() << m_name << " received " << m_numBadPackets << " gdb packets with a bad checksum";
+
+	if (m_numLostBytes > 0)
+		LogWarning() << m_name << " lost " << m_numLostBytes << " bytes of output (not read in time)";
+}
+
+
+// Returns the number of events, 0 on error
+//
+uint TargetSimulator::Open(std::span<WSAEVENT> events)
+{
+	if (!m_outputTimer.Create() || !m_consoleTimer.Create())
+	{
+		LogError() << "Failed to create timers for " << m_name;
+		return 0;
+	}
+
+	events[(int)EventType::OutputTimer] = m_outputTimer.GetEvent();
+	events[(int)EventType::ConsoleTimer] = m_consoleTimer.GetEvent();
+
+	m_outputTask = OutputLoop();
+	m_consoleTask = ConsoleLoop();
+
+	if (!m_outputTask || !m_consoleTask)
+	{
+		LogError() << "No memory for " << m_name << " coroutines";
+		return 0;
+	}
+
+	LogInfo() << m_name << " target started (" << (m_config.baudRate == 0 ? "no pacing"s : std::to_string(m_config.baudRate) + " baud") << ")";
+
+	return (uint)EventType::_NumEvents;
+}
+
+
+// Data of unknown origin is typed on the console
+//
+bool TargetSimulator::Send(const Buffer* pBuffer)
+{
+	return SendFrom(pBuffer, TxSource::Raw);
+}
+
+
+// The gdb data goes to the kgdb stub, the other channels' data to the shell
+//
+bool TargetSimulator::SendFrom(const Buffer* pBuffer, const TxSource source)
+{
+	assert(pBuffer);
+
+	if (source == TxSource::Gdb)
+		ProcessGdbData(pBuffer->GetData());
+	else
+		ProcessConsoleData(pBuffer->GetData());
+
+	m_bufferPool.PutBuffer(pBuffer);
+
+	return ResumeSendLoop();
+}
+
+
+size_t TargetSimulator::GetFreeOutput(const bool isReply) const
+{
+	size_t freeSize{ cOutputSize - m_outputSize };
+
+	if (isReply)
+		return freeSize;
+
+	return freeSize > cReplyRoom ? freeSize - cReplyRoom : 0;
+}
+
+
+// Adds the text to the output, or loses it if it doesn't fit.
+// The caller wakes up the output loop.
+//
+void TargetSimulator::Output(const std::string_view text, const bool isReply)
+{
+	if (text.size() > GetFreeOutput(isReply))
+	{
+		m_numLostBytes += text.size();
+		return;
+	}
+
+	size_t end{ (m_outputStart + m_outputSize) % cOutputSize };
+	size_t firstSize{ std::min(text.size(), cOutputSize - end) };
+
+	std::copy_n(text.data(), firstSize, m_output.data() + end);
+	std::copy(text.data() + firstSize, text.data() + text.size(), m_output.data());
+
+	m_outputSize += text.size();
+}
+
+
+// Prints the next line of the boot log, "[    1.234567] message"
+//
+void TargetSimulator::PrintBootLine()
+{
+	std::array<char, cMaxLineSize> line;
+
+	m_bootTime += 1000 + m_numBootLines * 7919 % 4000;
+
+	auto message{ cBootMessages[m_numBootLines++ % cBootMessages.size()] };
+	char* pText{ line.data() };
+
+	*pText++ = '[';
+	pText = WriteNumber(pText, m_bootTime / 1'000'000, 5, ' ');
+	*pText++ = '.';
+	pText = WriteNumber(pText, m_bootTime % 1'000'000, 6, '0');
+	*pText++ = ']';
+	*pText++ = ' ';
+
+	assert(message.size() + 2 <= (size_t)(line.data() + line.size() - pText));
+
+	pText = std::copy(message.begin(), message.end(), pText);
+	*pText++ = '\r';
+	*pText++ = '\n';
+
+	Output({ line.data(), pText });
+}
+
+
+// Collects the gdb packets ($data#checksum) and acknowledges them. A break
+// (0x03) between packets halts the target, the acknowledgements from gdb
+// are ignored.
+//
+void TargetSimulator::ProcessGdbData(const std::span<const uint8_t> data)
+{
+	for (uint8_t byte : data)
+	{
+		switch (m_packetState)
+		{
+		case PacketState::Idle:
+			if (byte == '$')
+			{
+				m_packetState = PacketState::Data;
+				m_packetSize = 0;
+				m_packetChecksum = 0;
+			}
+			else if (byte == 0x03)
+			{
+				m_isHalted = true;
+				Reply("S05"sv);
+			}
+			break;
+
+		case PacketState::Data:
+			if (byte == '#')
+				m_packetState = PacketState::Checksum1;
+			else
+			{
+				m_packetChecksum += byte;
+
+				if (m_packetSize < m_packet.size())
+					m_packet[m_packetSize++] = (char)byte;
+			}
+			break;
+
+		case PacketState::Checksum1:
+		case PacketState::Checksum2:
+		{
+			int value{ GetHexValue(byte) };
+
+			if (value < 0)
+			{
+				++m_numBadPackets;
+				Output("-"sv, true);
+				m_packetState = PacketState::Idle;
+			}
+			else if (m_packetState == PacketState::Checksum1)
+			{
+				m_receivedChecksum = (uint8_t)(value << 4);
+				m_packetState = PacketState::Checksum2;
+			}
+			else
+			{
+				m_receivedChecksum |= (uint8_t)value;
+				m_packetState = PacketState::Idle;
+
+				if (m_receivedChecksum == m_packetChecksum)
+				{
+					Output("+"sv, true);
+					ProcessPacket();
+				}
+				else
+				{
+					++m_numBadPackets;
+					Output("-"sv, true);
+				}
+			}
+			break;
+		}
+		}
+	}
+}
+
+
+// Answers a packet like kgdb does. Any packet but 'c' leaves the target
+// halted, the memory and register contents are made up.
+//
+void TargetSimulator::ProcessPacket()
+{
+	std::string_view packet{ m_packet.data(), m_packetSize };
+
+	++m_numPackets;
+	m_isHalted = true;
+
+	switch (packet.empty() ? 0 : packet.front())
+	{
+	case '?':
+	case 's':
+		Reply("S05"sv);
+		break;
+
+	case 'g':
+		ReplyHex(0, m_config.registersSize);
+		break;
+
+	case 'm':
+	{
+		// m<address>,<length>
+
+		uint64_t address{};
+		size_t size{};
+		auto pEnd{ packet.data() + packet.size() };
+		auto result{ std::from_chars(packet.data() + 1, pEnd, address, 16) };
+
+		if (result.ec == std::errc{} && result.ptr != pEnd && *result.ptr == ',')
+			result = std::from_chars(result.ptr + 1, pEnd, size, 16);
+
+		if (result.ec != std::errc{} || result.ptr != pEnd || size == 0)
+			Reply("E01"sv);
+		else
+			ReplyHex(address, std::min(size, cMaxMemoryRead));
+
+		break;
+	}
+
+	case 'M':
+	case 'X':
+		Reply("OK"sv);
+		break;
+
+	case 'c':
+		m_isHalted = false;
+		break;
+
+	default:
+		Reply({});		// not supported
+		break;
+	}
+}
+
+
+// Outputs the reply packet, $text#checksum
+//
+void TargetSimulator::Reply(const std::string_view text)
+{
+	if (text.size() + 4 > GetFreeOutput(true))
+	{
+		m_numLostBytes += text.size() + 4;
+		return;
+	}
+
+	uint8_t checksum{};
+
+	for (char c : text)
+		checksum += (uint8_t)c;
+
+	std::array<char, 3> end{ '#', cHexDigits[checksum >> 4], cHexDigits[checksum & 0xF] };
+
+	Output("$"sv, true);
+	Output(text, true);
+	Output({ end.data(), end.size() }, true);
+}
+
+
+// Outputs a reply packet with the given number of bytes in hex. The byte at
+// each address is the low byte of the address.
+//
+void TargetSimulator::ReplyHex(const uint64_t address, const size_t size)
+{
+	if (size * 2 + 4 > GetFreeOutput(true))
+	{
+		m_numLostBytes += size * 2 + 4;
+		return;
+	}
+
+	std::array<char, 64> hex;
+	uint8_t checksum{};
+
+	Output("$"sv, true);
+
+	for (size_t offset{}; offset < size; offset += hex.size() / 2)
+	{
+		size_t numBytes{ std::min(size - offset, hex.size() / 2) };
+
+		for (size_t index{}; index < numBytes; ++index)
+		{
+			auto byte{ (uint8_t)(address + offset + index) };
+
+			hex[index * 2] = cHexDigits[byte >> 4];
+			hex[index * 2 + 1] = cHexDigits[byte & 0xF];
+			checksum += (uint8_t)(hex[index * 2] + hex[index * 2 + 1]);
+		}
+
+		Output({ hex.data(), numBytes * 2 }, true);
+	}
+
+	std::array<char, 3> end{ '#', cHexDigits[checksum >> 4], cHexDigits[checksum & 0xF] };
+	Output({ end.data(), end.size() }, true);
+}
+
+
+// The shell echoes what is typed and runs the command at the end of the line
+//
+void TargetSimulator::ProcessConsoleData(const std::span<const uint8_t> data)
+{
+	for (uint8_t byte : data)
+	{
+		if (byte == '\r')
+		{
+			Output("\r\n"sv);
+			RunCommand();
+			m_commandSize = 0;
+			Output(cPrompt);
+		}
+		else if (byte == 0x03)		// Ctrl-C
+		{
+			Output("^C\r\n"sv);
+			m_commandSize = 0;
+			Output(cPrompt);
+		}
+		else if (byte == 0x08 || byte == 0x7F)
+		{
+			if (m_commandSize > 0)
+			{
+				--m_commandSize;
+				Output("\b \b"sv);
+			}
+		}
+		else if (byte >= 0x20 && byte < 0x7F && m_commandSize < m_command.size())
+		{
+			m_command[m_commandSize++] = (char)byte;
+			Output({ (const char*)&byte, 1 });
+		}
+	}
+}
+
+
+void TargetSimulator::RunCommand()
+{
+	std::string_view command{ m_command.data(), m_commandSize };
+
+	if (command.empty())
+		return;
+
+	if (command == "uname"sv)
+		Output("Linux\r\n"sv);
+	else
+	{
+		Output("sh: "sv);
+		Output(command);
+		Output(": not found\r\n"sv);
+	}
+}
+
+
+// Returns the time the line takes to carry the bytes (10 bits each)
+//
+std::chrono::microseconds TargetSimulator::GetLineTime(const size_t size) const
+{
+	if (m_config.baudRate == 0)
+		return {};
+
+	return std::chrono::microseconds{ (uint64_t)size * 10 * 1'000'000 / m_config.baudRate };
+}
+
+
+// Hands the output over to Runner a read at a time, after the time the
+// line takes to carry it. The line's time is kept as a deadline, so a timer
+// that fires late doesn't slow the line down. Waits for the pool when it
+// has no buffers, like a port that stops reading.
+//
+Lib::Task TargetSimulator::OutputLoop()
+{
+	for (;;)
+	{
+		if (m_outputSize == 0)
+		{
+			co_await WaitForTxData();
+			continue;
+		}
+
+		size_t size{ std::min(m_outputSize, m_readSize) };
+		auto now{ std::chrono::steady_clock::now() };
+
+		m_lineTime = std::max(m_lineTime, now) + GetLineTime(size);
+
+		m_outputTimer.Start(std::chrono::duration_cast<std::chrono::microseconds>(m_lineTime - now));
+		co_await WaitForEvent((uint)EventType::OutputTimer);
+		m_outputTimer.Stop();
+
+		Buffer* pBuffer{ m_bufferPool.GetBuffer() };
+
+		while (!pBuffer)
+		{
+			m_outputTimer.Start(cRetryDelay);
+			co_await WaitForEvent((uint)EventType::OutputTimer);
+			m_outputTimer.Stop();
+
+			pBuffer = m_bufferPool.GetBuffer();
+		}
+
+		size_t firstSize{ std::min(size, cOutputSize - m_outputStart) };
+		uint8_t* pData{ pBuffer->GetBufferPtr() };
+
+		std::copy_n(m_output.data() + m_outputStart, firstSize, pData);
+		std::copy_n(m_output.data(), size - firstSize, pData + firstSize);
+		pBuffer->SetDataSize(size);
+
+		m_outputStart = (m_outputStart + size) % cOutputSize;
+		m_outputSize -= size;
+		m_numBytesOut += size;
+
+		Deliver(pBuffer);
+	}
+}
+
+
+// Prints the boot log, a burst of lines every burstInterval while the
+// target isn't halted, and then the shell prompt. Like printk on a serial
+// console, the log waits for the line: a burst stops early when the output
+// is full, and the rest of it is printed with the next one.
+// Finishes when the boot log is done or on error.
+//
+Lib::Task TargetSimulator::ConsoleLoop()
+{
+	while (m_numBootLines < m_config.numBootLines)
+	{
+		m_consoleTimer.Start(m_config.burstInterval);
+		co_await WaitForEvent((uint)EventType::ConsoleTimer);
+		m_consoleTimer.Stop();
+
+		if (m_isHalted)
+			continue;
+
+		for (uint line{}; line < m_config.burstLines && m_numBootLines < m_config.numBootLines && GetFreeOutput(false) >= cMaxLineSize; ++line)
+			PrintBootLine();
+
+		if (!ResumeSendLoop())
+		{
+			Fail();
+			co_return;
+		}
+	}
+
+	Output("\r\n"sv);
+	Output(cPrompt);
+
+	if (!ResumeSendLoop())
+		Fail();
+}
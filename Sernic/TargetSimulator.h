@@ -0,0 +1,98 @@
+#pragma once
+
+#include "BaseClient.h"
+#include "EventTimer.h"
+
+
+// Takes the place of the serial port and acts as the target behind it
+// (port SIM), so Sernic and its clients can be loaded without a board.
+//
+// The target prints a boot log in bursts of lines and then a shell prompt
+// that echoes what is typed on the console. A minimal kgdb stub answers
+// the gdb packets ('?', 'g', 'm', 'M', 'X', 's' and 'c') with replies of
+// realistic sizes. A packet or a break (0x03) halts the target, which
+// then prints nothing until gdb continues it.
+//
+// With a baud rate the output is paced like a serial line: each read
+// returns what the line carries in cReadInterval, after the time it takes
+// to send it. Without one the output is delivered as fast as the event
+// loop takes it.
+//
+class TargetSimulator : public BaseClient
+{
+public:
+	struct Config
+	{
+		uint baudRate;										// 0 for no pacing
+		uint numBootLines{ 2000 };
+		uint burstLines{ 50 };								// printed at a time
+		std::chrono::milliseconds burstInterval{ 20ms };
+		uint registersSize{ 560 };							// bytes in the 'g' reply (x86-64)
+	};
+
+	TargetSimulator(std::string_view name, const Config& config, BufferPool& bufferPool);
+	~TargetSimulator();
+
+private:
+	// The output not yet read by Sernic. cReplyRoom of it is kept for the
+	// gdb replies, the console output that doesn't fit is lost.
+	static constexpr size_t cOutputSize{ 64 * 1024 };
+	static constexpr size_t cReplyRoom{ 16 * 1024 };
+
+	static constexpr size_t cMaxPacketSize{ 4096 };		// of the packets kept, longer ones are cut
+	static constexpr size_t cMaxMemoryRead{ 4096 };		// bytes in an 'm' reply
+	static constexpr size_t cMaxCommandSize{ 80 };
+	static constexpr size_t cMaxLineSize{ 128 };		// of a boot log line
+	static constexpr auto cReadInterval{ 1ms };
+	static constexpr auto cRetryDelay{ 1ms };			// when the buffer pool is empty
+
+	enum class PacketState
+	{
+		Idle,
+		Data,
+		Checksum1,
+		Checksum2
+	};
+
+	uint Open(std::span<WSAEVENT> events) override;
+	bool Send(const Buffer* pBuffer) override;
+	bool SendFrom(const Buffer* pBuffer, TxSource source) override;
+
+	size_t GetFreeOutput(bool isReply) const;
+	void Output(std::string_view text, bool isReply = false);
+	void PrintBootLine();
+	void ProcessGdbData(std::span<const uint8_t> data);
+	void ProcessPacket();
+	void Reply(std::string_view text);
+	void ReplyHex(uint64_t address, size_t size);
+	void ProcessConsoleData(std::span<const uint8_t> data);
+	void RunCommand();
+	std::chrono::microseconds GetLineTime(size_t size) const;
+	Lib::Task OutputLoop();
+	Lib::Task ConsoleLoop();
+
+	Config m_config;
+	size_t m_readSize;					// the most bytes a read returns
+	std::vector<uint8_t> m_output;		// a ring of cOutputSize
+	size_t m_outputStart{};
+	size_t m_outputSize{};
+	std::chrono::steady_clock::time_point m_lineTime{};		// when the line has carried the output read so far
+	bool m_isHalted{};
+	uint m_numBootLines{};				// printed so far
+	uint64_t m_bootTime{};				// of the last boot line, in us
+	PacketState m_packetState{};
+	std::array<char, cMaxPacketSize> m_packet{};
+	size_t m_packetSize{};
+	uint8_t m_packetChecksum{};			// computed
+	uint8_t m_receivedChecksum{};
+	std::array<char, cMaxCommandSize> m_command{};
+	size_t m_commandSize{};
+	uint64_t m_numPackets{};
+	uint64_t m_numBadPackets{};
+	uint64_t m_numBytesOut{};
+	uint64_t m_numLostBytes{};
+	EventTimer m_outputTimer;
+	EventTimer m_consoleTimer;
+	Lib::Task m_outputTask;
+	Lib::Task m_consoleTask;
+};
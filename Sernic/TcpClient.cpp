@@ -2,6 +2,7 @@
 #include "TcpClient.h"
 #include <MSWSock.h>	// after TcpClient.h because it includes WinSock2.h
 #include "IFilter.h"
+#include "Log.h"
 
 
 namespace
@@ -13,8 +14,28 @@ namespace
 		Connection,
 		DataReceived,
 		DataSent,
+		CoalesceTimer,
+		RxRetryTimer,
 		_NumEvents
 	};
+
+
+	// Returns true if the path is an AF_UNIX socket file, which is a
+	// reparse point with its own tag
+	//
+	bool IsSocketFile(const char* path)
+	{
+		WIN32_FIND_DATAA findData;
+		HANDLE hFind{ FindFirstFileA(path, &findData) };
+
+		if (hFind == INVALID_HANDLE_VALUE)
+			return false;
+
+		FindClose(hFind);
+
+		return (findData.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT)
+			&& findData.dwReserved0 == IO_REPARSE_TAG_AF_UNIX;
+	}
 }
 
 
@@ -25,6 +46,19 @@ TcpClient::TcpClient(
 		std::unique_ptr<IFilter> pTxFilter)
 	: BaseClient{ name, bufferPool, cNumTxBuffers, std::move(pTxFilter) }
 	, m_port{ port }
+	, m_endpoint{ "port " + std::to_string(port) }
+{
+}
+
+
+TcpClient::TcpClient(
+		std::string_view name,
+		std::string_view socketPath,
+		BufferPool& bufferPool,
+		std::unique_ptr<IFilter> pTxFilter)
+	: BaseClient{ name, bufferPool, cNumTxBuffers, std::move(pTxFilter) }
+	, m_socketPath{ socketPath }
+	, m_endpoint{ "socket " + std::string{ socketPath } }
 {
 }
 
@@ -43,6 +77,16 @@ void TcpClient::Cleanup()
 	{
 		closesocket(m_socketListen);
 		m_socketListen = INVALID_SOCKET;
+
+		// Remove the socket file, the next bind would fail otherwise
+
+		if (!m_socketPath.empty() && !m_socketPath.starts_with('@'))
+		{
+			std::string path{ m_socketPath };
+
+			if (IsSocketFile(path.c_str()))
+				DeleteFileA(path.c_str());
+		}
 	}
 
 	if (m_socketData != INVALID_SOCKET)
@@ -68,42 +112,106 @@ void TcpClient::Cleanup()
 		WSACloseEvent(m_ovSend.hEvent);
 		m_ovSend.hEvent = NULL;
 	}
+
+	m_coalesceTimer.Close();
+	m_rxRetryTimer.Close();
+
+	const Buffer* pBuffer;
+
+	while (m_scrollback.PopFirst(&pBuffer))
+		m_bufferPool.PutBuffer(pBuffer);
 }
 
 
-uint TcpClient::Open(std::span<WSAEVENT> events)
+// Creates an overlapped stream socket of the client's address family
+//
+SOCKET TcpClient::CreateSocket() const
 {
-	m_socketListen = WSASocketW(
-			AF_INET,
+	bool isUnix{ !m_socketPath.empty() };
+
+	return WSASocketW(
+			isUnix ? AF_UNIX : AF_INET,
 			SOCK_STREAM,
-			IPPROTO_TCP,
+			isUnix ? 0 : IPPROTO_TCP,
 			NULL,	// lpProtocolInfo
 			0,		// group
 			WSA_FLAG_OVERLAPPED);
+}
 
-	if (m_socketListen == INVALID_SOCKET)
+
+// Binds the listening socket to the TCP port or to the socket path.
+// Returns false on error.
+//
+bool TcpClient::Bind()
+{
+	if (m_socketPath.empty())
 	{
-		std::cerr << "Failed to create listening socket\n";
-		return 0;
+		int value{ 1 };
+		setsockopt(m_socketListen, SOL_SOCKET, SO_REUSEADDR, (const char*)&value, sizeof value);
+		setsockopt(m_socketListen, IPPROTO_TCP, TCP_NODELAY, (const char*)&value, sizeof value);
+
+		value = 0;
+		setsockopt(m_socketListen, SOL_SOCKET, SO_LINGER, (const char*)&value, sizeof value);
+
+		// Bind the listen socket to localhost
+
+		sockaddr_in addr{};
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_ANY);
+		addr.sin_port = htons(m_port);
+
+		return bind(m_socketListen, (const sockaddr*)&addr, sizeof addr) == 0;
+	}
+
+	sockaddr_un addr{};
+	addr.sun_family = AF_UNIX;
+
+	if (m_socketPath.size() >= sizeof addr.sun_path)
+		return false;
+
+	int addrSize{ (int)sizeof addr };
+
+	if (m_socketPath.starts_with('@'))
+	{
+		// Abstract name: starts with a null character and its length
+		// is given by the address size, not by a terminating null
+
+		std::copy(m_socketPath.begin() + 1, m_socketPath.end(), addr.sun_path + 1);
+		addrSize = (int)(offsetof(sockaddr_un, sun_path) + m_socketPath.size());
+	}
+	else
+	{
+		// A socket file left behind by a previous run would make bind
+		// fail. Any other file at the path is not ours to delete.
+
+		std::copy(m_socketPath.begin(), m_socketPath.end(), addr.sun_path);
+
+		if (IsSocketFile(addr.sun_path))
+			DeleteFileA(addr.sun_path);
+		else if (GetFileAttributesA(addr.sun_path) != INVALID_FILE_ATTRIBUTES)
+		{
+			LogError() << m_socketPath << " exists and is not a socket";
+			return false;
+		}
 	}
 
-	int value{ 1 };
-	setsockopt(m_socketListen, SOL_SOCKET, SO_REUSEADDR, (const char*)&value, sizeof value);
-	setsockopt(m_socketListen, IPPROTO_TCP, TCP_NODELAY, (const char*)&value, sizeof value);
+	return bind(m_socketListen, (const sockaddr*)&addr, addrSize) == 0;
+}
 
-	value = 0;
-	setsockopt(m_socketListen, SOL_SOCKET, SO_LINGER, (const char*)&value, sizeof value);
 
-	// Bind the listen socket to localhost
+uint TcpClient::Open(std::span<WSAEVENT> events)
+{
+	m_socketListen = CreateSocket();
 
-	sockaddr_in addr{};
-	addr.sin_family = AF_INET;
-	addr.sin_addr.s_addr = htonl(INADDR_ANY);
-	addr.sin_port = htons(m_port);
+	if (m_socketListen == INVALID_SOCKET)
+	{
+		LogError() << "Failed to create listening socket";
+		return 0;
+	}
 
-	if (bind(m_socketListen, (const sockaddr*)&addr, sizeof addr))
+	if (!Bind())
 	{
-		std::cerr << "Failed to bind to port " << m_port << std::endl;
+		LogError() << "Failed to bind to " << m_endpoint;
 		return 0;
 	}
 
@@ -111,7 +219,7 @@ uint TcpClient::Open(std::span<WSAEVENT> events)
 	//
 	if (listen(m_socketListen, 1))
 	{
-		std::cerr << "Failed to listen on port " << m_port << std::endl;
+		LogError() << "Failed to listen on " << m_endpoint;
 		return 0;
 	}
 
@@ -124,8 +232,26 @@ uint TcpClient::Open(std::span<WSAEVENT> events)
 	m_ovSend.hEvent = WSACreateEvent();
 	events[(int)EventType::DataSent] = m_ovSend.hEvent;
 
-	if (!PrepareAccept())
+	if (!m_coalesceTimer.Create() || !m_rxRetryTimer.Create())
+	{
+		LogError() << "Failed to create timer for " << m_name;
+		return 0;
+	}
+
+	events[(int)EventType::CoalesceTimer] = m_coalesceTimer.GetEvent();
+	events[(int)EventType::RxRetryTimer] = m_rxRetryTimer.GetEvent();
+
+	m_sendTask = SendLoop();
+	m_connectionTask = ConnectionLoop();
+
+	if (!m_sendTask || !m_connectionTask)
+	{
+		LogError() << "No memory for " << m_name << " coroutines";
 		return 0;
+	}
+
+	if (m_connectionTask.IsDone())
+		return 0;		// failed to start accepting
 
 	return (uint)EventType::_NumEvents;
 }
@@ -133,17 +259,11 @@ uint TcpClient::Open(std::span<WSAEVENT> events)
 
 bool TcpClient::PrepareAccept()
 {
-	m_socketData = WSASocketW(
-			AF_INET,
-			SOCK_STREAM,
-			IPPROTO_TCP,
-			NULL,	// lpProtocolInfo
-			0,		// group
-			WSA_FLAG_OVERLAPPED);
+	m_socketData = CreateSocket();
 
 	if (m_socketData == INVALID_SOCKET)
 	{
-		std::cerr << "Failed to create accepting socket\n";
+		LogError() << "Failed to create accepting socket";
 		return false;
 	}
 
@@ -168,186 +288,464 @@ bool TcpClient::PrepareAccept()
 	{
 		if (WSAGetLastError() != ERROR_IO_PENDING)
 		{
-			std::cerr << "AcceptEx failed\n";
+			LogError() << "AcceptEx failed";
 			return false;
 		}
 	}
 
-	std::cout << m_name << " listening on port " << m_port << std::endl;
+	LogInfo() << m_name << " listening on " << m_endpoint;
 
 	return true;
 }
 
 
-bool TcpClient::StartReceiving(DWORD flags)
+// Takes up to cMaxRxChunks pool buffers for the next receive, fewer if
+// the pool is low. Returns false if the pool is empty.
+//
+bool TcpClient::GetRxBuffers()
 {
-	m_pRxBuffer = m_bufferPool.GetBuffer();
-	bool isOk{ !!m_pRxBuffer };
-
-	if (isOk)
+	for (m_numRxBuffers = 0; m_numRxBuffers < cMaxRxChunks; ++m_numRxBuffers)
 	{
-		m_rxWsaBuf.buf = (char*)m_pRxBuffer->GetBufferPtr();
-		m_rxWsaBuf.len = m_pRxBuffer->GetBufferSize();
+		Buffer* pBuffer{ m_bufferPool.GetBuffer() };
 
-		DWORD bytesReceived;
+		if (!pBuffer)
+			break;		// receive into fewer buffers
 
-		if (WSARecv(
-				m_socketData,
-				&m_rxWsaBuf,
-				1,		// WSA buffer count
-				&bytesReceived,
-				&flags,
-				&m_ovReceive,
-				NULL	// completion routine
-				) == SOCKET_ERROR)
-		{
-			isOk = WSAGetLastError() == ERROR_IO_PENDING;
-		}
-	}
+		m_bufferPool.SetOwner(pBuffer, m_name);
+		m_bufferPool.Keep(pBuffer);		// until data arrives
 
-	if (!isOk)
-		std::cerr << "Failed to receive on socket\n";
+		m_rxBuffers[m_numRxBuffers] = pBuffer;
+		m_rxWsaBufs[m_numRxBuffers].buf = (char*)pBuffer->GetBufferPtr();
+		m_rxWsaBufs[m_numRxBuffers].len = (ULONG)pBuffer->GetBufferSize();
+	}
 
-	return isOk;
+	return m_numRxBuffers > 0;
 }
 
 
-bool TcpClient::Send(const Buffer* pBuffer)
+// Posts one receive that scatters the data over the buffers taken with
+// GetRxBuffers, so a large upload is taken in with a few receives.
+// Returns false on error.
+//
+bool TcpClient::StartReceiving(DWORD flags)
 {
-	assert(pBuffer);
-	bool isOk{ true };
+	DWORD bytesReceived;
 
-	if (m_isConnected)
+	if (WSARecv(
+			m_socketData,
+			m_rxWsaBufs.data(),
+			m_numRxBuffers,
+			&bytesReceived,
+			&flags,
+			&m_ovReceive,
+			NULL	// completion routine
+			) == SOCKET_ERROR && WSAGetLastError() != ERROR_IO_PENDING)
 	{
-		if (BaseClient::PrepareSend(pBuffer))
-		{
-			// Sender is ready, so send the buffer now
-
-			m_txWsaBuf.buf = (char*)m_pTxBuffer->GetBufferPtr();
-			m_txWsaBuf.len = m_pTxBuffer->GetDataSize();
-
-			DWORD bytesSent;
+		LogError() << "Failed to receive on socket";
+		return false;
+	}
 
-			if (WSASend(
-					m_socketData,
-					&m_txWsaBuf,
-					1,		// WSA buffer count
-					&bytesSent,
-					0,		// flags
-					&m_ovSend,
-					NULL	// completion routine
-				) == SOCKET_ERROR)
-			{
-				isOk = WSAGetLastError() == ERROR_IO_PENDING;
+	return true;
+}
 
-				if (!isOk)
-					std::cerr << "Failed to send to " << m_name << std::endl;
-			}
-		}
-	}
-	else
-	{
-		// Just free the buffer, data is lost
 
-		m_bufferPool.PutBuffer(pBuffer);
-	}
+void TcpClient::ReleaseRxBuffers()
+{
+	for (uint i{}; i < m_numRxBuffers; ++i)
+		m_bufferPool.PutBuffer(std::exchange(m_rxBuffers[i], {}));
 
-	return isOk;
+	m_numRxBuffers = 0;
 }
 
 
-int TcpClient::ProcessEvent(uint index, Buffer** ppRxBuffer)
+// Returns true if the queued data fills a send, so coalescing is over
+//
+bool TcpClient::IsTxBatchFull()
 {
-	switch ((EventType)index)
-	{
-	case EventType::Connection:
-		return OnConnection();
+	auto txBuffers{ m_txQueue.FrontN(cMaxTxBuffers) };
+	size_t size{};
 
-	case EventType::DataReceived:
-		return OnDataReceived(ppRxBuffer);
+	for (const Buffer* pBuffer : txBuffers)
+		size += pBuffer->GetDataSize();
+
+	return txBuffers.size() == cMaxTxBuffers || size >= m_coalesceSize;
+}
 
-	case EventType::DataSent:
-		WSAResetEvent(m_ovSend.hEvent);
-		return OnDataSent();
-	}
 
-	assert(false);
-	return -1;
+void TcpClient::FreezeScrollback()
+{
+	if (m_scrollback.GetCapacity() == 0 || m_freezePosition != cNotFrozen)
+		return;
+
+	m_freezePosition = m_scrollback.GetEnd() + m_scrollback.GetCapacity() / 2;
 }
 
 
-// Returns 0 on success, -1 on error.
+// Adds a reference to the buffer to the scrollback and releases the
+// oldest buffer if the scrollback is full.
+// Returns false if the scrollback is frozen and the buffer isn't kept.
 //
-int TcpClient::OnConnection()
+bool TcpClient::KeepInScrollback(const Buffer* pBuffer)
 {
-	WSAResetEvent(m_ovListen.hEvent);
+	if (m_scrollback.GetEnd() == m_freezePosition)
+		return false;
 
-	DWORD bytesReceived;
-	DWORD flags;
+	m_bufferPool.AddRef(pBuffer);
+	m_bufferPool.Keep(pBuffer);
 
-	if (!WSAGetOverlappedResult(
-			m_socketListen,
-			&m_ovListen,
-			&bytesReceived,
-			FALSE,		// don't wait
-			&flags))
+	if (const Buffer* pEvicted; m_scrollback.Push(pBuffer, &pEvicted))
 	{
-		std::cerr << "WSAGetOverlappedResult failed for listening socket\n";
-		return -1;
+		m_bufferPool.Unkeep(pEvicted);
+		m_bufferPool.PutBuffer(pEvicted);
 	}
 
-	// We're connected
-	//
-	m_isConnected = true;
-	std::cout << m_name << " port " << m_port << " connected.\n";
+	if (m_scrollback.GetEnd() == m_freezePosition)
+		LogInfo() << m_name << " scrollback frozen with " << m_scrollback.GetSize() << " buffers for the next client";
 
-	return StartReceiving(flags) ? 0 : -1;
+	return true;
 }
 
 
-int TcpClient::OnDataReceived(Buffer** ppRxBuffer)
+// The data (filtered, if the channel has a filter) goes to the scrollback
+// and to the send queue. While the scrollback is being replayed, the send
+// loop takes the new data from the scrollback as well, unless the
+// scrollback has been frozen meanwhile: the data is then queued and sent
+// after the replay.
+// While the send loop is coalescing, the timer is fired at once when
+// a send is full.
+//
+bool TcpClient::Send(const Buffer* pBuffer)
 {
-	assert(m_pRxBuffer);
+	FilterTx(pBuffer, [this](const Buffer* pTxBuffer)
+		{
+			bool isKept{ m_scrollback.GetCapacity() > 0 && KeepInScrollback(pTxBuffer) };
 
-	WSAResetEvent(m_ovReceive.hEvent);
+			if (m_isConnected && (!m_isReplaying || !isKept))
+				QueueBuffer(pTxBuffer);
+			else
+				m_bufferPool.PutBuffer(pTxBuffer);		// no client, data is lost
+		});
 
-	int bytesReceived{ -1 };
-	DWORD flags;
+	if (!m_isConnected || m_isReplaying)
+		return true;
 
-	if (!WSAGetOverlappedResult(
-			m_socketData,
-			&m_ovReceive,
-			(DWORD*)&bytesReceived,
-			FALSE,		// don't wait
-			&flags))
+	bool isOk{ ResumeSendLoop() };
+
+	if (m_isCoalescing && IsTxBatchFull())
+		m_coalesceTimer.Start({});
+
+	return isOk;
+}
+
+
+// Returns the next scrollback buffers to be replayed (up to cMaxTxBuffers),
+// with a reference added to each, or an empty span when the replay has
+// caught up with the new data. If the client is too slow, the buffers it
+// hasn't got yet may have been evicted and are skipped.
+//
+std::span<const Buffer*> TcpClient::GetReplayBuffers()
+{
+	if (m_replayPosition < m_scrollback.GetFirst())
 	{
-		std::cerr << "WSAGetOverlappedResult failed for data socket\n";
-		return -1;
+		LogInfo() << m_name << " scrollback replay skipped " << m_scrollback.GetFirst() - m_replayPosition
+				<< " buffers";
+		m_replayPosition = m_scrollback.GetFirst();
 	}
 
-	if (bytesReceived > 0)
-	{
-		m_pRxBuffer->SetDataSize(bytesReceived);
-		*ppRxBuffer = m_pRxBuffer;
-		m_pRxBuffer = {};	// the caller now owns the buffer
+	uint numBuffers{ (uint)std::min<uint64_t>(m_scrollback.GetEnd() - m_replayPosition, cMaxTxBuffers) };
 
-		if (m_isConnected && !StartReceiving(0))
-			bytesReceived = -1;
+	for (uint i{}; i < numBuffers; ++i)
+	{
+		m_replayBuffers[i] = m_scrollback[m_replayPosition++];
+		m_bufferPool.AddRef(m_replayBuffers[i]);
 	}
-	else
+
+	return std::span{ m_replayBuffers }.first(numBuffers);
+}
+
+
+// Accepts a connection and receives data from it until the remote
+// client disconnects, then waits for the next connection.
+// Finishes on error.
+//
+// When a receive completes, the next one is posted before the received
+// chunks (pool buffers) are handed over, one per ProcessEvent call. The
+// event is kept set until the last chunk is delivered, so Runner comes
+// back without waiting.
+//
+// If the pool has no buffers for the next receive, the chunks are handed
+// over first and the receive is tried again every cRxRetryInterval, so
+// a short pool slows the client down instead of closing the channel.
+//
+Lib::Task TcpClient::ConnectionLoop()
+{
+	while (PrepareAccept())
 	{
+		co_await WaitForEvent((uint)EventType::Connection);
+		WSAResetEvent(m_ovListen.hEvent);
+
+		DWORD bytesReceived;
+		DWORD flags;
+
+		if (!WSAGetOverlappedResult(
+				m_socketListen,
+				&m_ovListen,
+				&bytesReceived,
+				FALSE,		// don't wait
+				&flags))
+		{
+			LogMessage(Log::Level::Error, "WSAGetOverlappedResult failed for listening socket");
+			break;
+		}
+
+		// We're connected
+		//
+		m_isConnected = true;
+		LogMessage(Log::Level::Info, m_name, " ", m_endpoint, " connected.");
+
+		if (!m_scrollback.IsEmpty())
+		{
+			LogMessage(Log::Level::Info, m_name, " replaying ", m_scrollback.GetSize(), " buffers of scrollback");
+
+			// The new data is added after the frozen data and replayed with it
+
+			m_replayPosition = m_scrollback.GetFirst();
+			m_freezePosition = cNotFrozen;
+			m_isReplaying = true;
+
+			if (!ResumeSendLoop())
+			{
+				Fail();
+				co_return;
+			}
+		}
+
+		bool isReceiving{};
+		DWORD rxFlags{ flags };
+
+		for (;;)
+		{
+			while (!isReceiving)
+			{
+				if (GetRxBuffers())
+				{
+					if (!StartReceiving(rxFlags))
+					{
+						ReleaseRxBuffers();
+						Fail();
+						co_return;
+					}
+
+					isReceiving = true;
+					break;
+				}
+
+				// No receive is pending, the event is only set for delivering chunks
+
+				WSAResetEvent(m_ovReceive.hEvent);
+
+				if (m_numRxRetries++ == 0)
+					LogMessage(Log::Level::Warning, m_name, " receive waits for free buffers");
+
+				m_rxRetryTimer.Start(cRxRetryInterval);
+				co_await WaitForEvent((uint)EventType::RxRetryTimer);
+				m_rxRetryTimer.Stop();
+			}
+
+			co_await WaitForEvent((uint)EventType::DataReceived);
+			WSAResetEvent(m_ovReceive.hEvent);
+
+			if (!HasOverlappedIoCompleted(&m_ovReceive))
+				continue;		// the event was set for delivering the previous chunk
+
+			if (!WSAGetOverlappedResult(
+					m_socketData,
+					&m_ovReceive,
+					&bytesReceived,
+					FALSE,		// don't wait
+					&flags))
+			{
+				LogMessage(Log::Level::Error, "WSAGetOverlappedResult failed for data socket");
+				Fail();
+				co_return;
+			}
+
+			if (bytesReceived == 0)
+				break;
+
+			m_rxSizes.Add(bytesReceived);
+
+			// Take over the filled buffers and return the unused ones
+
+			auto rxBuffers{ m_rxBuffers };
+			uint numChunks{ (uint)((bytesReceived + cBufferSize - 1) / cBufferSize) };
+
+			for (uint chunk{}; chunk < numChunks; ++chunk)
+				m_bufferPool.Unkeep(rxBuffers[chunk]);
+
+			for (uint chunk{ numChunks }; chunk < m_numRxBuffers; ++chunk)
+				m_bufferPool.PutBuffer(rxBuffers[chunk]);
+
+			rxFlags = 0;
+			isReceiving = GetRxBuffers();
+
+			if (isReceiving && !StartReceiving(rxFlags))
+			{
+				ReleaseRxBuffers();
+
+				for (uint chunk{}; chunk < numChunks; ++chunk)
+					m_bufferPool.PutBuffer(rxBuffers[chunk]);
+
+				Fail();
+				co_return;
+			}
+
+			for (uint chunk{}; chunk < numChunks; ++chunk)
+			{
+				if (chunk > 0)
+				{
+					WSASetEvent(m_ovReceive.hEvent);
+					co_await WaitForEvent((uint)EventType::DataReceived);
+				}
+
+				auto chunkSize{ std::min((size_t)bytesReceived, cBufferSize) };
+				bytesReceived -= (DWORD)chunkSize;
+
+				rxBuffers[chunk]->SetDataSize(chunkSize);
+				Deliver(rxBuffers[chunk]);		// the caller now owns the buffer
+			}
+		}
+
 		// Client has closed the connection
 
 		closesocket(m_socketData);
-		m_bufferPool.PutBuffer(m_pRxBuffer);
+		m_socketData = INVALID_SOCKET;
+		ReleaseRxBuffers();
 
 		m_isConnected = false;
-		std::cout << m_name << " port disconnected.\n";
+		m_isReplaying = false;
+		ReportConnection();
 
 		// Make a new accept socket and issue AcceptEx
-		//
-		bytesReceived = PrepareAccept() ? 0 : -1;
 	}
 
-	return bytesReceived;
+	Fail();
+}
+
+
+// Sends the queued buffers, all that are queued (up to cMaxTxBuffers)
+// with one gathering send. The buffers stay in the queue until the
+// send completes.
+// Finishes on error.
+//
+// With coalescing, data queued while the loop is idle waits for the
+// coalescing timer, so the small buffers of a serial read burst go out in
+// one send (and segment) instead of one each. Data queued while a send is
+// in progress goes out with the next send anyway.
+//
+// After a client connects, the loop first sends the scrollback in the same
+// way, one send at a time, so the event loop keeps running during a large
+// replay. The data sent to the channel meanwhile is added to the scrollback
+// and sent with it, and the loop switches to the queue when it catches up.
+//
+Lib::Task TcpClient::SendLoop()
+{
+	for (;;)
+	{
+		const bool isReplay{ m_isReplaying };
+		std::span<const Buffer*> txBuffers{ isReplay ? GetReplayBuffers() : m_txQueue.FrontN(cMaxTxBuffers) };
+
+		if (txBuffers.empty())
+		{
+			if (isReplay)
+			{
+				m_isReplaying = false;		// from now on the new data is queued
+				continue;
+			}
+
+			co_await WaitForTxData();
+
+			if (m_coalesceWindow > 0us && m_isConnected && !m_isReplaying
+				&& !m_txQueue.FrontN(1).empty() && !IsTxBatchFull())
+			{
+				m_isCoalescing = true;
+				m_coalesceTimer.Start(m_coalesceWindow);
+
+				co_await WaitForEvent((uint)EventType::CoalesceTimer);
+
+				m_coalesceTimer.Stop();
+				m_isCoalescing = false;
+			}
+
+			continue;
+		}
+
+		if (m_isConnected)
+		{
+			for (size_t i{}; i < txBuffers.size(); ++i)
+			{
+				m_txWsaBufs[i].buf = (char*)txBuffers[i]->GetBufferPtr();
+				m_txWsaBufs[i].len = (ULONG)txBuffers[i]->GetDataSize();
+				m_numSentBytes += m_txWsaBufs[i].len;
+			}
+
+			DWORD bytesSent;
+
+			if (WSASend(
+					m_socketData,
+					m_txWsaBufs.data(),
+					(DWORD)txBuffers.size(),
+					&bytesSent,
+					0,		// flags
+					&m_ovSend,
+					NULL	// completion routine
+				) == SOCKET_ERROR && WSAGetLastError() != ERROR_IO_PENDING)
+			{
+				LogMessage(Log::Level::Error, "Failed to send to ", m_name);
+				break;
+			}
+
+			co_await WaitForEvent((uint)EventType::DataSent);
+			WSAResetEvent(m_ovSend.hEvent);
+
+			++m_numSends;
+			m_numSentBuffers += txBuffers.size();
+		}
+
+		// If the client has disconnected, the data is lost
+
+		for (const Buffer* pBuffer : txBuffers)
+			m_bufferPool.PutBuffer(pBuffer);
+
+		if (!isReplay)
+			m_txQueue.PopN((uint)txBuffers.size());
+	}
+
+	Fail();
+}
+
+
+// Reports the data of the connection that has just closed and clears
+// the counts for the next one
+//
+void TcpClient::ReportConnection()
+{
+	{
+		LogLine line{ LogInfo() };
+		line << m_name << " " << m_endpoint << " disconnected, received " << m_rxSizes.GetTotalSize()
+				<< " bytes in " << m_rxSizes.GetNumSamples() << " receives, sizes";
+		m_rxSizes.Print(line.GetStream());
+	}
+
+	LogInfo() << m_name << " sent " << m_numSentBytes << " bytes from " << m_numSentBuffers
+			<< " buffers in " << m_numSends << " sends";
+
+	if (m_numRxRetries > 0)
+		LogWarning() << m_name << " receive waited " << m_numRxRetries << " times for free buffers";
+
+	m_rxSizes.Clear();
+	m_numRxRetries = 0;
+	m_numSends = 0;
+	m_numSentBuffers = 0;
+	m_numSentBytes = 0;
 }
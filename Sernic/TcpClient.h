@@ -1,50 +1,131 @@
 #pragma once
 
 #include "BaseClient.h"
+#include <afunix.h>		// after BaseClient.h because it needs WinSock2.h
+#include "Lib/SizeHistogram.h"
+#include "Lib/HistoryRing.h"
+#include "EventTimer.h"
 
 struct IFilter;
 
 
+// Channel that accepts one client at a time, either on a TCP port or on
+// a Unix domain socket (AF_UNIX) for clients on the same machine.
+//
 class TcpClient : public BaseClient
 {
 public:
+	// Listens on the TCP port
 	explicit TcpClient(
 			std::string_view name,
 			uint16_t port,
 			BufferPool& bufferPool,
 			std::unique_ptr<IFilter> pTxFilter = {});
+
+	// Listens on the Unix domain socket with the given path.
+	// A path starting with '@' is an abstract socket name (no file).
+	explicit TcpClient(
+			std::string_view name,
+			std::string_view socketPath,
+			BufferPool& bufferPool,
+			std::unique_ptr<IFilter> pTxFilter = {});
 	~TcpClient();
 
+	// When data is queued while the channel is idle, the channel waits up to
+	// the window for more data and sends it all together, unless maxSize
+	// bytes are queued first. A zero window (the default) sends at once.
+	//
+	void SetCoalescing(std::chrono::microseconds window, size_t maxSize)
+	{
+		m_coalesceWindow = window;
+		m_coalesceSize = maxSize;
+	}
+
+	// The channel keeps (a reference to) the last numBuffers buffers sent
+	// to it, also when no client is connected, and sends them to a client
+	// when it connects, before the new data. 0 (the default) keeps nothing.
+	// Must be called before the client is opened.
+	//
+	void SetScrollback(uint numBuffers) { m_scrollback.SetCapacity(numBuffers); }
+
+	// Stops adding data to the scrollback once half of it is newer than
+	// now, so the data before and after the event is kept for the next
+	// client. The scrollback is unfrozen when a client connects.
+	//
+	void FreezeScrollback() override;
+
+	// The number of sends to the connected client so far
+	uint64_t GetNumSends() const { return m_numSends; }
+
 protected:
-	int ProcessEvent(uint index, Buffer** ppRxBuffer) override;
 	bool Send(const Buffer* pBuffer) override;
 
 private:
 	uint Open(std::span<WSAEVENT> events) override;
 
+	SOCKET CreateSocket() const;
+	bool Bind();
 	bool PrepareAccept();
+	bool GetRxBuffers();
 	bool StartReceiving(DWORD flags);
-	int OnConnection();
-	int OnDataReceived(Buffer** ppRxBuffer);
+	void ReleaseRxBuffers();
+	bool IsTxBatchFull();
+	bool KeepInScrollback(const Buffer* pBuffer);
+	std::span<const Buffer*> GetReplayBuffers();
+	Lib::Task ConnectionLoop();
+	Lib::Task SendLoop();
+	void ReportConnection();
 	void Cleanup();
 
 	// The value of dwLocalAddressLength and dwRemoteAddressLength
 	// for the AcceptEx call (as prescribed in the doc)
-	static constexpr size_t cAcceptAddressSize{ sizeof(SOCKADDR_IN) + 16 };
+	static constexpr size_t cAcceptAddressSize{ std::max(sizeof(SOCKADDR_IN), sizeof(SOCKADDR_UN)) + 16 };
 
 	// The accept buffer must accommodate at least two address structures.
 	// We will not receive the initial client data, so this is enough.
 	static constexpr size_t cAcceptBufferSize{ 2 * cAcceptAddressSize };
 
+	// The maximum number of pool buffers filled by one receive
+	static constexpr uint cMaxRxChunks{ 16 };
+
+	// How often a receive that has no pool buffers tries again
+	static constexpr auto cRxRetryInterval{ 10ms };
+
+	// The maximum number of queued buffers sent by one send
+	static constexpr uint cMaxTxBuffers{ 64 };
+
+	static constexpr uint64_t cNotFrozen{ std::numeric_limits<uint64_t>::max() };
+
 	SOCKET m_socketListen{ INVALID_SOCKET };
 	SOCKET m_socketData{ INVALID_SOCKET };
 	OVERLAPPED m_ovListen{};
 	OVERLAPPED m_ovReceive{};
 	OVERLAPPED m_ovSend{};
 	std::array<uint8_t, cAcceptBufferSize> m_acceptBuffer{};
-	WSABUF m_rxWsaBuf{};
-	WSABUF m_txWsaBuf{};
+	std::array<Buffer*, cMaxRxChunks> m_rxBuffers{};
+	std::array<WSABUF, cMaxRxChunks> m_rxWsaBufs{};
+	uint m_numRxBuffers{};
+	std::array<WSABUF, cMaxTxBuffers> m_txWsaBufs{};
+	Lib::HistoryRing<const Buffer*> m_scrollback;
+	std::array<const Buffer*, cMaxTxBuffers> m_replayBuffers{};
+	uint64_t m_replayPosition{};		// of the next scrollback buffer to send
+	uint64_t m_freezePosition{ cNotFrozen };	// where the scrollback stops
+	bool m_isReplaying{};				// the send loop sends the scrollback
+	Lib::SizeHistogram m_rxSizes;
+	EventTimer m_coalesceTimer;
+	EventTimer m_rxRetryTimer;
+	uint64_t m_numRxRetries{};			// of receives that waited for buffers
+	std::chrono::microseconds m_coalesceWindow{};
+	size_t m_coalesceSize{};
+	bool m_isCoalescing{};				// the send loop waits for the timer
+	uint64_t m_numSends{};
+	uint64_t m_numSentBuffers{};
+	uint64_t m_numSentBytes{};
 
-	uint16_t m_port;
+	uint16_t m_port{};
+	std::string_view m_socketPath;		// empty for TCP
+	std::string m_endpoint;				// description for messages
 	bool m_isConnected{};
+	Lib::Task m_connectionTask;
+	Lib::Task m_sendTask;
 };
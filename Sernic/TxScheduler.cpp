@@ -0,0 +1,209 @@
+#include "TxScheduler.h"
+#include <cassert>
+#include "Log.h"
+
+
+TxScheduler::TxScheduler(const uint numBuffers, const uint gdbWeight)
+	: m_entries(std::bit_ceil(numBuffers) * cNumSources)
+{
+	const size_t queueSize{ m_entries.size() / cNumSources };
+
+	for (uint index{}; index < cNumSources; ++index)
+		m_sources[index].queue.SetBuffer(std::span{ m_entries }.subspan(index * queueSize, queueSize));
+
+	m_sources[(uint)TxSource::Gdb].weight = gdbWeight;
+}
+
+
+// Queues a buffer. Returns false if the source's queue is full.
+//
+bool TxScheduler::Push(const TxSource source, const Buffer* pBuffer)
+{
+	return m_sources[(uint)source].queue.Enqueue({ pBuffer, Clock::now() });
+}
+
+
+// Returns the buffer to be sent next, or nullptr if there is none
+// (or only other data while a gdb packet is unfinished).
+// The caller must send the buffer and call Pop.
+//
+const Buffer* TxScheduler::Front()
+{
+	m_selectedSource = SelectSource();
+
+	if (m_selectedSource == cNumSources)
+		return nullptr;
+
+	return m_sources[m_selectedSource].queue.Front()->pBuffer;
+}
+
+
+// Dequeues the buffer returned by Front
+//
+void TxScheduler::Pop()
+{
+	assert(m_selectedSource < cNumSources);
+
+	auto& source{ m_sources[m_selectedSource] };
+	Entry* pEntry{ source.queue.Front() };
+	auto data{ pEntry->pBuffer->GetData() };
+
+	source.deficit -= (int)data.size();
+
+	auto delay{ Clock::now() - pEntry->queueTime };
+	source.delays.Add((size_t)std::chrono::duration_cast<std::chrono::microseconds>(delay).count());
+	source.maxDelay = std::max(source.maxDelay, delay);
+
+	if (m_selectedSource == (uint)TxSource::Gdb)
+		TrackGdbPacket(data);
+
+	source.queue.Pop();
+	m_selectedSource = cNumSources;
+}
+
+
+// Returns the number of buffers queued by all the sources
+//
+uint TxScheduler::GetNumQueued() const
+{
+	uint numQueued{};
+
+	for (const auto& source : m_sources)
+		numQueued += source.queue.GetNumUsedBlocks();
+
+	return numQueued;
+}
+
+
+// Returns how long the queued data of the other sources is still held
+// for an unfinished gdb packet, or 0 if none is held
+//
+std::chrono::microseconds TxScheduler::GetHoldTime() const
+{
+	constexpr uint cGdb{ (uint)TxSource::Gdb };
+
+	if (m_gdbPacketState == GdbPacketState::Idle || GetNumQueued() == m_sources[cGdb].queue.GetNumUsedBlocks())
+		return {};
+
+	auto holdTime{ std::chrono::ceil<std::chrono::microseconds>(m_gdbPacketTime + cGdbPacketTimeout - Clock::now()) };
+
+	return std::max(holdTime, std::chrono::microseconds{ 1 });
+}
+
+
+// Logs the queueing delay of each source that sent data
+//
+void TxScheduler::PrintStats(const std::string_view name) const
+{
+	constexpr std::array cSourceNames{ "gdb"sv, "console"sv, "raw"sv, "shm"sv };
+	static_assert(cSourceNames.size() == cNumSources);
+
+	for (uint index{}; index < cNumSources; ++index)
+	{
+		const auto& delays{ m_sources[index].delays };
+
+		if (delays.GetNumSamples() == 0)
+			continue;
+
+		LogLine line{ LogInfo() };
+		line << name << " " << cSourceNames[index] << " TX delay: " << delays.GetNumSamples() << " buffers, average "
+			<< delays.GetTotalSize() / delays.GetNumSamples() << " us, max "
+			<< std::chrono::duration_cast<std::chrono::microseconds>(m_sources[index].maxDelay).count() << " us, us:";
+		delays.Print(line.GetStream());
+	}
+}
+
+
+// Returns the index of the source whose front buffer is sent next,
+// or cNumSources if nothing can be sent.
+//
+uint TxScheduler::SelectSource()
+{
+	constexpr uint cGdb{ (uint)TxSource::Gdb };
+
+	if (IsHoldingGdbPacket())
+		return m_sources[cGdb].queue.Front() ? cGdb : cNumSources;
+
+	if (m_sources[cGdb].weight == cStrictPriority && m_sources[cGdb].queue.Front())
+		return cGdb;
+
+	// Deficit round robin: a source gets weight * cQuantum bytes at the start
+	// of its turn and keeps the turn while its front buffer fits in the
+	// deficit. A source with an empty queue loses its deficit.
+	// Every source is visited at most twice (the current one may be out
+	// of deficit and get a new turn after the others).
+
+	for (uint step{}; step <= cNumSources; ++step)
+	{
+		auto& source{ m_sources[m_turn] };
+
+		if (Entry* pEntry{ source.queue.Front() }; pEntry && source.weight != cStrictPriority)
+		{
+			if (!m_isTurnStarted)
+			{
+				source.deficit += (int)source.weight * cQuantum;
+				m_isTurnStarted = true;
+			}
+
+			if (source.deficit >= (int)pEntry->pBuffer->GetDataSize())
+				return m_turn;
+		}
+		else
+			source.deficit = 0;
+
+		m_turn = (m_turn + 1) % cNumSources;
+		m_isTurnStarted = false;
+	}
+
+	return cNumSources;
+}
+
+
+// Returns true if a gdb packet has been sent in part and nothing else may be
+// sent until its end. Gives up on the packet if gdb doesn't continue it in time.
+//
+bool TxScheduler::IsHoldingGdbPacket()
+{
+	if (m_gdbPacketState == GdbPacketState::Idle)
+		return false;
+
+	if (m_sources[(uint)TxSource::Gdb].queue.Front() || Clock::now() - m_gdbPacketTime < cGdbPacketTimeout)
+		return true;
+
+	m_gdbPacketState = GdbPacketState::Idle;
+
+	return false;
+}
+
+
+// Follows the gdb packets ($data#xx) in the data sent from the gdb channel.
+// '#' is always escaped in the packet data, so it marks the checksum.
+//
+void TxScheduler::TrackGdbPacket(const std::span<const uint8_t> data)
+{
+	for (uint8_t byte : data)
+	{
+		switch (m_gdbPacketState)
+		{
+		case GdbPacketState::Idle:
+			if (byte == '$')
+				m_gdbPacketState = GdbPacketState::Data;
+			break;
+
+		case GdbPacketState::Data:
+			if (byte == '#')
+				m_gdbPacketState = GdbPacketState::Checksum1;
+			break;
+
+		case GdbPacketState::Checksum1:
+			m_gdbPacketState = GdbPacketState::Checksum2;
+			break;
+
+		case GdbPacketState::Checksum2:
+			m_gdbPacketState = GdbPacketState::Idle;
+			break;
+		}
+	}
+
+	m_gdbPacketTime = Clock::now();
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "Lib/BlockQueue.h"
+#include "Lib/SizeHistogram.h"
+#include "Buffers.h"
+#include "IClient.h"
+
+
+// Queues the data sent to the serial port separately for each source
+// channel and decides which buffer goes out next:
+//
+// - gdb data has strict priority (weight cStrictPriority), or shares
+//   the port with the other sources by weight
+// - the other sources share the port equally, by deficit round robin
+//   (in bytes, so a source sending large buffers doesn't get more)
+// - once the start of a gdb packet ($...#xx) has been sent, no other data
+//   is sent until the end of the packet, unless gdb doesn't send the rest
+//   within cGdbPacketTimeout
+//
+// The time each buffer spends in the queue is recorded per source.
+// Not thread-safe.
+//
+class TxScheduler : NonCopyable
+{
+public:
+	static constexpr uint cStrictPriority{ 0 };
+	static constexpr auto cGdbPacketTimeout{ 100ms };
+
+	// Each source can queue numBuffers buffers
+	TxScheduler(uint numBuffers, uint gdbWeight);
+
+	// Queues a buffer. Returns false if the source's queue is full.
+	bool Push(TxSource source, const Buffer* pBuffer);
+
+	// Returns the buffer to be sent next, or nullptr if there is none.
+	// The caller must send the buffer and call Pop.
+	const Buffer* Front();
+
+	// Dequeues the buffer returned by Front
+	void Pop();
+
+	// Returns the number of buffers queued by all the sources
+	uint GetNumQueued() const;
+
+	// Returns how long the queued data of the other sources is still held
+	// for an unfinished gdb packet, or 0 if none is held. Front releases it
+	// when called after that time.
+	std::chrono::microseconds GetHoldTime() const;
+
+	// Logs the queueing delay of each source that sent data
+	void PrintStats(std::string_view name) const;
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	static constexpr uint cNumSources{ (uint)TxSource::_NumSources };
+	static constexpr int cQuantum{ (int)cBufferSize };		// bytes per turn and unit of weight
+
+	enum class GdbPacketState
+	{
+		Idle,
+		Data,				// after '$'
+		Checksum1,			// after '#'
+		Checksum2
+	};
+
+	struct Entry
+	{
+		const Buffer* pBuffer;
+		Clock::time_point queueTime;
+	};
+
+	struct Source
+	{
+		Lib::BlockQueue<Entry, 1> queue;
+		uint weight{ 1 };
+		int deficit{};						// bytes the source may still send in its turn
+		Lib::SizeHistogram delays;			// in us
+		Clock::duration maxDelay{};
+	};
+
+	uint SelectSource();
+	bool IsHoldingGdbPacket();
+	void TrackGdbPacket(std::span<const uint8_t> data);
+
+	std::vector<Entry> m_entries;			// space for all the queues
+	std::array<Source, cNumSources> m_sources;
+	uint m_turn{};							// the source whose round robin turn it is
+	bool m_isTurnStarted{};					// the source has got its quantum for this turn
+	uint m_selectedSource{ cNumSources };	// set by Front
+	GdbPacketState m_gdbPacketState{ GdbPacketState::Idle };
+	Clock::time_point m_gdbPacketTime;		// when the gdb packet was last continued
+};
@@ -0,0 +1,256 @@
+#include "UdpClient.h"
+#include <WS2tcpip.h>	// after UdpClient.h because it includes WinSock2.h
+#include "IFilter.h"
+#include "Log.h"
+
+
+static_assert(cBufferSize <= cMaxMulticastDataSize, "A pool buffer must fit in a datagram");
+
+
+namespace
+{
+	constexpr uint cNumTxBuffers{ 256 };
+
+	enum class EventType
+	{
+		DataSent,
+		CoalesceTimer,
+		_NumEvents
+	};
+}
+
+
+UdpClient::UdpClient(
+		std::string_view name,
+		std::string_view address,
+		uint16_t port,
+		BufferPool& bufferPool,
+		std::unique_ptr<IFilter> pTxFilter)
+	: BaseClient{ name, bufferPool, cNumTxBuffers, std::move(pTxFilter) }
+	, m_addressText{ address }
+	, m_port{ port }
+	, m_endpoint{ std::string{ address } + ":" + std::to_string(port) }
+{
+}
+
+
+UdpClient::~UdpClient()
+{
+	if (m_sequence > 0)
+	{
+		LogInfo() << m_name << " sent " << m_numSentBytes << " bytes from " << m_numSentBuffers << " buffers in "
+				<< m_sequence << " datagrams, " << m_numFailedSends << " failed";
+	}
+
+	Cleanup();
+}
+
+
+void UdpClient::Cleanup()
+{
+	if (m_socket != INVALID_SOCKET)
+	{
+		closesocket(m_socket);
+		m_socket = INVALID_SOCKET;
+	}
+
+	if (m_ovSend.hEvent)
+	{
+		WSACloseEvent(m_ovSend.hEvent);
+		m_ovSend.hEvent = NULL;
+	}
+
+	m_coalesceTimer.Close();
+}
+
+
+uint UdpClient::Open(std::span<WSAEVENT> events)
+{
+	m_address.sin_family = AF_INET;
+	m_address.sin_port = htons(m_port);
+
+	if (inet_pton(AF_INET, m_addressText.c_str(), &m_address.sin_addr) != 1)
+	{
+		LogError() << "Invalid address for " << m_name << ": " << m_addressText;
+		return 0;
+	}
+
+	m_socket = WSASocketW(
+			AF_INET,
+			SOCK_DGRAM,
+			IPPROTO_UDP,
+			NULL,	// lpProtocolInfo
+			0,		// group
+			WSA_FLAG_OVERLAPPED);
+
+	if (m_socket == INVALID_SOCKET)
+	{
+		LogError() << "Failed to create UDP socket";
+		return 0;
+	}
+
+	if (IN_MULTICAST(ntohl(m_address.sin_addr.s_addr)))
+	{
+		// The receivers on this machine get the datagrams too
+
+		int value{ cMulticastTtl };
+		setsockopt(m_socket, IPPROTO_IP, IP_MULTICAST_TTL, (const char*)&value, sizeof value);
+
+		value = 1;
+		setsockopt(m_socket, IPPROTO_IP, IP_MULTICAST_LOOP, (const char*)&value, sizeof value);
+	}
+
+	m_ovSend.hEvent = WSACreateEvent();
+	events[(int)EventType::DataSent] = m_ovSend.hEvent;
+
+	if (!m_coalesceTimer.Create())
+	{
+		LogError() << "Failed to create timer for " << m_name;
+		return 0;
+	}
+
+	events[(int)EventType::CoalesceTimer] = m_coalesceTimer.GetEvent();
+
+	m_sendTask = SendLoop();
+
+	if (!m_sendTask)
+	{
+		LogError() << "No memory for " << m_name << " coroutines";
+		return 0;
+	}
+
+	LogInfo() << m_name << " sending to " << m_endpoint;
+
+	return (uint)EventType::_NumEvents;
+}
+
+
+// Returns the queued buffers that go in the next datagram: as many as fit
+// in cMaxMulticastDataSize, up to cMaxDatagramBuffers
+//
+std::span<const Buffer*> UdpClient::GetDatagramBuffers()
+{
+	auto txBuffers{ m_txQueue.FrontN(cMaxDatagramBuffers) };
+	size_t numBuffers{};
+	size_t size{};
+
+	while (numBuffers < txBuffers.size() && size + txBuffers[numBuffers]->GetDataSize() <= cMaxMulticastDataSize)
+		size += txBuffers[numBuffers++]->GetDataSize();
+
+	return txBuffers.first(numBuffers);
+}
+
+
+// Returns true if the queued data fills a datagram, so coalescing is over
+//
+bool UdpClient::IsDatagramFull()
+{
+	size_t numBuffers{ GetDatagramBuffers().size() };
+
+	return numBuffers == cMaxDatagramBuffers || m_txQueue.FrontN(numBuffers + 1).size() > numBuffers;
+}
+
+
+// The data (filtered, if the channel has a filter) goes to the send queue.
+// While the send loop is coalescing, the timer is fired at once when
+// a datagram is full.
+//
+bool UdpClient::Send(const Buffer* pBuffer)
+{
+	bool isOk{ QueueSend(pBuffer) };
+
+	if (m_isCoalescing && IsDatagramFull())
+		m_coalesceTimer.Start({});
+
+	return isOk;
+}
+
+
+// Sends the queued buffers in datagrams, each one with one gathering send
+// of the header and the buffers. The buffers stay in the queue until the
+// send completes.
+//
+// Data queued while the loop is idle waits up to cMulticastCoalesceWindow
+// for more data to fill the datagram, so the receivers get fewer and
+// larger datagrams. Data queued while a send is in progress goes out with
+// the next send anyway.
+//
+// A send that fails is counted and its data is lost, the receivers see
+// the gap in the sequence numbers.
+//
+Lib::Task UdpClient::SendLoop()
+{
+	for (;;)
+	{
+		std::span<const Buffer*> txBuffers{ GetDatagramBuffers() };
+
+		if (txBuffers.empty())
+		{
+			co_await WaitForTxData();
+
+			if (!m_txQueue.FrontN(1).empty() && !IsDatagramFull())
+			{
+				m_isCoalescing = true;
+				m_coalesceTimer.Start(cMulticastCoalesceWindow);
+
+				co_await WaitForEvent((uint)EventType::CoalesceTimer);
+
+				m_coalesceTimer.Stop();
+				m_isCoalescing = false;
+			}
+
+			continue;
+		}
+
+		m_header = { .magic = cMulticastMagic, .sequence = m_sequence++ };
+
+		for (size_t i{}; i < txBuffers.size(); ++i)
+		{
+			m_txWsaBufs[i + 1].buf = (char*)txBuffers[i]->GetBufferPtr();
+			m_txWsaBufs[i + 1].len = (ULONG)txBuffers[i]->GetDataSize();
+			m_header.dataSize += m_txWsaBufs[i + 1].len;
+		}
+
+		m_txWsaBufs[0].buf = (char*)&m_header;
+		m_txWsaBufs[0].len = (ULONG)sizeof(m_header);
+
+		DWORD bytesSent;
+		bool isSent{ true };
+
+		if (WSASendTo(
+				m_socket,
+				m_txWsaBufs.data(),
+				(DWORD)txBuffers.size() + 1,
+				&bytesSent,
+				0,		// flags
+				(const sockaddr*)&m_address,
+				sizeof m_address,
+				&m_ovSend,
+				NULL	// completion routine
+			) == SOCKET_ERROR && WSAGetLastError() != ERROR_IO_PENDING)
+		{
+			isSent = false;
+		}
+		else
+		{
+			co_await WaitForEvent((uint)EventType::DataSent);
+			WSAResetEvent(m_ovSend.hEvent);
+
+			DWORD flags;
+			isSent = WSAGetOverlappedResult(m_socket, &m_ovSend, &bytesSent, FALSE, &flags);
+		}
+
+		if (isSent)
+		{
+			m_numSentBuffers += txBuffers.size();
+			m_numSentBytes += m_header.dataSize;
+		}
+		else if (m_numFailedSends++ == 0)
+			LogMessage(Log::Level::Warning, "Failed to send to ", m_name, " ", m_endpoint, ", error ", WSAGetLastError());
+
+		for (const Buffer* pBuffer : txBuffers)
+			m_bufferPool.PutBuffer(pBuffer);
+
+		m_txQueue.PopN((uint)txBuffers.size());
+	}
+}
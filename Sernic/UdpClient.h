@@ -0,0 +1,60 @@
+#pragma once
+
+#include "BaseClient.h"
+#include "MulticastDatagram.h"
+#include "EventTimer.h"
+
+struct IFilter;
+
+
+// Channel that sends the data to a UDP address, for any number of passive
+// receivers: a multicast group, or a single address such as 127.0.0.1 for
+// a test. The data is sent in sequenced datagrams (see MulticastDatagram.h),
+// several pool buffers in each, and nothing is received.
+//
+class UdpClient : public BaseClient
+{
+public:
+	// Sends to the IPv4 address (text, e.g. "239.0.0.1") and port
+	explicit UdpClient(
+			std::string_view name,
+			std::string_view address,
+			uint16_t port,
+			BufferPool& bufferPool,
+			std::unique_ptr<IFilter> pTxFilter = {});
+	~UdpClient();
+
+protected:
+	bool Send(const Buffer* pBuffer) override;
+
+private:
+	uint Open(std::span<WSAEVENT> events) override;
+
+	std::span<const Buffer*> GetDatagramBuffers();
+	bool IsDatagramFull();
+	Lib::Task SendLoop();
+	void Cleanup();
+
+	// The maximum number of queued buffers sent in one datagram
+	static constexpr uint cMaxDatagramBuffers{ 32 };
+
+	// Multicast datagrams stay on the local network
+	static constexpr int cMulticastTtl{ 1 };
+
+	SOCKET m_socket{ INVALID_SOCKET };
+	OVERLAPPED m_ovSend{};
+	sockaddr_in m_address{};
+	MulticastHeader m_header{};						// of the datagram being sent
+	std::array<WSABUF, 1 + cMaxDatagramBuffers> m_txWsaBufs{};
+	EventTimer m_coalesceTimer;
+	bool m_isCoalescing{};							// the send loop waits for the timer
+	uint64_t m_sequence{};							// of the next datagram
+	uint64_t m_numSentBuffers{};
+	uint64_t m_numSentBytes{};
+	uint64_t m_numFailedSends{};
+
+	std::string m_addressText;						// null-terminated for inet_pton
+	uint16_t m_port;
+	std::string m_endpoint;							// description for messages
+	Lib::Task m_sendTask;
+};
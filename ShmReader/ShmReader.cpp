@@ -0,0 +1,108 @@
+#include <csignal>
+#include "ShmChannel.h"
+
+
+// Benchmark consumer of a Sernic shared memory channel (option -m).
+// Reads the serial data in place and prints the data rate, the number of
+// wake-ups and the CPU time used once per second.
+//
+namespace
+{
+	volatile std::sig_atomic_t g_isRunning{ 1 };
+
+	void Usage()
+	{
+		std::cout << "Usage:\n\n";
+		std::cout << "ShmReader shmName [-d]\n\n";
+		std::cout << "where\n";
+		std::cout << "\tshmName - name of the channel given to Sernic with the -m option\n";
+		std::cout << "\t-d - write the data to stdout (the statistics go to stderr)\n";
+	}
+
+
+	// Returns the CPU time (user and kernel) used by the process, in ms
+	//
+	double GetCpuTime()
+	{
+		FILETIME creationTime, exitTime, kernelTime, userTime;
+
+		if (!GetProcessTimes(GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime))
+			return 0;
+
+		auto toMs = [](const FILETIME& time) { return (((uint64_t)time.dwHighDateTime << 32) | time.dwLowDateTime) / 10'000.0; };
+
+		return toMs(kernelTime) + toMs(userTime);
+	}
+}
+
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2 || argc > 3 || (argc == 3 && argv[2] != "-d"sv))
+	{
+		Usage();
+		return -1;
+	}
+
+	const bool isDumping{ argc == 3 };
+
+	ShmChannel channel;
+
+	if (!channel.Open(argv[1]))
+	{
+		std::cerr << "Failed to open shared memory channel " << argv[1] << " (is Sernic running with -m?)" << std::endl;
+		return -1;
+	}
+
+	std::signal(SIGINT, [](int) { g_isRunning = 0; });
+
+	uint64_t numBytes{};
+	uint64_t numBlocks{};
+	uint64_t numWakeUps{};
+	auto reportTime{ std::chrono::steady_clock::now() };
+	double cpuTime{ GetCpuTime() };
+
+	std::cerr << std::fixed << std::setprecision(2);
+
+	while (g_isRunning)
+	{
+		if (channel.WaitForInput(100))
+		{
+			++numWakeUps;
+
+			// Take everything that is in the ring
+
+			for (auto data{ channel.Peek() }; !data.empty(); data = channel.Peek())
+			{
+				numBytes += data.size();
+				++numBlocks;
+
+				if (isDumping)
+					std::cout.write((const char*)data.data(), data.size());
+
+				channel.Pop();
+			}
+		}
+
+		auto now{ std::chrono::steady_clock::now() };
+		std::chrono::duration<double> seconds{ now - reportTime };
+
+		if (seconds.count() >= 1)
+		{
+			double newCpuTime{ GetCpuTime() };
+
+			std::cerr << numBytes / seconds.count() / 1024 << " KB/s, "
+					<< numBlocks << " blocks, "
+					<< numWakeUps << " wake-ups, CPU "
+					<< (newCpuTime - cpuTime) / seconds.count() << " ms/s\n";
+
+			numBytes = 0;
+			numBlocks = 0;
+			numWakeUps = 0;
+			reportTime = now;
+			cpuTime = newCpuTime;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,208 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#include "Lib/AllocationAudit.h"
+#include "GdbOutputFilter.h"
+#include "LocalClient.h"
+#include "Runner.h"
+#include "Log.h"
+
+
+namespace
+{
+	// Serial data with console text and gdb packets, as the filters see it
+	constexpr std::array cSerialData
+	{
+		"[   12.345678] console text\r\n"sv,
+		"$T05thread:01;#07"sv,
+		"+$OK#9a"sv,
+		"more text and $partial"sv,
+		" packet#00 after\r\n"sv
+	};
+
+	void CopyTo(Buffer* pBuffer, const std::string_view text)
+	{
+		std::copy(text.begin(), text.end(), pBuffer->GetBufferPtr());
+		pBuffer->SetDataSize(text.size());
+	}
+
+
+	// A serial port that receives cSerialData over and over. It counts the
+	// allocations made on the runner's thread between the warm-up and the
+	// last buffer.
+	//
+	class FakeSerialClient : public IClient
+	{
+	public:
+		static constexpr uint cNumWarmUpBuffers{ 100 };
+		static constexpr uint cNumBuffers{ 10000 };
+
+		explicit FakeSerialClient(BufferPool& bufferPool)
+			: m_bufferPool{ bufferPool }
+		{
+		}
+
+		~FakeSerialClient()
+		{
+			if (m_event != WSA_INVALID_EVENT)
+				WSACloseEvent(m_event);
+		}
+
+		uint Open(std::span<WSAEVENT> events) override
+		{
+			m_event = WSACreateEvent();
+			WSASetEvent(m_event);
+			events[0] = m_event;
+
+			return 1;
+		}
+
+		int ProcessEvent(uint index, Buffer** ppRxBuffer) override
+		{
+			if (m_numReceived == cNumWarmUpBuffers)
+				m_allocationAudit.NextPhase();		// on the runner's thread
+
+			if (m_numReceived == cNumBuffers)
+			{
+				m_numAllocations = m_allocationAudit.GetCount();
+				m_isDone.store(true, std::memory_order_release);
+				WSAResetEvent(m_event);
+
+				return 0;
+			}
+
+			Buffer* pBuffer{ m_bufferPool.GetBuffer() };
+
+			if (!pBuffer)
+				return -1;
+
+			CopyTo(pBuffer, cSerialData[m_numReceived++ % cSerialData.size()]);
+			*ppRxBuffer = pBuffer;
+
+			return (int)pBuffer->GetDataSize();
+		}
+
+		bool Send(const Buffer* pBuffer) override
+		{
+			m_numSentBytes += pBuffer->GetDataSize();
+			m_bufferPool.PutBuffer(pBuffer);
+
+			return true;
+		}
+
+		std::atomic<bool> m_isDone{};
+		uint64_t m_numAllocations{};
+		uint64_t m_numSentBytes{};
+
+	private:
+		BufferPool& m_bufferPool;
+		WSAEVENT m_event{ WSA_INVALID_EVENT };
+		uint m_numReceived{};
+		Lib::AllocationAudit m_allocationAudit;
+	};
+}
+
+
+namespace Test1
+{
+	TEST_CLASS(AllocationAuditTest)
+	{
+	public:
+
+		TEST_METHOD(CountsAllocations)
+		{
+			Lib::AllocationAudit allocationAudit;
+
+			auto pValue{ std::make_unique<int>(1) };
+			Assert::AreEqual(1ull, (unsigned long long)allocationAudit.NextPhase());
+
+			pValue.reset();
+			Assert::AreEqual(0ull, (unsigned long long)allocationAudit.GetCount());
+		}
+
+		TEST_METHOD(FilterDoesNotAllocate)
+		{
+			BufferPool bufferPool{ 64 };
+			GdbOutputFilter filter{ bufferPool };
+
+			auto filterAll{ [&](const uint numBuffers)
+				{
+					for (uint n{}; n < numBuffers; ++n)
+					{
+						Buffer* pBuffer{ bufferPool.GetBuffer() };
+						CopyTo(pBuffer, cSerialData[n % cSerialData.size()]);
+
+						for (uint numResults{ filter.Process(pBuffer) }; numResults > 0; --numResults)
+							bufferPool.PutBuffer(filter.GetResult());
+					}
+				} };
+
+			filterAll(100);
+
+			Lib::AllocationAudit allocationAudit;
+			filterAll(10000);
+
+			Assert::AreEqual(0ull, (unsigned long long)allocationAudit.GetCount());
+		}
+
+		TEST_METHOD(LoggingDoesNotAllocate)
+		{
+			std::ostringstream text;
+			auto* pCoutBuffer{ std::cout.rdbuf(text.rdbuf()) };
+			uint64_t numAllocations{};
+
+			{
+				LogWriter writer;
+				LogInfo() << "First message of the thread";
+
+				Lib::AllocationAudit allocationAudit;
+
+				for (uint n{}; n < Log::cMaxRepeats; ++n)
+					LogInfo() << "Message " << n << " of " << std::fixed << std::setprecision(1) << 1.5;
+
+				numAllocations = allocationAudit.GetCount();
+			}
+
+			std::cout.rdbuf(pCoutBuffer);
+
+			Assert::AreEqual(0ull, (unsigned long long)numAllocations);
+		}
+
+		TEST_METHOD(ForwardingDoesNotAllocate)
+		{
+			BufferPool bufferPool{ 256 };
+			FakeSerialClient serialClient{ bufferPool };
+			uint64_t numReceivedBytes{};
+
+			auto onData{ [&numReceivedBytes](std::span<const uint8_t> data) { numReceivedBytes += data.size(); } };
+
+			LocalClient consoleClient{ "Console"sv, bufferPool, onData, std::make_unique<GdbOutputFilter>(bufferPool) };
+			LocalClient gdbClient{ "GDB"sv, bufferPool, onData };
+			LocalClient rawClient{ "Raw"sv, bufferPool, onData };
+			Runner runner{ serialClient, &consoleClient, &gdbClient, &rawClient, nullptr };
+
+			std::thread thread{ [&runner] { runner.Run(); } };
+
+			// The channels send data to the serial port meanwhile
+
+			constexpr auto cCommand{ "$m80000000,4#c1"sv };
+			const std::span<const uint8_t> command{ (const uint8_t*)cCommand.data(), cCommand.size() };
+
+			while (!serialClient.m_isDone.load(std::memory_order_acquire))
+			{
+				consoleClient.Write(command);
+				gdbClient.Write(command);
+				std::this_thread::yield();
+			}
+
+			runner.Close();
+			thread.join();
+
+			Assert::IsTrue(numReceivedBytes > 0);
+			Assert::IsTrue(serialClient.m_numSentBytes > 0);
+			Assert::AreEqual(0ull, (unsigned long long)serialClient.m_numAllocations);
+		}
+	};
+}
@@ -0,0 +1,183 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#include "Lib/BlockQueue.h"
+#include "Lib/MpscBlockQueue.h"
+
+
+namespace
+{
+	constexpr uint cNumItems{ 1'000'000 };
+}
+
+
+namespace Test1
+{
+	TEST_CLASS(BlockQueueTest)
+	{
+	public:
+
+		TEST_METHOD(SingleBlocks)
+		{
+			Lib::BlockQueue<uint, 1> queue{ 6 };	// rounded up to 8
+
+			Assert::AreEqual(queue.GetNumBlocks(), 8U);
+
+			for (uint i{}; i < 8; ++i)
+				Assert::IsTrue(queue.Enqueue(i));
+
+			Assert::IsFalse(queue.Enqueue(8));
+			Assert::AreEqual(queue.GetNumFreeBlocks(), 0U);
+
+			uint value{};
+
+			for (uint i{}; i < 5; ++i)
+				Assert::IsTrue(queue.Dequeue(&value) && value == i);
+
+			for (uint i{ 8 }; i < 13; ++i)
+				Assert::IsTrue(queue.Enqueue(i));
+
+			for (uint i{ 5 }; i < 13; ++i)
+				Assert::IsTrue(queue.Dequeue(&value) && value == i);
+
+			Assert::IsFalse(queue.Dequeue(&value));
+		}
+
+		TEST_METHOD(BlockRuns)
+		{
+			Lib::BlockQueue<uint, 2> queue{ 8 };
+			const std::array<uint, 10> items{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+			std::array<uint, 16> result{};
+
+			// Move the indices so the next runs wrap around the end
+
+			Assert::AreEqual(queue.EnqueueN(items), 5U);
+			Assert::AreEqual(queue.DequeueN(std::span{ result }.first(10)), 5U);
+
+			Assert::AreEqual(queue.EnqueueN(items), 5U);
+			Assert::AreEqual(queue.EnqueueN(items), 3U);	// queue full
+
+			// The contiguous span ends at the end of the buffer
+
+			auto front{ queue.FrontN(8) };
+			Assert::IsTrue(front.size() == 3 * 2);
+			Assert::IsTrue(std::equal(front.begin(), front.end(), items.begin()));
+			queue.PopN(3);
+
+			Assert::AreEqual(queue.DequeueN(result), 5U);
+			Assert::IsTrue(std::equal(items.begin() + 6, items.end(), result.begin()));
+			Assert::IsTrue(std::equal(items.begin(), items.begin() + 6, result.begin() + 4));
+
+			auto back{ queue.BackN(8) };
+			Assert::IsTrue(back.size() == 3 * 2);
+			queue.PushN(1);
+			Assert::AreEqual(queue.GetNumUsedBlocks(), 1U);
+		}
+
+		TEST_METHOD(SingleWriterThread)
+		{
+			Lib::BlockQueue<uint, 1> queue{ 256 };
+
+			std::thread writer{ [&queue]
+			{
+				std::array<uint, 16> items;
+
+				for (uint next{}; next < cNumItems;)
+				{
+					uint numItems{ std::min(cNumItems - next, (uint)items.size()) };
+
+					for (uint i{}; i < numItems; ++i)
+						items[i] = next + i;
+
+					uint numCopied{ queue.EnqueueN(std::span{ items }.first(numItems)) };
+
+					if (numCopied == 0)
+						std::this_thread::yield();
+
+					next += numCopied;
+				}
+			} };
+
+			uint expected{};
+			bool isOk{ true };
+
+			while (expected < cNumItems && isOk)
+			{
+				auto items{ queue.FrontN(32) };
+
+				if (items.empty())
+					std::this_thread::yield();
+
+				for (uint item : items)
+					isOk &= item == expected++;
+
+				queue.PopN((uint)items.size());
+			}
+
+			writer.join();
+
+			Assert::IsTrue(isOk);
+		}
+
+		TEST_METHOD(ManyWriterThreads)
+		{
+			constexpr uint cNumWriters{ 3 };
+			Lib::MpscBlockQueue<uint, 1> queue{ 256 };
+			std::vector<std::thread> writers;
+
+			// Each writer sends its index in the top bits and a sequence number in the rest
+
+			for (uint writer{}; writer < cNumWriters; ++writer)
+			{
+				writers.emplace_back([&queue, writer]
+				{
+					std::array<uint, 4> items;
+
+					for (uint next{}; next < cNumItems;)
+					{
+						uint numItems{ std::min(cNumItems - next, (uint)items.size()) };
+
+						for (uint i{}; i < numItems; ++i)
+							items[i] = writer << 24 | (next + i);
+
+						uint numCopied{ queue.EnqueueN(std::span{ items }.first(numItems)) };
+
+						if (numCopied == 0)
+							std::this_thread::yield();
+
+						next += numCopied;
+					}
+				});
+			}
+
+			std::array<uint, cNumWriters> expected{};
+			uint numReceived{};
+			bool isOk{ true };
+
+			while (numReceived < cNumWriters * cNumItems && isOk)
+			{
+				auto items{ queue.FrontN(32) };
+
+				if (items.empty())
+					std::this_thread::yield();
+
+				for (uint item : items)
+				{
+					uint writer{ item >> 24 };
+					isOk &= writer < cNumWriters && (item & 0xffffff) == expected[writer]++;
+				}
+
+				numReceived += (uint)items.size();
+				queue.PopN((uint)items.size());
+			}
+
+			for (auto& writer : writers)
+				writer.join();
+
+			Assert::IsTrue(isOk);
+			Assert::AreEqual(queue.GetNumUsedBlocks(), 0U);
+		}
+	};
+}
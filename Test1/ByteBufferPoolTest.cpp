@@ -0,0 +1,88 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#include "Buffers.h"
+
+
+namespace Test1
+{
+	TEST_CLASS(ByteBufferPoolTest)
+	{
+	public:
+
+		TEST_METHOD(CountsReferences)
+		{
+			BufferPool bufferPool{ 2 };
+			Buffer* pBuffer{ bufferPool.GetBuffer() };
+
+			bufferPool.AddRef(pBuffer);
+			bufferPool.PutBuffer(pBuffer);
+			Assert::AreEqual((size_t)1, bufferPool.GetNumFree());
+
+			bufferPool.PutBuffer(pBuffer);
+			Assert::AreEqual((size_t)2, bufferPool.GetNumFree());
+		}
+
+#ifdef TRACE_BUFFERS
+		TEST_METHOD(TracesOwners)
+		{
+			BufferPool bufferPool{ 4 };
+			Buffer* pBuffer{ bufferPool.GetBuffer() };
+
+			Assert::IsTrue(bufferPool.GetTrace(pBuffer).isHeld);
+
+			bufferPool.SetOwner(pBuffer, "Console"sv);
+
+			std::ostringstream trace;
+			bufferPool.PrintTrace(trace, pBuffer);
+
+			Assert::IsTrue(trace.str().contains("owner Console, refs 1, got at ByteBufferPoolTest.cpp("sv));
+
+			bufferPool.PutBuffer(pBuffer);
+			Assert::IsFalse(bufferPool.GetTrace(pBuffer).isHeld);
+		}
+
+		TEST_METHOD(FindsHeldBuffers)
+		{
+			BufferPool bufferPool{ 4 };
+			Buffer* pHeld{ bufferPool.GetBuffer() };
+			Buffer* pKept{ bufferPool.GetBuffer() };
+			Buffer* pShared{ bufferPool.GetBuffer() };
+
+			// A buffer with one kept reference and one that is not kept is held
+
+			bufferPool.Keep(pKept);
+			bufferPool.AddRef(pShared);
+			bufferPool.Keep(pShared);
+
+			std::this_thread::sleep_for(20ms);
+
+			std::vector<const Buffer*> heldBuffers;
+			auto findHeld{ [&]
+				{
+					heldBuffers.clear();
+					bufferPool.ForEachHeldBuffer(10ms, [&](const Buffer* pBuffer, std::chrono::milliseconds) { heldBuffers.push_back(pBuffer); });
+				} };
+
+			findHeld();
+			Assert::IsTrue(heldBuffers == std::vector<const Buffer*>{ pHeld, pShared } || heldBuffers == std::vector<const Buffer*>{ pShared, pHeld });
+
+			// The time is counted again from the last hand-over
+
+			bufferPool.SetOwner(pHeld, "Raw"sv);
+			bufferPool.PutBuffer(pShared);
+
+			findHeld();
+			Assert::IsTrue(heldBuffers.empty());
+
+			bufferPool.PutBuffer(pHeld);
+			bufferPool.PutBuffer(pKept);
+			bufferPool.PutBuffer(pShared);
+
+			Assert::AreEqual((size_t)4, bufferPool.GetNumFree());
+		}
+#endif
+	};
+}
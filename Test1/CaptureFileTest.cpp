@@ -0,0 +1,258 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#include "CaptureFile.h"
+
+
+namespace
+{
+	std::span<const uint8_t> ToBytes(const std::string_view text)
+	{
+		return { (const uint8_t*)text.data(), text.size() };
+	}
+
+
+	// A capture and its index in memory, as CaptureClient writes them
+	//
+	class CaptureBuilder
+	{
+	public:
+		CaptureBuilder()
+		{
+			Append(m_file, &cCaptureFileHeader, sizeof(cCaptureFileHeader));
+			Append(m_index, &cCaptureIndexHeader, sizeof(cCaptureIndexHeader));
+		}
+
+		// Returns the offset of the record
+		//
+		uint64_t Add(const uint64_t time, const CaptureOrigin origin, const std::string_view text, const bool isIndexed = false)
+		{
+			uint64_t offset{ m_file.size() };
+
+			if (isIndexed)
+			{
+				CaptureIndexEntry entry{ time, offset };
+				Append(m_index, &entry, sizeof(entry));
+			}
+
+			m_file.resize(offset + sizeof(CaptureRecordHeader) + text.size());
+			WriteCaptureRecord(m_file.data() + offset, time, origin, ToBytes(text));
+
+			return offset;
+		}
+
+		// Returns the capture compressed, as CaptureClient writes it with -z
+		//
+		std::vector<uint8_t> Compress() const
+		{
+			Lib::Lz4Block compressor;
+			std::vector<uint8_t> file;
+
+			Append(file, &cCompressedCaptureFileHeader, sizeof(cCompressedCaptureFileHeader));
+
+			for (size_t offset{ sizeof(CaptureFileHeader) }; offset < m_file.size();)
+			{
+				std::span<const uint8_t> records{ m_file.data() + offset, m_file.size() - offset };
+				size_t blockSize{ GetCaptureBlockSize(records) };
+				size_t fileSize{ file.size() };
+
+				file.resize(fileSize + GetMaxCaptureBlockSize(blockSize));
+				file.resize(fileSize + WriteCaptureBlock(file.data() + fileSize, offset, records.first(blockSize), compressor));
+
+				offset += blockSize;
+			}
+
+			return file;
+		}
+
+		std::vector<uint8_t> m_file;
+		std::vector<uint8_t> m_index;
+
+	private:
+		static void Append(std::vector<uint8_t>& bytes, const void* pData, const size_t size)
+		{
+			bytes.insert(bytes.end(), (const uint8_t*)pData, (const uint8_t*)pData + size);
+		}
+	};
+}
+
+
+namespace Test1
+{
+	TEST_CLASS(CaptureFileTest)
+	{
+	public:
+
+		TEST_METHOD(SeeksByTime)
+		{
+			CaptureBuilder builder;
+			std::vector<uint64_t> offsets;
+
+			for (uint n{}; n < 1000; ++n)
+				offsets.push_back(builder.Add(1000 + 10 * n, CaptureOrigin::Serial, "data"sv, n % 100 == 0));
+
+			uint64_t end{ builder.m_file.size() };
+
+			// With the index and without it
+
+			for (bool useIndex : { true, false })
+			{
+				CaptureReader reader;
+				Assert::IsTrue(reader.Open(builder.m_file, useIndex ? builder.m_index : std::vector<uint8_t>{}));
+				Assert::AreEqual(useIndex ? 10u : 0u, reader.GetNumIndexEntries());
+
+				Assert::AreEqual(offsets[537], reader.Seek(1000 + 5370));
+				Assert::AreEqual(offsets[538], reader.Seek(1000 + 5371));
+				Assert::AreEqual(offsets[600], reader.Seek(1000 + 6000));
+				Assert::AreEqual(offsets[0], reader.Seek(0));
+				Assert::AreEqual(end, reader.Seek(1000000));
+			}
+		}
+
+		TEST_METHOD(FindsMatchesAcrossRecords)
+		{
+			CaptureBuilder builder;
+
+			// The serial data has the text split between reads, and a console
+			// client types it one byte at a time in between
+
+			uint64_t time{ 1000 };
+			std::vector<uint64_t> consoleOffsets;
+			uint64_t serialOffset{ builder.Add(time++, CaptureOrigin::Serial, "<6>Kernel pa"sv) };
+
+			for (char c : "Kernel panic"sv)
+				consoleOffsets.push_back(builder.Add(time++, CaptureOrigin::Console, std::string_view{ &c, 1 }));
+
+			builder.Add(time++, CaptureOrigin::Serial, "n"sv);
+			builder.Add(time++, CaptureOrigin::Serial, "ic - not syncing"sv);
+			uint64_t lastOffset{ builder.Add(time++, CaptureOrigin::Gdb, "$g#67 Kernel panic"sv) };
+
+			CaptureReader reader;
+			Assert::IsTrue(reader.Open(builder.m_file, builder.m_index));
+
+			// Each match is reported with the record where it starts, once
+			// the record where it ends has been read
+
+			std::vector<std::pair<uint64_t, size_t>> matches;
+			Lib::SubstringSearch search{ ToBytes("Kernel panic"sv) };
+
+			reader.Search(reader.GetBegin(), reader.GetEnd(), search, [&matches](const CaptureReader::Record& record, size_t position)
+				{
+					matches.emplace_back(record.offset, position);
+				});
+
+			std::vector<std::pair<uint64_t, size_t>> expected
+			{
+				{ consoleOffsets[0], 0 },
+				{ serialOffset, 3 },
+				{ lastOffset, 6 }
+			};
+
+			Assert::IsTrue(matches == expected);
+		}
+
+		// Reads the records of a compressed capture of many blocks, as they
+		// are without compression
+		//
+		TEST_METHOD(ReadsCompressedCapture)
+		{
+			CaptureBuilder builder;
+			uint64_t time{ 1000 };
+
+			for (uint n{}; n < 20000; ++n)
+			{
+				std::string text{ "[  " + std::to_string(n) + "] eth0: link up" };
+
+				if (n % 1000 == 999)
+					text += " Kernel pa";
+
+				builder.Add(time++, CaptureOrigin::Serial, text, n % 100 == 0);
+
+				if (n % 1000 == 999)
+					builder.Add(time++, CaptureOrigin::Serial, "nic"sv);
+			}
+
+			auto compressed{ builder.Compress() };
+
+			CaptureReader reader;
+			CaptureReader compressedReader;
+
+			Assert::IsTrue(reader.Open(builder.m_file, builder.m_index));
+			Assert::IsTrue(compressedReader.Open(compressed, builder.m_index));
+
+			Assert::IsTrue(compressedReader.IsCompressed());
+			Assert::IsTrue(compressedReader.GetNumBlocks() > 8);
+			Assert::IsTrue(compressed.size() < builder.m_file.size() / 2);
+			Assert::AreEqual(reader.GetEnd(), compressedReader.GetEnd());
+
+			CaptureReader::Record record;
+			CaptureReader::Record compressedRecord;
+			uint64_t offset{ reader.GetBegin() };
+
+			for (; reader.Read(offset, &record); offset = reader.GetNext(record))
+			{
+				Assert::IsTrue(compressedReader.Read(offset, &compressedRecord));
+				Assert::AreEqual(record.time, compressedRecord.time);
+				Assert::IsTrue(std::ranges::equal(record.data, compressedRecord.data));
+			}
+
+			Assert::IsFalse(compressedReader.Read(offset, &compressedRecord));
+			Assert::AreEqual(reader.Seek(1000 + 12345), compressedReader.Seek(1000 + 12345));
+
+			// The same matches, which straddle the records, in many blocks
+
+			auto search{ [](const CaptureReader& captureReader)
+				{
+					std::vector<std::pair<uint64_t, std::string>> matches;
+					Lib::SubstringSearch search{ ToBytes("Kernel panic"sv) };
+
+					captureReader.Search(captureReader.GetBegin(), captureReader.GetEnd(), search, [&matches](const CaptureReader::Record& record, size_t position)
+						{
+							matches.emplace_back(record.offset, std::string{ record.data.begin() + position, record.data.end() });
+						});
+
+					return matches;
+				} };
+
+			auto matches{ search(reader) };
+
+			Assert::AreEqual((size_t)20, matches.size());
+			Assert::IsTrue(matches == search(compressedReader));
+
+			// A capture that is still being written ends at the last complete block
+
+			compressed.resize(compressed.size() - 10);
+			Assert::IsTrue(compressedReader.Open(compressed, builder.m_index));
+			Assert::IsTrue(compressedReader.GetEnd() < reader.GetEnd());
+			Assert::IsTrue(compressedReader.Read(compressedReader.Seek(1000), &compressedRecord));
+		}
+
+		TEST_METHOD(StopsAtIncompleteRecord)
+		{
+			CaptureBuilder builder;
+
+			builder.Add(1000, CaptureOrigin::Serial, "complete"sv);
+			uint64_t offset{ builder.Add(1001, CaptureOrigin::Serial, "still being written"sv) };
+
+			builder.m_file.resize(builder.m_file.size() - 5);
+
+			CaptureReader reader;
+			Assert::IsTrue(reader.Open(builder.m_file));
+
+			CaptureReader::Record record;
+			Assert::IsTrue(reader.Read(reader.GetBegin(), &record));
+			Assert::IsTrue(std::ranges::equal(ToBytes("complete"sv), record.data));
+			Assert::AreEqual(offset, reader.GetNext(record));
+			Assert::IsFalse(reader.Read(offset, &record));
+
+			Assert::AreEqual(offset, reader.Seek(2000));
+
+			// Not a capture
+
+			std::vector<uint8_t> text(100, 'x');
+			Assert::IsFalse(reader.Open(text));
+		}
+	};
+}
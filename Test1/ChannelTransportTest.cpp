@@ -0,0 +1,523 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#include "TcpClient.h"
+#include "IFilter.h"
+
+
+namespace
+{
+	constexpr uint16_t cTestPort{ 43219 };
+	constexpr auto cTestSocketPath{ "SernicTest.sock"sv };
+	constexpr uint cNumPings{ 10'000 };
+	constexpr size_t cPingSize{ cBufferSize };
+	constexpr size_t cNumBenchBytes{ 16 * 1024 * 1024 };
+	constexpr size_t cPeerSendSize{ 4096 };
+	constexpr uint cNumTrickleBuffers{ 50 };
+	constexpr auto cTrickleInterval{ 1ms };
+	constexpr uint cNumScrollbackBuffers{ 1000 };
+
+
+	// Runs the events of one client the way Runner does
+	//
+	class ChannelDriver
+	{
+	public:
+		explicit ChannelDriver(IClient& client)
+			: m_client{ client }
+		{
+		}
+
+		bool Open()
+		{
+			m_numEvents = m_client.Open(m_events);
+			return m_numEvents > 0;
+		}
+
+		// Processes events until the client delivers a buffer.
+		// Returns nullptr on error or if nothing happens for a second.
+		//
+		Buffer* Receive()
+		{
+			for (;;)
+			{
+				Buffer* pBuffer{};
+
+				if (ProcessEvent(1000, &pBuffer) <= 0)
+					return pBuffer;
+			}
+		}
+
+		// Processes one event if any is set within the timeout (ms).
+		// Returns -1 on error or timeout, 0 if a buffer was received
+		// (set in ppBuffer) and 1 otherwise.
+		//
+		int ProcessEvent(const DWORD timeout, Buffer** ppBuffer)
+		{
+			auto result{ WSAWaitForMultipleEvents(m_numEvents, m_events.data(), FALSE, timeout, FALSE) };
+
+			if (result == WSA_WAIT_TIMEOUT || result == WSA_WAIT_FAILED)
+				return -1;
+
+			auto bytesReceived{ m_client.ProcessEvent(result - WSA_WAIT_EVENT_0, ppBuffer) };
+
+			if (bytesReceived < 0)
+				return -1;
+
+			return bytesReceived > 0 ? 0 : 1;
+		}
+
+	private:
+		IClient& m_client;
+		std::array<WSAEVENT, 8> m_events{};
+		uint m_numEvents{};
+	};
+
+
+	// Connects a blocking socket to the channel, as gdb or telnet would
+	//
+	SOCKET ConnectPeer(const bool isUnix)
+	{
+		SOCKET peer{ socket(isUnix ? AF_UNIX : AF_INET, SOCK_STREAM, 0) };
+
+		if (peer == INVALID_SOCKET)
+			return peer;
+
+		int result;
+
+		if (isUnix)
+		{
+			sockaddr_un addr{};
+			addr.sun_family = AF_UNIX;
+			std::copy(cTestSocketPath.begin(), cTestSocketPath.end(), addr.sun_path);
+
+			result = connect(peer, (const sockaddr*)&addr, sizeof addr);
+		}
+		else
+		{
+			int value{ 1 };
+			setsockopt(peer, IPPROTO_TCP, TCP_NODELAY, (const char*)&value, sizeof value);
+
+			sockaddr_in addr{};
+			addr.sin_family = AF_INET;
+			addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			addr.sin_port = htons(cTestPort);
+
+			result = connect(peer, (const sockaddr*)&addr, sizeof addr);
+		}
+
+		if (result != 0)
+		{
+			closesocket(peer);
+			peer = INVALID_SOCKET;
+		}
+
+		return peer;
+	}
+
+
+	bool ReceiveAll(const SOCKET peer, char* pData, size_t size)
+	{
+		while (size > 0)
+		{
+			int result{ recv(peer, pData, (int)size, 0) };
+
+			if (result <= 0)
+				return false;
+
+			pData += result;
+			size -= result;
+		}
+
+		return true;
+	}
+
+
+	// Measures the throughput of data sent by the channel (as if received
+	// on the serial port). Returns MB/s or 0 on error.
+	//
+	double MeasureDownstream()
+	{
+		BufferPool bufferPool{ cNumBuffers };
+		TcpClient tcpClient{ "Test"sv, cTestPort, bufferPool };
+
+		IClient& client{ tcpClient };
+		ChannelDriver driver{ client };
+
+		if (!driver.Open())
+			return 0;
+
+		SOCKET peer{ ConnectPeer(false) };
+
+		if (peer == INVALID_SOCKET)
+			return 0;
+
+		// The channel drops data until it has processed the connection,
+		// so wait for a first packet from the peer
+
+		char hello{};
+		Buffer* pHello{};
+
+		if (send(peer, &hello, 1, 0) != 1 || !(pHello = driver.Receive()))
+		{
+			closesocket(peer);
+			return 0;
+		}
+
+		bufferPool.PutBuffer(pHello);
+
+		std::thread receiver{ [peer]
+			{
+				std::vector<char> data(cPeerSendSize);
+
+				for (size_t received{}; received < cNumBenchBytes; )
+				{
+					int result{ recv(peer, data.data(), (int)data.size(), 0) };
+
+					if (result <= 0)
+						break;
+
+					received += result;
+				}
+			} };
+
+		bool isOk{ true };
+		auto start{ std::chrono::steady_clock::now() };
+
+		for (size_t sent{}; isOk && sent < cNumBenchBytes; )
+		{
+			if (Buffer* pBuffer{ bufferPool.GetBuffer() })
+			{
+				pBuffer->SetDataSize(pBuffer->GetBufferSize());
+				sent += pBuffer->GetDataSize();
+				isOk = client.Send(pBuffer);
+			}
+			else
+			{
+				// All buffers are queued, wait for a send to complete
+
+				Buffer* pReceived{};
+				isOk = driver.ProcessEvent(1000, &pReceived) > 0;
+			}
+		}
+
+		receiver.join();
+
+		std::chrono::duration<double> seconds{ std::chrono::steady_clock::now() - start };
+
+		closesocket(peer);
+
+		return isOk ? cNumBenchBytes / seconds.count() / (1024 * 1024) : 0;
+	}
+
+
+	// Sends small buffers through the channel at short intervals, as the
+	// serial port does with a boot log, and returns the number of sends
+	// the channel needed for them (0 on error)
+	//
+	uint64_t CountTrickleSends(const std::chrono::microseconds coalesceWindow)
+	{
+		BufferPool bufferPool{ cNumBuffers };
+		TcpClient tcpClient{ "Test"sv, cTestPort, bufferPool };
+
+		tcpClient.SetCoalescing(coalesceWindow, cTxCoalesceSize);
+
+		IClient& client{ tcpClient };
+		ChannelDriver driver{ client };
+
+		if (!driver.Open())
+			return 0;
+
+		SOCKET peer{ ConnectPeer(false) };
+
+		if (peer == INVALID_SOCKET)
+			return 0;
+
+		char hello{};
+		Buffer* pHello{};
+
+		if (send(peer, &hello, 1, 0) != 1 || !(pHello = driver.Receive()))
+		{
+			closesocket(peer);
+			return 0;
+		}
+
+		bufferPool.PutBuffer(pHello);
+
+		bool isOk{ true };
+
+		for (uint n{}; isOk && n < cNumTrickleBuffers; ++n)
+		{
+			Buffer* pBuffer{ bufferPool.GetBuffer() };
+			pBuffer->SetDataSize(1);
+			isOk = client.Send(pBuffer);
+
+			// Run the events until it is time for the next buffer
+
+			auto nextTime{ std::chrono::steady_clock::now() + cTrickleInterval };
+
+			while (isOk && std::chrono::steady_clock::now() < nextTime)
+			{
+				// Timeouts (-1) are expected, data from the peer isn't
+
+				Buffer* pReceived{};
+				isOk = driver.ProcessEvent(1, &pReceived) != 0;
+			}
+		}
+
+		std::array<char, cNumTrickleBuffers> data{};
+		isOk = isOk && ReceiveAll(peer, data.data(), data.size());
+
+		closesocket(peer);
+
+		return isOk ? tcpClient.GetNumSends() : 0;
+	}
+
+
+	// Sends numbered buffers to a channel with no client, connects a client
+	// and checks that it gets the most recent ones, followed by live data.
+	// Returns false on error.
+	//
+	bool CheckScrollback()
+	{
+		BufferPool bufferPool{ cNumBuffers + cNumScrollbackBuffers };
+		TcpClient tcpClient{ "Test"sv, cTestPort, bufferPool };
+
+		tcpClient.SetScrollback(cNumScrollbackBuffers);
+
+		IClient& client{ tcpClient };
+		ChannelDriver driver{ client };
+
+		if (!driver.Open())
+			return false;
+
+		// Each buffer holds its number
+
+		auto sendNumber = [&](const uint number)
+			{
+				Buffer* pBuffer{ bufferPool.GetBuffer() };
+				std::copy_n((const uint8_t*)&number, sizeof number, pBuffer->GetBufferPtr());
+				pBuffer->SetDataSize(sizeof number);
+
+				return client.Send(pBuffer);
+			};
+
+		constexpr uint cNumOldBuffers{ 3 * cNumScrollbackBuffers };
+
+		for (uint n{}; n < cNumOldBuffers; ++n)
+			sendNumber(n);
+
+		SOCKET peer{ ConnectPeer(false) };
+
+		if (peer == INVALID_SOCKET)
+			return false;
+
+		char hello{};
+		Buffer* pHello{};
+
+		bool isOk{ send(peer, &hello, 1, 0) == 1 && (pHello = driver.Receive()) != nullptr };
+
+		if (isOk)
+		{
+			bufferPool.PutBuffer(pHello);
+			isOk = sendNumber(cNumOldBuffers);		// live data
+		}
+
+		// Run the replay while the peer reads it
+
+		std::vector<uint> numbers(cNumScrollbackBuffers + 1);
+		std::atomic<bool> isReceived{};
+
+		std::thread receiver{ [&]
+			{
+				if (ReceiveAll(peer, (char*)numbers.data(), numbers.size() * sizeof(uint)))
+					isReceived = true;
+			} };
+
+		auto endTime{ std::chrono::steady_clock::now() + 5s };
+
+		while (isOk && !isReceived && std::chrono::steady_clock::now() < endTime)
+		{
+			Buffer* pReceived{};
+			driver.ProcessEvent(1, &pReceived);
+		}
+
+		closesocket(peer);
+		receiver.join();
+
+		isOk = isOk && isReceived;
+
+		for (uint n{}; isOk && n < numbers.size(); ++n)
+			isOk = numbers[n] == cNumOldBuffers - cNumScrollbackBuffers + n;
+
+		return isOk;
+	}
+
+
+	struct TransportResult
+	{
+		double roundTripTime;		// us
+		double throughput;			// MB/s
+	};
+
+
+	// Measures the round trip of small packets echoed by the channel and
+	// the throughput of a bulk upload received by the channel.
+	// Returns false on error.
+	//
+	bool MeasureTransport(const bool isUnix, TransportResult& result)
+	{
+		BufferPool bufferPool{ cNumBuffers };
+		auto pClient
+		{
+			isUnix
+				? std::make_unique<TcpClient>("Test"sv, cTestSocketPath, bufferPool)
+				: std::make_unique<TcpClient>("Test"sv, cTestPort, bufferPool)
+		};
+
+		IClient& client{ *pClient };
+		ChannelDriver driver{ client };
+
+		if (!driver.Open())
+			return false;
+
+		SOCKET peer{ ConnectPeer(isUnix) };
+
+		if (peer == INVALID_SOCKET)
+			return false;
+
+		bool isOk{ true };
+		std::array<char, cPingSize> ping{};
+		std::array<char, cPingSize> pong{};
+
+		// --- Latency: the channel echoes every packet back
+
+		auto start{ std::chrono::steady_clock::now() };
+
+		for (uint n{}; n < cNumPings && isOk; ++n)
+		{
+			ping[0] = (char)n;
+			isOk = send(peer, ping.data(), (int)ping.size(), 0) == (int)ping.size();
+
+			for (size_t received{}; isOk && received < ping.size(); )
+			{
+				Buffer* pBuffer{ driver.Receive() };
+				isOk = pBuffer && client.Send(pBuffer);
+
+				if (isOk)
+					received += pBuffer->GetDataSize();
+			}
+
+			isOk = isOk && ReceiveAll(peer, pong.data(), pong.size()) && pong == ping;
+		}
+
+		std::chrono::duration<double, std::micro> time{ std::chrono::steady_clock::now() - start };
+		result.roundTripTime = time.count() / cNumPings;
+
+		// --- Throughput: the peer uploads as fast as it can
+
+		std::thread sender{ [peer]
+			{
+				std::vector<char> data(cPeerSendSize);
+
+				for (size_t sent{}; sent < cNumBenchBytes; sent += data.size())
+				{
+					if (send(peer, data.data(), (int)data.size(), 0) != (int)data.size())
+						break;
+				}
+			} };
+
+		start = std::chrono::steady_clock::now();
+
+		for (size_t received{}; isOk && received < cNumBenchBytes; )
+		{
+			Buffer* pBuffer{ driver.Receive() };
+			isOk = !!pBuffer;
+
+			if (isOk)
+			{
+				received += pBuffer->GetDataSize();
+				bufferPool.PutBuffer(pBuffer);
+			}
+		}
+
+		std::chrono::duration<double> seconds{ std::chrono::steady_clock::now() - start };
+		result.throughput = cNumBenchBytes / seconds.count() / (1024 * 1024);
+
+		sender.join();
+		closesocket(peer);
+
+		return isOk;
+	}
+}
+
+
+namespace Test1
+{
+	TEST_CLASS(ChannelTransportTest)
+	{
+	public:
+
+		TEST_CLASS_INITIALIZE(Startup)
+		{
+			WSADATA wsaData;
+			WSAStartup(0x0202, &wsaData);
+		}
+
+		TEST_CLASS_CLEANUP(Cleanup)
+		{
+			WSACleanup();
+		}
+
+		TEST_METHOD(TcpVersusUnixSocket)
+		{
+			TransportResult tcp{};
+			TransportResult unixSocket{};
+
+			Assert::IsTrue(MeasureTransport(false, tcp));
+			Assert::IsTrue(MeasureTransport(true, unixSocket));
+
+			std::wostringstream message;
+			message << std::fixed << std::setprecision(2);
+			message << L"Loopback TCP: " << tcp.roundTripTime << L" us round trip, " << tcp.throughput << L" MB/s\n";
+			message << L"Unix socket:  " << unixSocket.roundTripTime << L" us round trip, " << unixSocket.throughput << L" MB/s\n";
+
+			Logger::WriteMessage(message.str().c_str());
+		}
+
+		TEST_METHOD(DownstreamThroughput)
+		{
+			double throughput{ MeasureDownstream() };
+
+			Assert::IsTrue(throughput > 0);
+
+			std::wostringstream message;
+			message << std::fixed << std::setprecision(2);
+			message << L"Sending from pool buffers: " << throughput << L" MB/s\n";
+
+			Logger::WriteMessage(message.str().c_str());
+		}
+
+		TEST_METHOD(ScrollbackReplay)
+		{
+			Assert::IsTrue(CheckScrollback());
+		}
+
+		TEST_METHOD(CoalescedSends)
+		{
+			uint64_t numSends{ CountTrickleSends({}) };
+			uint64_t numCoalescedSends{ CountTrickleSends(cTxCoalesceWindow) };
+
+			Assert::IsTrue(numSends > 0 && numCoalescedSends > 0);
+			Assert::IsTrue(numCoalescedSends < numSends);
+
+			std::wostringstream message;
+			message << cNumTrickleBuffers << L" buffers sent in " << numSends << L" sends, coalesced in "
+					<< numCoalescedSends << L" sends\n";
+
+			Logger::WriteMessage(message.str().c_str());
+		}
+	};
+}
@@ -0,0 +1,76 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#include "Lib/HistoryRing.h"
+
+
+namespace Test1
+{
+	TEST_CLASS(HistoryRingTest)
+	{
+	public:
+
+		TEST_METHOD(KeepsMostRecent)
+		{
+			Lib::HistoryRing<uint> ring{ 5 };
+			uint evicted{};
+
+			for (uint n{}; n < 5; ++n)
+				Assert::IsFalse(ring.Push(n, &evicted));
+
+			Assert::AreEqual(5u, ring.GetSize());
+
+			for (uint n{ 5 }; n < 12; ++n)
+			{
+				Assert::IsTrue(ring.Push(n, &evicted));
+				Assert::AreEqual(n - 5, evicted);
+			}
+
+			// Positions follow the pushes
+
+			Assert::AreEqual(7ull, (unsigned long long)ring.GetFirst());
+			Assert::AreEqual(12ull, (unsigned long long)ring.GetEnd());
+
+			for (uint64_t position{ ring.GetFirst() }; position < ring.GetEnd(); ++position)
+				Assert::AreEqual((uint)position, ring[position]);
+
+			uint item{};
+
+			Assert::IsTrue(ring.PopFirst(&item));
+			Assert::AreEqual(7u, item);
+			Assert::AreEqual(4u, ring.GetSize());
+		}
+
+		TEST_METHOD(ReaderFallsBehind)
+		{
+			Lib::HistoryRing<uint> ring{ 4 };
+			uint evicted{};
+
+			for (uint n{}; n < 3; ++n)
+				ring.Push(n, &evicted);
+
+			// The reader has read item 0 and then the writer goes on
+
+			uint64_t readPosition{ ring.GetFirst() + 1 };
+
+			for (uint n{ 3 }; n < 10; ++n)
+				ring.Push(n, &evicted);
+
+			Assert::IsTrue(readPosition < ring.GetFirst());
+			Assert::AreEqual(6u, ring[ring.GetFirst()]);
+		}
+
+		TEST_METHOD(NoCapacity)
+		{
+			Lib::HistoryRing<uint> ring;
+
+			Assert::AreEqual(0u, ring.GetCapacity());
+			Assert::IsTrue(ring.IsEmpty());
+
+			uint item{};
+			Assert::IsFalse(ring.PopFirst(&item));
+		}
+	};
+}
@@ -0,0 +1,120 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#include "LocalClient.h"
+
+
+namespace Test1
+{
+	TEST_CLASS(LocalClientTest)
+	{
+	public:
+
+		TEST_METHOD(DeliversSerialData)
+		{
+			BufferPool bufferPool{ LocalClient::cNumRxBuffers + 4 };
+			std::string received;
+
+			LocalClient client{ "Local"sv, bufferPool, [&](std::span<const uint8_t> data)
+				{
+					received.append(data.begin(), data.end());
+				} };
+
+			IClient& iClient{ client };
+			std::array<WSAEVENT, 1> events{};
+
+			Assert::AreEqual(1u, iClient.Open(events));
+
+			const std::string_view text{ "Hello" };
+			Buffer* pBuffer{ bufferPool.GetBuffer() };
+			std::copy(text.begin(), text.end(), pBuffer->GetBufferPtr());
+			pBuffer->SetDataSize(text.size());
+
+			Assert::IsTrue(iClient.Send(pBuffer));
+			Assert::AreEqual(std::string{ text }, received);
+			Assert::AreEqual((size_t)4, bufferPool.GetNumFree());
+		}
+
+		TEST_METHOD(WritesFromAnotherThread)
+		{
+			BufferPool bufferPool{ 16 };
+			LocalClient client{ "Local"sv, bufferPool, [](std::span<const uint8_t>) {} };
+
+			IClient& iClient{ client };
+			std::array<WSAEVENT, 1> events{};
+
+			Assert::AreEqual(1u, iClient.Open(events));
+
+			// More than one buffer of data is split into blocks
+
+			std::vector<uint8_t> data(cBufferSize + 10);
+			std::iota(data.begin(), data.end(), (uint8_t)0);
+
+			std::thread writer{ [&] { Assert::AreEqual(data.size(), client.Write(data)); } };
+			writer.join();
+
+			Assert::AreEqual((DWORD)WAIT_OBJECT_0, WaitForSingleObject(events[0], 1000));
+
+			std::vector<uint8_t> received;
+
+			for (;;)
+			{
+				Buffer* pBuffer{};
+				int result{ iClient.ProcessEvent(0, &pBuffer) };
+
+				Assert::IsTrue(result >= 0);
+
+				if (result == 0)
+					break;
+
+				auto bufferData{ pBuffer->GetData() };
+				received.insert(received.end(), bufferData.begin(), bufferData.end());
+				bufferPool.PutBuffer(pBuffer);
+			}
+
+			Assert::IsTrue(data == received);
+		}
+
+		TEST_METHOD(WaitsForFreeBuffers)
+		{
+			BufferPool bufferPool{ LocalClient::cNumRxBuffers };
+			LocalClient client{ "Local"sv, bufferPool, [](std::span<const uint8_t>) {} };
+
+			IClient& iClient{ client };
+			std::array<WSAEVENT, 1> events{};
+
+			Assert::AreEqual(1u, iClient.Open(events));
+			Assert::AreEqual((size_t)0, bufferPool.GetNumFree());
+
+			// The client has taken the whole pool, more data than that is not queued
+
+			std::vector<uint8_t> data((LocalClient::cNumRxBuffers + 1) * cBufferSize);
+			Assert::AreEqual(LocalClient::cNumRxBuffers * cBufferSize, client.Write(data));
+
+			std::vector<Buffer*> received;
+			Buffer* pBuffer{};
+
+			while (iClient.ProcessEvent(0, &pBuffer) > 0)
+				received.push_back(std::exchange(pBuffer, {}));
+
+			Assert::AreEqual((size_t)LocalClient::cNumRxBuffers, received.size());
+			Assert::AreEqual((size_t)0, client.Write(data));
+
+			// The pool is empty, so the runner takes no new buffers and receives nothing
+
+			Assert::AreEqual(0, iClient.ProcessEvent(0, &pBuffer));
+
+			for (Buffer* pReceived : received)
+				bufferPool.PutBuffer(pReceived);
+
+			// Writing again wakes up the runner, which takes the buffers back
+
+			Assert::AreEqual((size_t)0, client.Write(data));
+			Assert::AreEqual((DWORD)WAIT_OBJECT_0, WaitForSingleObject(events[0], 0));
+			Assert::AreEqual(0, iClient.ProcessEvent(0, &pBuffer));
+			Assert::AreEqual(cBufferSize, client.Write({ data.data(), cBufferSize }));
+		}
+	};
+}
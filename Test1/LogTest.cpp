@@ -0,0 +1,78 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#include "Log.h"
+
+
+namespace Test1
+{
+	TEST_CLASS(LogTest)
+	{
+	public:
+
+		TEST_METHOD(LimitsRepeats)
+		{
+			auto& log{ Log::Get() };
+			const auto location{ std::source_location::current() };
+			uint numSuppressed{};
+
+			for (uint n{}; n < Log::cMaxRepeats; ++n)
+				Assert::IsTrue(log.Admit(location, numSuppressed));
+
+			Assert::IsFalse(log.Admit(location, numSuppressed));
+			Assert::IsFalse(log.Admit(location, numSuppressed));
+
+			// Other sites are not affected
+
+			Assert::IsTrue(log.Admit(std::source_location::current(), numSuppressed));
+
+			std::this_thread::sleep_for(Log::cRepeatInterval);
+
+			Assert::IsTrue(log.Admit(location, numSuppressed));
+			Assert::AreEqual(2u, numSuppressed);
+		}
+
+		TEST_METHOD(WritesFromThread)
+		{
+			std::ostringstream text;
+			auto* pCoutBuffer{ std::cout.rdbuf(text.rdbuf()) };
+
+			{
+				LogWriter writer;
+
+				LogInfo() << "Value " << 42;
+				LogDebug() << "Not written";
+
+				// A message longer than a record is cut
+
+				LogInfo() << std::string(Log::cMaxMessageSize + 10, 'x');
+			}
+
+			std::cout.rdbuf(pCoutBuffer);
+
+			Assert::AreEqual("Value 42\n" + std::string(Log::cMaxMessageSize, 'x') + "\n", text.str());
+		}
+
+		TEST_METHOD(MessageHasCallersSite)
+		{
+			std::ostringstream text;
+			auto* pCoutBuffer{ std::cout.rdbuf(text.rdbuf()) };
+
+			for (uint n{}; n <= Log::cMaxRepeats; ++n)
+				LogMessage(Log::Level::Info, "Line ", n);
+
+			LogMessage(Log::Level::Info, "Other site");
+
+			std::cout.rdbuf(pCoutBuffer);
+
+			std::string expected;
+
+			for (uint n{}; n < Log::cMaxRepeats; ++n)
+				expected += "Line " + std::to_string(n) + "\n";
+
+			Assert::AreEqual(expected + "Other site\n", text.str());
+		}
+	};
+}
@@ -0,0 +1,177 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#include "Lib/Lz4Block.h"
+
+
+namespace
+{
+	std::vector<uint8_t> ToBytes(const std::string_view text)
+	{
+		return { text.begin(), text.end() };
+	}
+
+
+	// Compresses and decompresses the data, returns the size of the block
+	//
+	size_t RoundTrip(Lib::Lz4Block& compressor, const std::vector<uint8_t>& data)
+	{
+		std::vector<uint8_t> block(Lib::Lz4Block::GetMaxCompressedSize(data.size()));
+		size_t blockSize{ compressor.Compress(data, block) };
+
+		Assert::IsTrue(blockSize > 0);
+
+		std::vector<uint8_t> result(data.size());
+		Assert::AreEqual(data.size(), Lib::Lz4Block::Decompress({ block.data(), blockSize }, result));
+		Assert::IsTrue(result == data);
+
+		return blockSize;
+	}
+
+
+	// A boot log like the one a board prints on its console
+	//
+	std::vector<uint8_t> MakeBootLog(const size_t size)
+	{
+		constexpr std::array cMessages
+		{
+			"usb 1-1: new high-speed USB device number %u using ehci-pci"sv,
+			"EXT4-fs (mmcblk0p%u): mounted filesystem with ordered data mode. Opts: (null)"sv,
+			"random: crng init done, %u bits of entropy"sv,
+			"eth0: link up, 1000Mbps, full-duplex, lpa 0x%04X"sv,
+			"systemd[1]: Started Journal Service (pid %u)."sv
+		};
+
+		std::vector<uint8_t> log;
+		uint64_t time{ 1'000'000 };
+		uint32_t random{ 12345 };
+
+		while (log.size() < size)
+		{
+			random = random * 1103515245 + 12345;
+			time += random % 50'000;
+
+			std::array<char, 200> line{};
+			auto message{ cMessages[(random >> 8) % cMessages.size()] };
+			int length{ std::snprintf(line.data(), line.size(), "[%5u.%06u] ", (uint)(time / 1'000'000), (uint)(time % 1'000'000)) };
+
+			length += std::snprintf(line.data() + length, line.size() - length, std::string{ message }.c_str(), (random >> 16) % 4096);
+			length += std::snprintf(line.data() + length, line.size() - length, "\r\n");
+
+			log.insert(log.end(), line.data(), line.data() + length);
+		}
+
+		log.resize(size);
+
+		return log;
+	}
+}
+
+
+namespace Test1
+{
+	TEST_CLASS(Lz4BlockTest)
+	{
+	public:
+
+		TEST_METHOD(RoundTrips)
+		{
+			Lib::Lz4Block compressor;
+
+			// Too short for a match, a run of one byte (the match overlaps
+			// the data it produces), text and bytes that don't compress
+
+			RoundTrip(compressor, {});
+			RoundTrip(compressor, ToBytes("hello"sv));
+			Assert::IsTrue(RoundTrip(compressor, std::vector<uint8_t>(10000, 'a')) < 100);
+			Assert::IsTrue(RoundTrip(compressor, MakeBootLog(65536)) < 65536 / 2);
+
+			std::vector<uint8_t> random(65536);
+			uint32_t value{ 1 };
+
+			for (auto& byte : random)
+			{
+				value = value * 1664525 + 1013904223;
+				byte = (uint8_t)(value >> 24);
+			}
+
+			Assert::IsTrue(RoundTrip(compressor, random) <= Lib::Lz4Block::GetMaxCompressedSize(random.size()));
+
+			// A block that doesn't fit is not written
+
+			std::vector<uint8_t> small(100);
+			Assert::AreEqual((size_t)0, compressor.Compress(random, small));
+		}
+
+		TEST_METHOD(ReadsBlockFormat)
+		{
+			// 3 literals "abc" and a match of 8 bytes at offset 3, then the
+			// last 5 literals
+
+			const std::vector<uint8_t> block{ 0x34, 'a', 'b', 'c', 0x03, 0x00, 0x50, 'x', 'y', 'z', 'w', 'v' };
+			std::vector<uint8_t> result(16);
+
+			Assert::AreEqual((size_t)16, Lib::Lz4Block::Decompress(block, result));
+			Assert::IsTrue(result == ToBytes("abcabcabcabxyzwv"sv));
+
+			// Not valid: a match before the start, no room for the data, no last sequence
+
+			std::vector<uint8_t> badOffset{ block };
+			badOffset[4] = 0x04;
+
+			Assert::AreEqual(Lib::Lz4Block::npos, Lib::Lz4Block::Decompress(badOffset, result));
+			Assert::AreEqual(Lib::Lz4Block::npos, Lib::Lz4Block::Decompress(block, { result.data(), 15 }));
+			Assert::AreEqual(Lib::Lz4Block::npos, Lib::Lz4Block::Decompress({ block.data(), 6 }, result));
+		}
+
+		// Compresses a boot log in capture blocks and reports the ratio and
+		// the speed against the data rate of a 5 Mbaud line
+		//
+		TEST_METHOD(Benchmark)
+		{
+			constexpr size_t cBlockSize{ 64 * 1024 };
+			constexpr size_t cLogSize{ 64 * cBlockSize };
+			constexpr double cLineRate{ 5'000'000 / 10 };		// bytes per second
+
+			Lib::Lz4Block compressor;
+			auto log{ MakeBootLog(cLogSize) };
+			std::vector<uint8_t> blocks(cLogSize / cBlockSize * Lib::Lz4Block::GetMaxCompressedSize(cBlockSize));
+			std::vector<size_t> blockSizes;
+
+			auto startTime{ std::chrono::steady_clock::now() };
+			size_t compressedSize{};
+
+			for (size_t offset{}; offset < cLogSize; offset += cBlockSize)
+			{
+				blockSizes.push_back(compressor.Compress({ log.data() + offset, cBlockSize }, std::span{ blocks }.subspan(compressedSize)));
+				compressedSize += blockSizes.back();
+			}
+
+			std::chrono::duration<double> compressTime{ std::chrono::steady_clock::now() - startTime };
+
+			std::vector<uint8_t> result(cLogSize);
+			startTime = std::chrono::steady_clock::now();
+
+			for (size_t index{}, position{}; index < blockSizes.size(); position += blockSizes[index++])
+				Lib::Lz4Block::Decompress({ blocks.data() + position, blockSizes[index] }, { result.data() + index * cBlockSize, cBlockSize });
+
+			std::chrono::duration<double> decompressTime{ std::chrono::steady_clock::now() - startTime };
+
+			Assert::IsTrue(result == log);
+
+			double compressRate{ cLogSize / compressTime.count() };
+
+			std::wostringstream message;
+			message << std::fixed << std::setprecision(1);
+			message << L"Boot log compressed " << (double)cLogSize / compressedSize << L":1, " << compressRate / 1024 / 1024
+					<< L" MB/s (" << compressRate / cLineRate << L" times 5 Mbaud), decompressed " << cLogSize / decompressTime.count() / 1024 / 1024
+					<< L" MB/s\n";
+
+			Logger::WriteMessage(message.str().c_str());
+
+			Assert::IsTrue(compressedSize < cLogSize / 2);
+		}
+	};
+}
@@ -0,0 +1,126 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#include "Lib/MultiPatternMatcher.h"
+
+
+namespace
+{
+	std::span<const uint8_t> ToBytes(const std::string_view text)
+	{
+		return { (const uint8_t*)text.data(), text.size() };
+	}
+
+
+	// Scans the text in chunks of chunkSize bytes and returns the indices
+	// of the patterns found, in the order they were found
+	//
+	std::vector<uint> ScanChunks(Lib::MultiPatternMatcher& matcher, const std::string_view text, const size_t chunkSize)
+	{
+		std::vector<uint> matches;
+
+		matcher.Reset();
+
+		for (size_t offset{}; offset < text.size(); offset += chunkSize)
+			matcher.Scan(ToBytes(text.substr(offset, chunkSize)), [&matches](uint pattern) { matches.push_back(pattern); });
+
+		return matches;
+	}
+}
+
+
+namespace Test1
+{
+	TEST_CLASS(MultiPatternMatcherTest)
+	{
+	public:
+
+		TEST_METHOD(FindsPatterns)
+		{
+			Lib::MultiPatternMatcher matcher;
+
+			Assert::IsTrue(matcher.AddPattern("Kernel panic"sv));
+			Assert::IsTrue(matcher.AddPattern("Oops:"sv));
+			Assert::IsTrue(matcher.AddPattern("BUG:"sv));
+			Assert::IsFalse(matcher.AddPattern(""sv));
+			matcher.Build();
+
+			std::vector<uint> matches;
+			auto onMatch{ [&matches](uint pattern) { matches.push_back(pattern); } };
+
+			matcher.Scan(ToBytes("[    1.0] BUG: unable to handle\r\n[    1.1] Oops: 0000 [#1]\r\n"sv), onMatch);
+			matcher.Scan(ToBytes("[    1.2] Kernel pan"sv), onMatch);
+			Assert::IsTrue(matches == std::vector<uint>{ 2, 1 });
+
+			// The match straddles the buffers
+
+			matcher.Scan(ToBytes("ic - not syncing"sv), onMatch);
+			Assert::IsTrue(matches == std::vector<uint>{ 2, 1, 0 });
+
+			// Almost matches don't
+
+			matches.clear();
+			matcher.Scan(ToBytes("Kernel pani Oops BUG BUG;"sv), onMatch);
+			Assert::IsTrue(matches.empty());
+		}
+
+		TEST_METHOD(OverlappingPatterns)
+		{
+			Lib::MultiPatternMatcher matcher;
+
+			matcher.AddPattern("he"sv);
+			matcher.AddPattern("she"sv);
+			matcher.AddPattern("his"sv);
+			matcher.AddPattern("hers"sv);
+			matcher.Build();
+
+			// Patterns that end at the same byte are reported by index,
+			// whatever the size of the buffers
+
+			for (size_t chunkSize : { 1, 2, 3, 100 })
+				Assert::IsTrue(ScanChunks(matcher, "ushers his"sv, chunkSize) == std::vector<uint>{ 0, 1, 3, 2 });
+		}
+
+		TEST_METHOD(ScanThroughput)
+		{
+			Lib::MultiPatternMatcher matcher;
+
+			for (auto pattern : { "Kernel panic"sv, "Oops:"sv, "BUG:"sv, "Unable to handle"sv, "---[ end trace"sv })
+				matcher.AddPattern(pattern);
+
+			matcher.Build();
+
+			// Boot log text with the patterns' first letters, which is slower
+			// to scan than random data
+
+			std::string text;
+
+			while (text.size() < 1024 * 1024)
+				text += "[    3.141592] Kernel: Booting Unable Of Oops BUG ---[ usb 1-1: new device\r\n";
+
+			constexpr int cNumRounds{ 20 };
+			uint numMatches{};
+
+			auto startTime{ std::chrono::steady_clock::now() };
+
+			for (int round{}; round < cNumRounds; ++round)
+				matcher.Scan(ToBytes(text), [&numMatches](uint) { ++numMatches; });
+
+			std::chrono::duration<double, std::nano> time{ std::chrono::steady_clock::now() - startTime };
+			double timePerByte{ time.count() / (cNumRounds * text.size()) };
+
+			Assert::AreEqual(0u, numMatches);
+
+			// A serial port at 5 Mbaud receives 500 KB/s
+
+			std::wostringstream message;
+			message << std::fixed << std::setprecision(2);
+			message << L"Pattern scan " << timePerByte << L" ns/byte, "
+					<< timePerByte * 500000 / 1e7 << L"% of a core at 5 Mbaud\n";
+
+			Logger::WriteMessage(message.str().c_str());
+		}
+	};
+}
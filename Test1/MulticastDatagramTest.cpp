@@ -0,0 +1,85 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#include "MulticastDatagram.h"
+
+
+namespace
+{
+	// A datagram as Sernic sends it: the header and the data
+	//
+	std::vector<uint8_t> MakeDatagram(const uint64_t sequence, const std::string_view data)
+	{
+		MulticastHeader header{ .magic = cMulticastMagic, .dataSize = (uint32_t)data.size(), .sequence = sequence };
+		std::vector<uint8_t> datagram(sizeof(header));
+
+		std::memcpy(datagram.data(), &header, sizeof(header));
+		datagram.insert(datagram.end(), data.begin(), data.end());
+
+		return datagram;
+	}
+}
+
+
+namespace Test1
+{
+	TEST_CLASS(MulticastDatagramTest)
+	{
+	public:
+
+		TEST_METHOD(ReadsDatagrams)
+		{
+			MulticastHeader header{};
+			std::span<const uint8_t> data;
+
+			auto datagram{ MakeDatagram(7, "login: "sv) };
+
+			Assert::IsTrue(ReadMulticastDatagram(datagram, header, data));
+			Assert::AreEqual((uint64_t)7, header.sequence);
+			Assert::IsTrue(std::ranges::equal(data, "login: "sv));
+
+			// Not valid: a datagram of another program, cut short or too short for a header
+
+			auto otherDatagram{ datagram };
+			otherDatagram[0] = 'X';
+
+			Assert::IsFalse(ReadMulticastDatagram(otherDatagram, header, data));
+			Assert::IsFalse(ReadMulticastDatagram({ datagram.data(), datagram.size() - 1 }, header, data));
+			Assert::IsFalse(ReadMulticastDatagram({ datagram.data(), sizeof(header) - 1 }, header, data));
+
+			Assert::IsTrue(ReadMulticastDatagram(MakeDatagram(8, {}), header, data));
+			Assert::IsTrue(data.empty());
+		}
+
+		TEST_METHOD(FindsGaps)
+		{
+			MulticastSequence sequence;
+
+			// The receiver joins in the middle of the stream
+
+			Assert::AreEqual((uint64_t)0, sequence.Add(100));
+			Assert::AreEqual((uint64_t)0, sequence.Add(101));
+			Assert::AreEqual((uint64_t)2, sequence.Add(104));
+			Assert::AreEqual((uint64_t)0, sequence.Add(105));
+			Assert::AreEqual((uint64_t)2, sequence.GetNumLost());
+
+			// A reordered datagram is lost and then late, a duplicate is late
+
+			Assert::AreEqual((uint64_t)1, sequence.Add(107));
+			Assert::AreEqual((uint64_t)0, sequence.Add(106));
+			Assert::AreEqual((uint64_t)0, sequence.Add(107));
+			Assert::AreEqual((uint64_t)2, sequence.GetNumLate());
+
+			// Sernic was started again
+
+			Assert::AreEqual((uint64_t)0, sequence.Add(0));
+			Assert::AreEqual((uint64_t)1, sequence.Add(2));
+
+			Assert::AreEqual((uint64_t)7, sequence.GetNumReceived());
+			Assert::AreEqual((uint64_t)4, sequence.GetNumLost());
+			Assert::AreEqual((uint64_t)1, sequence.GetNumRestarts());
+		}
+	};
+}
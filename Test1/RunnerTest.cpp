@@ -0,0 +1,177 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#include "LocalClient.h"
+#include "Runner.h"
+
+
+namespace
+{
+	// A client whose event is always signaled, as if it had a new
+	// completion every time the runner checks it
+	//
+	class BusyClient : public IClient
+	{
+	public:
+		~BusyClient()
+		{
+			if (m_event != WSA_INVALID_EVENT)
+				WSACloseEvent(m_event);
+		}
+
+		uint Open(std::span<WSAEVENT> events) override
+		{
+			m_event = WSACreateEvent();
+			WSASetEvent(m_event);
+			events[0] = m_event;
+
+			return 1;
+		}
+
+		int ProcessEvent(uint index, Buffer** ppRxBuffer) override
+		{
+			++m_numEvents;
+			return 0;		// the event is not reset
+		}
+
+		bool Send(const Buffer* pBuffer) override
+		{
+			return true;
+		}
+
+		uint m_numEvents{};
+
+	private:
+		WSAEVENT m_event{ WSA_INVALID_EVENT };
+	};
+
+
+	int64_t GetTime()
+	{
+		return std::chrono::steady_clock::now().time_since_epoch().count();
+	}
+
+
+	// Measures the time from a write on the serial side until the console
+	// channel gets the byte, with a pause before each write so that the
+	// runner has gone to sleep (unless it is still polling).
+	// Returns the times in us, sorted.
+	//
+	std::vector<double> MeasureWakeUps(const std::chrono::microseconds spinBudget)
+	{
+		constexpr uint cNumSamples{ 300 };
+
+		BufferPool bufferPool{ 16 };
+		std::atomic<int64_t> receiveTime{};
+
+		LocalClient serialClient{ "Serial"sv, bufferPool, [](std::span<const uint8_t>) {} };
+		LocalClient consoleClient{ "Console"sv, bufferPool, [&receiveTime](std::span<const uint8_t>)
+			{
+				receiveTime.store(GetTime(), std::memory_order_release);
+			} };
+
+		Runner runner{ serialClient, &consoleClient, nullptr, nullptr, nullptr };
+
+		if (spinBudget > 0us)
+			runner.SetBusyPoll(Runner::cNoCore, spinBudget);
+
+		std::thread thread{ [&runner] { runner.Run(); } };
+		std::vector<double> times;
+		const uint8_t byte{ 'x' };
+
+		// The first sample waits for the runner to start
+
+		for (uint sample{}; sample <= cNumSamples; ++sample)
+		{
+			std::this_thread::sleep_for(500us);
+			receiveTime.store(0, std::memory_order_relaxed);
+
+			int64_t sendTime{ GetTime() };
+			serialClient.Write({ &byte, 1 });
+
+			int64_t time{};
+
+			while ((time = receiveTime.load(std::memory_order_acquire)) == 0)
+				std::this_thread::yield();
+
+			if (sample > 0)
+				times.push_back(std::chrono::duration<double, std::micro>{ std::chrono::steady_clock::duration{ time - sendTime } }.count());
+		}
+
+		runner.Close();
+		thread.join();
+
+		std::ranges::sort(times);
+
+		return times;
+	}
+
+
+	void PrintWakeUps(std::wostream& os, const std::vector<double>& times)
+	{
+		auto percentile{ [&times](const double fraction) { return times[(size_t)(fraction * (times.size() - 1))]; } };
+
+		os << L"median " << percentile(0.5) << L" us, 90% " << percentile(0.9) << L" us, 99% " << percentile(0.99)
+				<< L" us, max " << times.back() << L" us";
+	}
+}
+
+
+namespace Test1
+{
+	TEST_CLASS(RunnerTest)
+	{
+	public:
+
+		TEST_METHOD(NoClientStarves)
+		{
+			BusyClient serialClient;
+			BusyClient consoleClient;
+			BusyClient gdbClient;
+			BusyClient rawClient;
+			Runner runner{ serialClient, &consoleClient, &gdbClient, &rawClient, nullptr };
+
+			std::thread thread{ [&runner] { runner.Run(); } };
+
+			std::this_thread::sleep_for(200ms);
+			runner.Close();
+			thread.join();
+
+			// Every wake-up dispatches all the ready events, so the counts
+			// differ by at most one (the round interrupted by Close)
+
+			auto [minEvents, maxEvents] = std::minmax({
+					serialClient.m_numEvents,
+					consoleClient.m_numEvents,
+					gdbClient.m_numEvents,
+					rawClient.m_numEvents });
+
+			Assert::IsTrue(minEvents > 0);
+			Assert::IsTrue(maxEvents - minEvents <= 1);
+		}
+
+		// The latency of serial data to a channel when the runner blocks
+		// and when it polls (with a budget longer than the pause before
+		// each write)
+		//
+		TEST_METHOD(WakeUpLatency)
+		{
+			auto blockingTimes{ MeasureWakeUps(0us) };
+			auto pollingTimes{ MeasureWakeUps(100ms) };
+
+			std::wostringstream message;
+			message << std::fixed << std::setprecision(1);
+			message << L"Wake-up latency blocking: ";
+			PrintWakeUps(message, blockingTimes);
+			message << L"\nWake-up latency polling:  ";
+			PrintWakeUps(message, pollingTimes);
+			message << L"\n";
+
+			Logger::WriteMessage(message.str().c_str());
+
+			Assert::AreEqual(blockingTimes.size(), pollingTimes.size());
+		}
+	};
+}
@@ -0,0 +1,142 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#include "LocalClient.h"
+#include "Runner.h"
+
+
+namespace
+{
+	// The panic message is split between two reads
+	constexpr std::array cSerialData
+	{
+		"[   12.345678] Kernel pa"sv,
+		"nic - not syncing\r\n"sv,
+		"[   12.345679] after the panic\r\n"sv
+	};
+
+
+	// A serial port that receives cSerialData once
+	//
+	class ScriptedSerialClient : public IClient
+	{
+	public:
+		explicit ScriptedSerialClient(BufferPool& bufferPool)
+			: m_bufferPool{ bufferPool }
+		{
+		}
+
+		~ScriptedSerialClient()
+		{
+			if (m_event != WSA_INVALID_EVENT)
+				WSACloseEvent(m_event);
+		}
+
+		uint Open(std::span<WSAEVENT> events) override
+		{
+			m_event = WSACreateEvent();
+			WSASetEvent(m_event);
+			events[0] = m_event;
+
+			return 1;
+		}
+
+		int ProcessEvent(uint index, Buffer** ppRxBuffer) override
+		{
+			if (m_numReceived == cSerialData.size())
+			{
+				m_isDone.store(true, std::memory_order_release);
+				WSAResetEvent(m_event);
+
+				return 0;
+			}
+
+			auto text{ cSerialData[m_numReceived++] };
+			Buffer* pBuffer{ m_bufferPool.GetBuffer() };
+
+			std::copy(text.begin(), text.end(), pBuffer->GetBufferPtr());
+			pBuffer->SetDataSize(text.size());
+			*ppRxBuffer = pBuffer;
+
+			return (int)pBuffer->GetDataSize();
+		}
+
+		bool Send(const Buffer* pBuffer) override
+		{
+			m_bufferPool.PutBuffer(pBuffer);
+			return true;
+		}
+
+		std::atomic<bool> m_isDone{};
+
+	private:
+		BufferPool& m_bufferPool;
+		WSAEVENT m_event{ WSA_INVALID_EVENT };
+		uint m_numReceived{};
+	};
+}
+
+
+namespace Test1
+{
+	TEST_CLASS(RunnerTriggerTest)
+	{
+	public:
+
+		TEST_METHOD(PausesAndNotifies)
+		{
+			BufferPool bufferPool{ 16 + 2 * LocalClient::cNumRxBuffers };
+			ScriptedSerialClient serialClient{ bufferPool };
+			std::string consoleText;
+			std::string rawText;
+			std::vector<std::string> triggers;
+
+			auto appendTo{ [](std::string& text)
+				{
+					return [&text](std::span<const uint8_t> data) { text.append(data.begin(), data.end()); };
+				} };
+
+			LocalClient consoleClient{ "Console"sv, bufferPool, appendTo(consoleText) };
+			LocalClient rawClient{ "Raw"sv, bufferPool, appendTo(rawText) };
+			Runner runner{ serialClient, &consoleClient, nullptr, &rawClient, nullptr };
+
+			Lib::MultiPatternMatcher matcher;
+
+			for (auto pattern : cDefaultTriggerPatterns)
+				matcher.AddPattern(pattern);
+
+			matcher.Build();
+
+			runner.SetTriggers(
+					matcher,
+					{ .pauseConsole = true, .notifyChannels = true },
+					bufferPool,
+					[&triggers](std::string_view pattern) { triggers.emplace_back(pattern); });
+
+			std::thread thread{ [&runner] { runner.Run(); } };
+
+			while (!serialClient.m_isDone.load(std::memory_order_acquire))
+				std::this_thread::yield();
+
+			runner.Close();
+			thread.join();
+
+			Assert::AreEqual(size_t{ 1 }, triggers.size());
+			Assert::AreEqual("Kernel panic"s, triggers[0]);
+
+			// The console gets the line with the match and the notice, and
+			// nothing after it; the raw channel gets everything
+
+			Assert::IsTrue(consoleText.starts_with(std::string{ cSerialData[0] } + std::string{ cSerialData[1] }));
+			Assert::IsTrue(consoleText.contains("*** Sernic trigger: Kernel panic (console paused"sv));
+			Assert::IsFalse(consoleText.contains("after the panic"sv));
+
+			Assert::IsTrue(rawText.contains("*** Sernic trigger: Kernel panic"sv));
+			Assert::IsTrue(rawText.ends_with(cSerialData[2]));
+
+			Assert::AreEqual((size_t)16, (size_t)bufferPool.GetNumFree());		// the rest are held by the local channels
+		}
+	};
+}
@@ -0,0 +1,201 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#include "SerialClient.h"
+
+
+namespace
+{
+	constexpr auto cPipeName{ R"(\\.\pipe\SernicSerialTest)"sv };
+	constexpr uint cPoolSize{ 512 };		// well above the pool level that pauses receiving
+
+
+	// Serial client whose port is a named pipe. The test holds the other
+	// end and plays the target: closing it loses the port, creating the
+	// pipe again brings the port back.
+	//
+	class PipeSerialClient : public SerialClient
+	{
+	public:
+		explicit PipeSerialClient(BufferPool& bufferPool)
+			: SerialClient{ cPipeName, 115200, FlowControl::Default, 2, TxScheduler::cStrictPriority, bufferPool }
+		{
+		}
+
+	private:
+		// A pipe has no settings and no line errors
+		bool ConfigurePort() override { return true; }
+		bool StartWaitingForErrors() override { return true; }
+		bool UpdateMetrics() override { return true; }
+	};
+
+
+	// Runs the client's events on the test's thread, as Runner would,
+	// and collects the data received on the port
+	//
+	class PortDriver
+	{
+	public:
+		PortDriver(IClient& client, BufferPool& bufferPool)
+			: m_client{ client }
+			, m_bufferPool{ bufferPool }
+		{
+		}
+
+		bool Open()
+		{
+			m_numEvents = m_client.Open(m_events);
+			return m_numEvents > 0;
+		}
+
+		// Processes events until isDone returns true.
+		// Returns false on timeout or if the client fails.
+		//
+		template<typename Predicate>
+		bool RunUntil(Predicate isDone, const std::chrono::milliseconds timeout = 2000ms)
+		{
+			auto deadline{ std::chrono::steady_clock::now() + timeout };
+
+			while (!isDone())
+			{
+				auto remaining{ std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()) };
+
+				if (remaining <= 0ms)
+					return false;
+
+				DWORD result{ WaitForMultipleObjects(m_numEvents, m_events.data(), FALSE, (DWORD)remaining.count()) };
+
+				if (result == WAIT_TIMEOUT)
+					continue;
+
+				Buffer* pBuffer{};
+
+				if (m_client.ProcessEvent(result - WAIT_OBJECT_0, &pBuffer) < 0)
+				{
+					m_hasFailed = true;
+					return false;
+				}
+
+				if (pBuffer)
+				{
+					auto data{ pBuffer->GetData() };
+					m_received.append(data.begin(), data.end());
+					m_bufferPool.PutBuffer(pBuffer);
+				}
+			}
+
+			return true;
+		}
+
+		const std::string& GetReceived() const { return m_received; }
+		bool HasFailed() const { return m_hasFailed; }
+
+	private:
+		IClient& m_client;
+		BufferPool& m_bufferPool;
+		std::array<WSAEVENT, 8> m_events{};
+		DWORD m_numEvents{};
+		std::string m_received;
+		bool m_hasFailed{};
+	};
+
+
+	// Creates the target's end of the pipe, which the client opens as its port
+	//
+	HANDLE CreateTarget()
+	{
+		return CreateNamedPipeA(
+				cPipeName.data(),
+				PIPE_ACCESS_DUPLEX,
+				PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT,
+				1,			// instances
+				4096,		// out buffer size
+				4096,		// in buffer size
+				0,			// default timeout
+				NULL);		// security attributes
+	}
+
+
+	bool WriteToPort(const HANDLE target, const std::string_view text)
+	{
+		DWORD written{};
+		return WriteFile(target, text.data(), (DWORD)text.size(), &written, NULL) && written == text.size();
+	}
+
+
+	// Appends what the client has sent to the text, without waiting
+	//
+	void ReadFromPort(const HANDLE target, std::string& text)
+	{
+		DWORD available{};
+
+		if (!PeekNamedPipe(target, NULL, 0, NULL, &available, NULL) || available == 0)
+			return;
+
+		std::string data(available, '\0');
+		DWORD bytesRead{};
+
+		if (ReadFile(target, data.data(), available, &bytesRead, NULL))
+			text.append(data, 0, bytesRead);
+	}
+}
+
+
+namespace Test1
+{
+	TEST_CLASS(SerialClientTest)
+	{
+	public:
+
+		TEST_METHOD(ReopensLostPort)
+		{
+			BufferPool bufferPool{ cPoolSize };
+			HANDLE target{ CreateTarget() };
+
+			Assert::IsTrue(target != INVALID_HANDLE_VALUE);
+
+			PipeSerialClient client{ bufferPool };
+			IClient& iClient{ client };
+			PortDriver driver{ iClient, bufferPool };
+
+			Assert::IsTrue(driver.Open());
+			Assert::IsTrue(WriteToPort(target, "boot"));
+			Assert::IsTrue(driver.RunUntil([&] { return driver.GetReceived() == "boot"; }));
+
+			// The reads fail when the target goes away. The loops are torn
+			// down without waking up, and the port is closed once the reads
+			// have finished, which returns their buffers to the pool.
+
+			CloseHandle(target);
+			Assert::IsTrue(driver.RunUntil([&] { return bufferPool.GetNumFree() == cPoolSize; }));
+
+			// Data sent meanwhile is held, the probes don't fail the client
+
+			Buffer* pBuffer{ bufferPool.GetBuffer() };
+			const std::string_view held{ "held" };
+			std::copy(held.begin(), held.end(), pBuffer->GetBufferPtr());
+			pBuffer->SetDataSize(held.size());
+
+			Assert::IsTrue(iClient.Send(pBuffer));
+			driver.RunUntil([] { return false; }, 100ms);
+			Assert::IsFalse(driver.HasFailed());
+			Assert::AreEqual((size_t)cPoolSize - 1, bufferPool.GetNumFree());
+
+			// The target is back: the held data is sent after the port is
+			// reopened, and the port receives again
+
+			target = CreateTarget();
+			Assert::IsTrue(target != INVALID_HANDLE_VALUE);
+
+			std::string sent;
+			Assert::IsTrue(driver.RunUntil([&] { ReadFromPort(target, sent); return sent == held; }));
+
+			Assert::IsTrue(WriteToPort(target, "back"));
+			Assert::IsTrue(driver.RunUntil([&] { return driver.GetReceived() == "bootback"; }));
+
+			CloseHandle(target);
+		}
+	};
+}
@@ -0,0 +1,76 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#include "SerialMetrics.h"
+
+
+namespace Test1
+{
+	TEST_CLASS(SerialMetricsTest)
+	{
+	public:
+
+		TEST_METHOD(CountsErrors)
+		{
+			SerialMetrics metrics;
+
+			Assert::IsFalse(metrics.HasErrors());
+
+			metrics.AddErrors(0);
+			Assert::IsFalse(metrics.HasErrors());
+
+			metrics.AddErrors(CE_FRAME | CE_OVERRUN);
+			metrics.AddErrors(CE_OVERRUN);
+			metrics.AddErrors(CE_RXPARITY | CE_RXOVER | CE_BREAK);
+
+			Assert::IsTrue(metrics.HasErrors());
+			Assert::AreEqual(1u, metrics.numFramingErrors);
+			Assert::AreEqual(1u, metrics.numParityErrors);
+			Assert::AreEqual(2u, metrics.numOverruns);
+			Assert::AreEqual(1u, metrics.numRxOverflows);
+			Assert::AreEqual(1u, metrics.numBreaks);
+		}
+
+		TEST_METHOD(KeepsExtremes)
+		{
+			SerialMetrics metrics;
+			COMSTAT comStat{};
+
+			comStat.cbInQue = 100;
+			comStat.cbOutQue = 5;
+			metrics.AddSample(comStat, 2000, 3);
+
+			comStat.cbInQue = 40;
+			comStat.cbOutQue = 50;
+			metrics.AddSample(comStat, 1500, 1);
+
+			comStat.cbInQue = 0;
+			comStat.cbOutQue = 0;
+			metrics.AddSample(comStat, 1800, 0);
+
+			Assert::AreEqual(100u, metrics.maxDriverRxQueue);
+			Assert::AreEqual(50u, metrics.maxDriverTxQueue);
+			Assert::AreEqual(1500u, metrics.minFreeBuffers);
+			Assert::AreEqual(3u, metrics.maxTxQueued);
+		}
+
+		TEST_METHOD(CountsReconnects)
+		{
+			SerialMetrics metrics;
+
+			metrics.AddReconnect(250ms);
+			metrics.AddReconnect(40ms);
+
+			Assert::IsFalse(metrics.HasErrors());
+			Assert::AreEqual(2u, metrics.numReconnects);
+			Assert::AreEqual(250u, metrics.maxReconnectTime);
+
+			std::ostringstream report;
+			metrics.Print(report, "COM3"sv, 10s);
+
+			Assert::IsTrue(report.str().ends_with("; reconnects 2, longest 250 ms"sv));
+		}
+	};
+}
@@ -0,0 +1,190 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#include "Lib/SharedRing.h"
+
+
+namespace
+{
+	constexpr uint cBlockSize{ 124 };
+	constexpr uint cNumBlocks{ 16 };
+	constexpr uint cNumThreadBlocks{ 1'000'000 };
+
+
+	// Memory standing in for a shared mapping
+	//
+	struct SharedMemory
+	{
+		SharedMemory()
+			: memory(Lib::SharedRing::GetMemorySize(cBlockSize, cNumBlocks) / cCacheLineSize + 1)
+		{
+		}
+
+		void* Get() { return memory.data(); }
+		size_t GetSize() const { return memory.size() * cCacheLineSize; }
+
+		struct alignas(cCacheLineSize) Line { std::byte bytes[cCacheLineSize]; };
+		std::vector<Line> memory;
+	};
+
+
+	bool WriteValue(Lib::SharedRing& ring, const uint value, bool& mustRing)
+	{
+		return ring.Write({ (const uint8_t*)&value, sizeof value }, mustRing);
+	}
+
+
+	bool ReadValue(Lib::SharedRing& ring, uint& value)
+	{
+		auto data{ ring.Front() };
+
+		if (data.size() != sizeof value)
+			return false;
+
+		std::copy(data.begin(), data.end(), (uint8_t*)&value);
+		ring.Pop();
+
+		return true;
+	}
+}
+
+
+namespace Test1
+{
+	TEST_CLASS(SharedRingTest)
+	{
+	public:
+
+		TEST_METHOD(WriteAndRead)
+		{
+			SharedMemory memory;
+			Lib::SharedRing writer;
+			Lib::SharedRing reader;
+
+			Assert::IsFalse(reader.Attach(memory.Get(), memory.GetSize()));		// not initialized
+
+			writer.Initialize(memory.Get(), cBlockSize, cNumBlocks);
+
+			Assert::IsFalse(reader.Attach(memory.Get(), sizeof(Lib::SharedRingHeader)));
+			Assert::IsTrue(reader.Attach(memory.Get(), memory.GetSize()));
+			Assert::IsTrue(reader.GetMaxDataSize() == cBlockSize - Lib::SharedRing::cBlockHeaderSize);
+
+			// Go around the ring a few times
+
+			bool mustRing{};
+			uint value{};
+
+			for (uint round{}; round < 3; ++round)
+			{
+				for (uint i{}; i < cNumBlocks; ++i)
+					Assert::IsTrue(WriteValue(writer, round * 100 + i, mustRing));
+
+				Assert::IsFalse(WriteValue(writer, 0, mustRing));		// full
+				Assert::AreEqual(reader.GetNumUsedBlocks(), cNumBlocks);
+
+				for (uint i{}; i < cNumBlocks; ++i)
+				{
+					Assert::IsTrue(ReadValue(reader, value));
+					Assert::AreEqual(value, round * 100 + i);
+				}
+
+				Assert::IsTrue(reader.Front().empty());
+			}
+
+			std::vector<uint8_t> tooLarge(cBlockSize);
+			Assert::IsFalse(writer.Write(tooLarge, mustRing));
+		}
+
+		TEST_METHOD(Doorbell)
+		{
+			SharedMemory memory;
+			Lib::SharedRing writer;
+			Lib::SharedRing reader;
+
+			writer.Initialize(memory.Get(), cBlockSize, cNumBlocks);
+			reader.Attach(memory.Get(), memory.GetSize());
+
+			bool mustRing{};
+
+			// Nobody is waiting
+
+			WriteValue(writer, 1, mustRing);
+			Assert::IsFalse(mustRing);
+
+			// The ring is not empty, so the reader must not sleep
+
+			Assert::IsFalse(reader.ArmDoorbell());
+
+			uint value{};
+			ReadValue(reader, value);
+
+			// The reader sleeps, only the first write wakes it up
+
+			Assert::IsTrue(reader.ArmDoorbell());
+
+			WriteValue(writer, 2, mustRing);
+			Assert::IsTrue(mustRing);
+
+			WriteValue(writer, 3, mustRing);
+			Assert::IsFalse(mustRing);
+		}
+
+		TEST_METHOD(ReaderThread)
+		{
+			SharedMemory memory;
+			Lib::SharedRing writer;
+			Lib::SharedRing reader;
+
+			writer.Initialize(memory.Get(), cBlockSize, cNumBlocks);
+			reader.Attach(memory.Get(), memory.GetSize());
+
+			std::atomic<uint> numRings{};
+			bool isOk{ true };
+
+			std::thread thread{ [&]
+				{
+					for (uint expected{}; expected < cNumThreadBlocks && isOk; )
+					{
+						uint value{};
+
+						if (ReadValue(reader, value))
+						{
+							isOk = value == expected++;
+							continue;
+						}
+
+						// Sleep until the doorbell rings
+
+						if (reader.ArmDoorbell())
+						{
+							while (numRings.load() == 0)
+								std::this_thread::yield();
+
+							--numRings;
+						}
+					}
+				} };
+
+			for (uint n{}; n < cNumThreadBlocks; )
+			{
+				bool mustRing{};
+
+				if (WriteValue(writer, n, mustRing))
+				{
+					++n;
+
+					if (mustRing)
+						++numRings;
+				}
+				else
+					std::this_thread::yield();
+			}
+
+			thread.join();
+
+			Assert::IsTrue(isOk);
+		}
+	};
+}
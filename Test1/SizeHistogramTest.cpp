@@ -0,0 +1,47 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#include "Lib/SizeHistogram.h"
+
+
+namespace Test1
+{
+	TEST_CLASS(SizeHistogramTest)
+	{
+	public:
+
+		TEST_METHOD(Buckets)
+		{
+			using Lib::SizeHistogram;
+
+			Assert::AreEqual(SizeHistogram::GetBucket(0), 0u);
+			Assert::AreEqual(SizeHistogram::GetBucket(1), 1u);
+			Assert::AreEqual(SizeHistogram::GetBucket(119), 7u);
+			Assert::AreEqual(SizeHistogram::GetBucket(120), 7u);
+			Assert::AreEqual(SizeHistogram::GetBucket(128), 8u);
+			Assert::AreEqual(SizeHistogram::GetBucket(1'000'000), SizeHistogram::cNumBuckets - 1);
+
+			SizeHistogram histogram;
+
+			histogram.Add(1);
+			histogram.Add(100);
+			histogram.Add(120);
+			histogram.Add(4096);
+
+			Assert::IsTrue(histogram.GetNumSamples() == 4);
+			Assert::IsTrue(histogram.GetTotalSize() == 4317);
+			Assert::IsTrue(histogram.GetCount(7) == 2);
+
+			std::ostringstream text;
+			histogram.Print(text);
+
+			Assert::IsTrue(text.str() == " 1-1:1 64-127:2 4096-8191:1");
+
+			histogram.Clear();
+
+			Assert::IsTrue(histogram.GetNumSamples() == 0 && histogram.GetCount(7) == 0);
+		}
+	};
+}
@@ -0,0 +1,110 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#include "Lib/SubstringSearch.h"
+
+
+namespace
+{
+	std::span<const uint8_t> ToBytes(const std::string_view text)
+	{
+		return { (const uint8_t*)text.data(), text.size() };
+	}
+
+
+	// Returns the positions of all the matches, which may overlap
+	//
+	std::vector<size_t> FindAll(const std::string_view text, const std::string_view pattern)
+	{
+		Lib::SubstringSearch search{ ToBytes(pattern) };
+		std::vector<size_t> positions;
+
+		for (size_t position{ search.Find(ToBytes(text)) }; position != Lib::SubstringSearch::npos; position = search.Find(ToBytes(text), position + 1))
+			positions.push_back(position);
+
+		return positions;
+	}
+}
+
+
+namespace Test1
+{
+	TEST_CLASS(SubstringSearchTest)
+	{
+	public:
+
+		TEST_METHOD(FindsAllMatches)
+		{
+			// Matches in the 16-byte blocks and in the bytes after the last block
+
+			std::string text(100, '.');
+			text.replace(3, 5, "panic");
+			text.replace(30, 5, "panic");
+			text.replace(95, 5, "panic");
+
+			Assert::IsTrue(FindAll(text, "panic"sv) == std::vector<size_t>{ 3, 30, 95 });
+			Assert::IsTrue(FindAll(text, "p"sv) == std::vector<size_t>{ 3, 30, 95 });
+			Assert::IsTrue(FindAll(text, "pa"sv) == std::vector<size_t>{ 3, 30, 95 });
+			Assert::IsTrue(FindAll("aaaa"sv, "aa"sv) == std::vector<size_t>{ 0, 1, 2 });
+
+			// The first and last bytes match, the middle doesn't
+
+			Assert::IsTrue(FindAll("pXXXc panic pYYYc"sv, "panic"sv) == std::vector<size_t>{ 6 });
+			Assert::IsTrue(FindAll("pani"sv, "panic"sv).empty());
+		}
+
+		TEST_METHOD(SameAsStringFind)
+		{
+			// Text of few letters, so partial matches are common
+
+			std::string text;
+			uint32_t seed{ 12345 };
+
+			for (uint n{}; n < 5000; ++n)
+			{
+				seed = seed * 1103515245 + 12345;
+				text.push_back("abc\n"[(seed >> 16) % 4]);
+			}
+
+			for (auto pattern : { "a"sv, "ab"sv, "abc"sv, "cab\n"sv, "abcabca"sv, "\nabcabcabcabcabcabc"sv })
+			{
+				std::vector<size_t> expected;
+
+				for (size_t position{ text.find(pattern) }; position != std::string::npos; position = text.find(pattern, position + 1))
+					expected.push_back(position);
+
+				Assert::IsTrue(FindAll(text, pattern) == expected);
+			}
+		}
+
+		TEST_METHOD(SearchThroughput)
+		{
+			std::string text;
+
+			while (text.size() < 4 * 1024 * 1024)
+				text += "[    3.141592] Kernel: Booting Unable Of Oops BUG ---[ usb 1-1: new device\r\n";
+
+			Lib::SubstringSearch search{ ToBytes("Kernel panic"sv) };
+
+			constexpr int cNumRounds{ 20 };
+			size_t numMatches{};
+
+			auto startTime{ std::chrono::steady_clock::now() };
+
+			for (int round{}; round < cNumRounds; ++round)
+				numMatches += search.Find(ToBytes(text)) != Lib::SubstringSearch::npos;
+
+			std::chrono::duration<double> time{ std::chrono::steady_clock::now() - startTime };
+
+			Assert::AreEqual(size_t{ 0 }, numMatches);
+
+			std::wostringstream message;
+			message << std::fixed << std::setprecision(2);
+			message << L"Substring search " << cNumRounds * text.size() / time.count() / 1e9 << L" GB/s\n";
+
+			Logger::WriteMessage(message.str().c_str());
+		}
+	};
+}
@@ -0,0 +1,206 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#include "LocalClient.h"
+#include "TargetSimulator.h"
+#include "Runner.h"
+
+
+namespace
+{
+	// Collects the data a local channel gets, on the runner's thread, for
+	// the test's thread to wait for
+	//
+	class TextSink
+	{
+	public:
+		LocalClient::DataCallback GetCallback()
+		{
+			return [this](std::span<const uint8_t> data)
+				{
+					std::lock_guard lock{ m_mutex };
+					m_text.append(data.begin(), data.end());
+					m_received.notify_all();
+				};
+		}
+
+		size_t GetSize()
+		{
+			std::lock_guard lock{ m_mutex };
+			return m_text.size();
+		}
+
+		// Waits until the text has the part at or after the position.
+		// Returns the position after it, or npos on timeout.
+		//
+		size_t WaitFor(const std::string_view part, const size_t position = 0)
+		{
+			std::unique_lock lock{ m_mutex };
+			size_t found{ std::string::npos };
+
+			m_received.wait_for(lock, 10s, [&]
+				{
+					found = m_text.find(part, position);
+					return found != std::string::npos;
+				});
+
+			return found == std::string::npos ? found : found + part.size();
+		}
+
+	private:
+		std::mutex m_mutex;
+		std::condition_variable m_received;
+		std::string m_text;
+	};
+
+
+	std::string MakePacket(const std::string_view data)
+	{
+		uint8_t checksum{};
+
+		for (char c : data)
+			checksum += (uint8_t)c;
+
+		std::ostringstream packet;
+		packet << '$' << data << '#' << std::hex << std::setw(2) << std::setfill('0') << (uint)checksum;
+
+		return packet.str();
+	}
+
+
+	// The reply to m<address>,<size>: each byte is the low byte of its address
+	//
+	std::string MakeMemoryReply(const uint address, const uint size)
+	{
+		std::ostringstream data;
+		data << std::hex << std::setfill('0');
+
+		for (uint index{}; index < size; ++index)
+			data << std::setw(2) << ((address + index) & 0xFF);
+
+		return MakePacket(data.str());
+	}
+
+
+	size_t Write(LocalClient& client, const std::string_view text)
+	{
+		return client.Write({ (const uint8_t*)text.data(), text.size() });
+	}
+}
+
+
+namespace Test1
+{
+	TEST_CLASS(TargetSimulatorTest)
+	{
+	public:
+
+		TEST_METHOD(AnswersGdbAndConsole)
+		{
+			BufferPool bufferPool{ 64 + 2 * LocalClient::cNumRxBuffers };
+			TextSink console;
+			TextSink gdb;
+
+			TargetSimulator simulator{ "SIM"sv, { .baudRate = 0, .numBootLines = 0 }, bufferPool };
+			LocalClient consoleClient{ "Console"sv, bufferPool, console.GetCallback() };
+			LocalClient gdbClient{ "GDB"sv, bufferPool, gdb.GetCallback() };
+			Runner runner{ simulator, &consoleClient, &gdbClient, nullptr, nullptr };
+
+			std::thread thread{ [&runner] { runner.Run(); } };
+
+			Assert::AreNotEqual(std::string::npos, console.WaitFor("~ # "sv));
+
+			Write(gdbClient, MakePacket("?"sv));
+			Assert::AreNotEqual(std::string::npos, gdb.WaitFor("+" + MakePacket("S05"sv)));
+
+			Write(gdbClient, MakePacket("m1000,4"sv));
+			Assert::AreNotEqual(std::string::npos, gdb.WaitFor("+" + MakePacket("00010203"sv)));
+
+			Write(gdbClient, MakePacket("Mffff0000,2:abcd"sv));
+			Assert::AreNotEqual(std::string::npos, gdb.WaitFor("+" + MakePacket("OK"sv)));
+
+			// A bad checksum is refused
+
+			Write(gdbClient, "$g#00"sv);
+			Assert::AreNotEqual(std::string::npos, gdb.WaitFor("+" + MakePacket("OK"sv) + "-"));
+
+			Write(consoleClient, "uname\r"sv);
+			Assert::AreNotEqual(std::string::npos, console.WaitFor("uname\r\nLinux\r\n~ # "sv));
+
+			Write(consoleClient, "ls\r"sv);
+			Assert::AreNotEqual(std::string::npos, console.WaitFor("ls\r\nsh: ls: not found\r\n~ # "sv));
+
+			runner.Close();
+			thread.join();
+
+			Assert::AreEqual((size_t)64, (size_t)bufferPool.GetNumFree());		// the rest are held by the local channels
+		}
+
+		// Boots the target at 5 Mbaud with a console and a gdb client, and
+		// then reads memory from gdb
+		//
+		TEST_METHOD(Benchmark)
+		{
+			constexpr uint cBaudRate{ 5'000'000 };
+			constexpr uint cNumReads{ 200 };
+			constexpr uint cReadSize{ 256 };
+
+			BufferPool bufferPool{ 256 + 2 * LocalClient::cNumRxBuffers };
+			TextSink console;
+			TextSink gdb;
+
+			TargetSimulator simulator{ "SIM"sv, { .baudRate = cBaudRate, .numBootLines = 4000, .burstLines = 200, .burstInterval = 5ms }, bufferPool };
+			LocalClient consoleClient{ "Console"sv, bufferPool, console.GetCallback() };
+			LocalClient gdbClient{ "GDB"sv, bufferPool, gdb.GetCallback() };
+			Runner runner{ simulator, &consoleClient, &gdbClient, nullptr, nullptr };
+
+			auto startTime{ std::chrono::steady_clock::now() };
+			std::thread thread{ [&runner] { runner.Run(); } };
+
+			// The prompt follows the boot log
+
+			Assert::AreNotEqual(std::string::npos, console.WaitFor("\r\n~ # "sv));
+
+			std::chrono::duration<double> bootTime{ std::chrono::steady_clock::now() - startTime };
+			size_t consoleSize{ console.GetSize() };
+
+			std::vector<double> roundTrips;
+
+			for (uint read{}; read < cNumReads; ++read)
+			{
+				uint address{ 0x1000 + read * cReadSize };
+				std::ostringstream request;
+				request << 'm' << std::hex << address << ',' << cReadSize;
+
+				size_t position{ gdb.GetSize() };
+				auto sendTime{ std::chrono::steady_clock::now() };
+
+				Write(gdbClient, MakePacket(request.str()));
+				Assert::AreNotEqual(std::string::npos, gdb.WaitFor(MakeMemoryReply(address, cReadSize), position));
+
+				roundTrips.push_back(std::chrono::duration<double, std::micro>{ std::chrono::steady_clock::now() - sendTime }.count());
+			}
+
+			runner.Close();
+			thread.join();
+
+			std::ranges::sort(roundTrips);
+
+			// The time the line takes to carry the request and the reply (with
+			// the acknowledgement), 10 bits a byte
+			double lineTime{ (MakePacket("m1000,100"sv).size() + MakeMemoryReply(0, cReadSize).size() + 1) * 10 * 1e6 / cBaudRate };
+
+			std::wostringstream message;
+			message << std::fixed << std::setprecision(1);
+			message << L"Console " << consoleSize / bootTime.count() / 1024 << L" KB/s (line " << cBaudRate / 10 / 1024 << L" KB/s), "
+					<< L"gdb m" << cReadSize << L" round trip median " << roundTrips[roundTrips.size() / 2]
+					<< L" us, max " << roundTrips.back() << L" us (line " << lineTime << L" us)\n";
+
+			Logger::WriteMessage(message.str().c_str());
+
+			Assert::AreEqual((size_t)256, (size_t)bufferPool.GetNumFree());		// the rest are held by the local channels
+		}
+	};
+}
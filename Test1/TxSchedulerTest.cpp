@@ -0,0 +1,150 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#include "TxScheduler.h"
+
+
+namespace
+{
+	constexpr uint cNumQueueBuffers{ 64 };
+
+
+	Buffer* MakeBuffer(BufferPool& bufferPool, const std::string_view text)
+	{
+		Buffer* pBuffer{ bufferPool.GetBuffer() };
+
+		std::copy(text.begin(), text.end(), pBuffer->GetBufferPtr());
+		pBuffer->SetDataSize(text.size());
+
+		return pBuffer;
+	}
+
+
+	// Returns the text of the next buffer sent, or "-" if there is none
+	//
+	std::string SendNext(TxScheduler& scheduler, BufferPool& bufferPool)
+	{
+		const Buffer* pBuffer{ scheduler.Front() };
+
+		if (!pBuffer)
+			return "-";
+
+		auto data{ pBuffer->GetData() };
+		std::string text{ data.begin(), data.end() };
+
+		scheduler.Pop();
+		bufferPool.PutBuffer(pBuffer);
+
+		return text;
+	}
+}
+
+
+namespace Test1
+{
+	TEST_CLASS(TxSchedulerTest)
+	{
+	public:
+
+		TEST_METHOD(StrictPriority)
+		{
+			BufferPool bufferPool{ 16 };
+			TxScheduler scheduler{ cNumQueueBuffers, TxScheduler::cStrictPriority };
+
+			Assert::IsNull(scheduler.Front());
+
+			scheduler.Push(TxSource::Console, MakeBuffer(bufferPool, "c1"));
+			scheduler.Push(TxSource::Raw, MakeBuffer(bufferPool, "r1"));
+			scheduler.Push(TxSource::Gdb, MakeBuffer(bufferPool, "+"));
+			scheduler.Push(TxSource::Console, MakeBuffer(bufferPool, "c2"));
+			scheduler.Push(TxSource::Gdb, MakeBuffer(bufferPool, "$g#67"));
+
+			Assert::AreEqual("+"s, SendNext(scheduler, bufferPool));
+			Assert::AreEqual("$g#67"s, SendNext(scheduler, bufferPool));
+
+			// The other sources take turns of cBufferSize bytes
+
+			Assert::AreEqual("c1"s, SendNext(scheduler, bufferPool));
+			Assert::AreEqual("c2"s, SendNext(scheduler, bufferPool));
+			Assert::AreEqual("r1"s, SendNext(scheduler, bufferPool));
+			Assert::AreEqual("-"s, SendNext(scheduler, bufferPool));
+		}
+
+		TEST_METHOD(WeightedShare)
+		{
+			constexpr uint cGdbWeight{ 3 };
+			constexpr uint cNumRounds{ 10 };
+
+			BufferPool bufferPool{ cNumQueueBuffers * 3 };
+			TxScheduler scheduler{ cNumQueueBuffers, cGdbWeight };
+
+			// The data tells the source of a buffer
+
+			for (uint n{}; n < cNumQueueBuffers; ++n)
+			{
+				scheduler.Push(TxSource::Gdb, MakeBuffer(bufferPool, std::string(cBufferSize, 'g')));
+				scheduler.Push(TxSource::Console, MakeBuffer(bufferPool, std::string(cBufferSize, 'c')));
+				scheduler.Push(TxSource::Shm, MakeBuffer(bufferPool, std::string(cBufferSize, 's')));
+			}
+
+			std::map<char, uint> numSent;
+
+			for (uint n{}; n < cNumRounds * (cGdbWeight + 2); ++n)
+				++numSent[SendNext(scheduler, bufferPool).front()];
+
+			Assert::AreEqual(cNumRounds * cGdbWeight, numSent['g']);
+			Assert::AreEqual(cNumRounds, numSent['c']);
+			Assert::AreEqual(cNumRounds, numSent['s']);
+
+			while (SendNext(scheduler, bufferPool) != "-")
+				;
+		}
+
+		TEST_METHOD(GdbPacketNotInterleaved)
+		{
+			BufferPool bufferPool{ 16 };
+			TxScheduler scheduler{ cNumQueueBuffers, 1 };
+
+			scheduler.Push(TxSource::Gdb, MakeBuffer(bufferPool, "$m1000,"));
+			scheduler.Push(TxSource::Console, MakeBuffer(bufferPool, "ls\r"));
+
+			Assert::AreEqual("$m1000,"s, SendNext(scheduler, bufferPool));
+
+			// The console waits for the rest of the packet
+
+			Assert::AreEqual("-"s, SendNext(scheduler, bufferPool));
+
+			scheduler.Push(TxSource::Gdb, MakeBuffer(bufferPool, "4#"));
+			Assert::AreEqual("4#"s, SendNext(scheduler, bufferPool));
+			Assert::AreEqual("-"s, SendNext(scheduler, bufferPool));
+
+			scheduler.Push(TxSource::Gdb, MakeBuffer(bufferPool, "bc"));
+			Assert::AreEqual("bc"s, SendNext(scheduler, bufferPool));
+			Assert::AreEqual("ls\r"s, SendNext(scheduler, bufferPool));
+		}
+
+		TEST_METHOD(GdbPacketTimeout)
+		{
+			BufferPool bufferPool{ 16 };
+			TxScheduler scheduler{ cNumQueueBuffers, TxScheduler::cStrictPriority };
+
+			scheduler.Push(TxSource::Gdb, MakeBuffer(bufferPool, "$qSupported"));
+			scheduler.Push(TxSource::Raw, MakeBuffer(bufferPool, "r"));
+
+			Assert::AreEqual("$qSupported"s, SendNext(scheduler, bufferPool));
+			Assert::AreEqual("-"s, SendNext(scheduler, bufferPool));
+
+			auto holdTime{ scheduler.GetHoldTime() };
+			Assert::IsTrue(holdTime > 0us && holdTime <= TxScheduler::cGdbPacketTimeout);
+
+			// gdb has gone away in the middle of the packet
+
+			std::this_thread::sleep_for(TxScheduler::cGdbPacketTimeout + 20ms);
+
+			Assert::AreEqual("r"s, SendNext(scheduler, bufferPool));
+			Assert::IsTrue(scheduler.GetHoldTime() == 0us);
+		}
+	};
+}
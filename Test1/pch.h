@@ -2,6 +2,22 @@
 
 #include <cstdint>
 #include <cstddef>
+#include <cstdlib>
+#include <new>
 #include <span>
 #include <vector>
 #include <array>
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <coroutine>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <memory>
+#include <functional>
+#include <numeric>
+#include <source_location>
+#include <thread>